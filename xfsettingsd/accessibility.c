@@ -44,6 +44,11 @@
 #endif /* !HAVE_LIBNOTIFY */
 
 #include "debug.h"
+#include "metrics.h"
+#include "trace.h"
+#include "xfconf-snapshot.h"
+#include "xtrap.h"
+#include "dispatcher.h"
 #include "accessibility.h"
 
 
@@ -121,7 +126,7 @@ xfce_accessibility_helper_init (XfceAccessibilityHelper *helper)
     if (XkbQueryExtension (GDK_DISPLAY_XDISPLAY(gdk_display_get_default()), &dummy, &dummy, &dummy, &dummy, &dummy))
     {
         /* open the channel */
-        helper->channel = xfconf_channel_get ("accessibility");
+        helper->channel = xfsettings_snapshot_channel ("accessibility");
 
         /* monitor channel changes */
         g_signal_connect (G_OBJECT (helper->channel), "property-changed", G_CALLBACK (xfce_accessibility_helper_channel_property_changed), helper);
@@ -137,8 +142,8 @@ xfce_accessibility_helper_init (XfceAccessibilityHelper *helper)
         /* add event filter */
         XkbSelectEvents (GDK_DISPLAY_XDISPLAY(gdk_display_get_default()), XkbUseCoreKbd, XkbControlsNotifyMask, XkbControlsNotifyMask);
 
-        /* monitor all window events */
-        gdk_window_add_filter (NULL, xfce_accessibility_helper_event_filter, helper);
+        /* monitor the xkb controls */
+        xfsettings_dispatcher_add_xkb (XkbControlsNotify, xfce_accessibility_helper_event_filter, helper);
 #endif /* !HAVE_LIBNOTIFY */
     }
     else
@@ -156,6 +161,8 @@ xfce_accessibility_helper_finalize (GObject *object)
 #ifdef HAVE_LIBNOTIFY
     XfceAccessibilityHelper *helper = XFCE_ACCESSIBILITY_HELPER (object);
 
+    xfsettings_dispatcher_remove (xfce_accessibility_helper_event_filter, helper);
+
     /* close an opened notification */
     if (G_UNLIKELY (helper->notification))
         notify_notification_close (helper->notification, NULL);
@@ -175,7 +182,7 @@ xfce_accessibility_helper_set_xkb (XfceAccessibilityHelper *helper,
     gint       delay, interval, time_to_max;
     gint       max_speed, curve;
 
-    gdk_x11_display_error_trap_push (gdk_display_get_default ());
+    xfsettings_xtrap_begin (XFSD_HELPER_ACCESSIBILITY, "set-xkb");
 
     /* allocate */
     xkb = XkbAllocKeyboard ();
@@ -196,13 +203,16 @@ xfce_accessibility_helper_set_xkb (XfceAccessibilityHelper *helper,
         if (HAS_FLAG (mask, XkbMouseKeysMask))
             SET_FLAG (mask, XkbMouseKeysAccelMask);
 
-        /* load the xkb controls into the structure */
+        /* load the xkb controls into the structure, the enabled controls
+         * are always replaced, so this is the one round trip we need */
+        xfsettings_xtrap_push ("get keyboard controls");
         XkbGetControls (GDK_DISPLAY_XDISPLAY(gdk_display_get_default()), mask, xkb);
+        xfsettings_xtrap_pop ();
 
         /* AccessXKeys */
         if (HAS_FLAG (mask, XkbAccessXKeysMask))
         {
-            if (xfconf_channel_get_bool (helper->channel, "/AccessXKeys", FALSE))
+            if (xfsettings_snapshot_get_bool (helper->channel, "/AccessXKeys", FALSE))
             {
                 SET_FLAG (xkb->ctrls->enabled_ctrls, XkbAccessXKeysMask);
                 UNSET_FLAG (xkb->ctrls->axt_ctrls_mask, XkbAccessXKeysMask);
@@ -223,18 +233,18 @@ xfce_accessibility_helper_set_xkb (XfceAccessibilityHelper *helper,
         /* Sticky keys */
         if (HAS_FLAG (mask, XkbStickyKeysMask))
         {
-            if (xfconf_channel_get_bool (helper->channel, "/StickyKeys", FALSE))
+            if (xfsettings_snapshot_get_bool (helper->channel, "/StickyKeys", FALSE))
             {
                 SET_FLAG (xkb->ctrls->enabled_ctrls, XkbStickyKeysMask);
                 UNSET_FLAG (xkb->ctrls->axt_ctrls_mask, XkbStickyKeysMask);
                 UNSET_FLAG (xkb->ctrls->axt_ctrls_values, XkbStickyKeysMask);
 
-                if (xfconf_channel_get_bool (helper->channel, "/StickyKeys/LatchToLock", FALSE))
+                if (xfsettings_snapshot_get_bool (helper->channel, "/StickyKeys/LatchToLock", FALSE))
                     SET_FLAG (xkb->ctrls->ax_options, XkbAX_LatchToLockMask);
                 else
                     UNSET_FLAG (xkb->ctrls->ax_options, XkbAX_LatchToLockMask);
 
-                if (xfconf_channel_get_bool (helper->channel, "/StickyKeys/TwoKeysDisable", FALSE))
+                if (xfsettings_snapshot_get_bool (helper->channel, "/StickyKeys/TwoKeysDisable", FALSE))
                     SET_FLAG (xkb->ctrls->ax_options, XkbAX_TwoKeysMask);
                 else
                     UNSET_FLAG (xkb->ctrls->ax_options, XkbAX_TwoKeysMask);
@@ -255,13 +265,13 @@ xfce_accessibility_helper_set_xkb (XfceAccessibilityHelper *helper,
         /* Slow keys */
         if (HAS_FLAG (mask, XkbSlowKeysMask))
         {
-            if (xfconf_channel_get_bool (helper->channel, "/SlowKeys", FALSE))
+            if (xfsettings_snapshot_get_bool (helper->channel, "/SlowKeys", FALSE))
             {
                 SET_FLAG (xkb->ctrls->enabled_ctrls, XkbSlowKeysMask);
                 UNSET_FLAG (xkb->ctrls->axt_ctrls_mask, XkbSlowKeysMask);
                 UNSET_FLAG (xkb->ctrls->axt_ctrls_values, XkbSlowKeysMask);
 
-                delay = xfconf_channel_get_int (helper->channel, "/SlowKeys/Delay", 100);
+                delay = xfsettings_snapshot_get_int (helper->channel, "/SlowKeys/Delay", 100);
                 xkb->ctrls->slow_keys_delay = CLAMP (delay, 1, G_MAXUSHORT);
 
                 xfsettings_dbg (XFSD_DEBUG_ACCESSIBILITY, "slowkeys enabled (delay=%d)",
@@ -280,13 +290,13 @@ xfce_accessibility_helper_set_xkb (XfceAccessibilityHelper *helper,
         /* Bounce keys */
         if (HAS_FLAG (mask, XkbBounceKeysMask))
         {
-            if (xfconf_channel_get_bool (helper->channel, "/BounceKeys", FALSE))
+            if (xfsettings_snapshot_get_bool (helper->channel, "/BounceKeys", FALSE))
             {
                 SET_FLAG (xkb->ctrls->enabled_ctrls, XkbBounceKeysMask);
                 UNSET_FLAG (xkb->ctrls->axt_ctrls_mask, XkbBounceKeysMask);
                 UNSET_FLAG (xkb->ctrls->axt_ctrls_values, XkbBounceKeysMask);
 
-                delay = xfconf_channel_get_int (helper->channel, "/BounceKeys/Delay", 100);
+                delay = xfsettings_snapshot_get_int (helper->channel, "/BounceKeys/Delay", 100);
                 xkb->ctrls->debounce_delay = CLAMP (delay, 1, G_MAXUSHORT);
 
                 xfsettings_dbg (XFSD_DEBUG_ACCESSIBILITY, "bouncekeys enabled (delay=%d)",
@@ -305,18 +315,18 @@ xfce_accessibility_helper_set_xkb (XfceAccessibilityHelper *helper,
         /* Mouse keys */
         if (HAS_FLAG (mask, XkbMouseKeysMask))
         {
-            if (xfconf_channel_get_bool (helper->channel, "/MouseKeys", FALSE))
+            if (xfsettings_snapshot_get_bool (helper->channel, "/MouseKeys", FALSE))
             {
                 SET_FLAG (xkb->ctrls->enabled_ctrls, XkbMouseKeysMask);
                 UNSET_FLAG (xkb->ctrls->axt_ctrls_mask, XkbMouseKeysMask);
                 UNSET_FLAG (xkb->ctrls->axt_ctrls_values, XkbMouseKeysMask);
 
                 /* get values */
-                delay = xfconf_channel_get_int (helper->channel, "/MouseKeys/Delay", 160);
-                interval = xfconf_channel_get_int (helper->channel, "/MouseKeys/Interval", 20);
-                time_to_max = xfconf_channel_get_int (helper->channel, "/MouseKeys/TimeToMax", 3000);
-                max_speed = xfconf_channel_get_int (helper->channel, "/MouseKeys/MaxSpeed", 1000);
-                curve = xfconf_channel_get_int (helper->channel, "/MouseKeys/Curve", 0);
+                delay = xfsettings_snapshot_get_int (helper->channel, "/MouseKeys/Delay", 160);
+                interval = xfsettings_snapshot_get_int (helper->channel, "/MouseKeys/Interval", 20);
+                time_to_max = xfsettings_snapshot_get_int (helper->channel, "/MouseKeys/TimeToMax", 3000);
+                max_speed = xfsettings_snapshot_get_int (helper->channel, "/MouseKeys/MaxSpeed", 1000);
+                curve = xfsettings_snapshot_get_int (helper->channel, "/MouseKeys/Curve", 0);
 
                 /* calculate maximum speed and to to reach it */
                 interval = CLAMP (interval, 1, G_MAXUSHORT);
@@ -348,8 +358,10 @@ xfce_accessibility_helper_set_xkb (XfceAccessibilityHelper *helper,
         }
 
         /* set the modified controls */
+        xfsettings_xtrap_push ("set keyboard controls");
         if (!XkbSetControls (GDK_DISPLAY_XDISPLAY(gdk_display_get_default()), mask, xkb))
             g_message ("Setting the xkb controls failed");
+        xfsettings_xtrap_pop ();
 
         /* free the structure */
         XkbFreeControls (xkb, mask, True);
@@ -361,8 +373,7 @@ xfce_accessibility_helper_set_xkb (XfceAccessibilityHelper *helper,
         g_critical ("XkbAllocKeyboard() returned a null pointer");
     }
 
-    if (gdk_x11_display_error_trap_pop (gdk_display_get_default ()) != 0)
-       g_critical ("Failed to set keyboard controls");
+    xfsettings_xtrap_commit ();
 }
 
 
@@ -389,7 +400,10 @@ xfce_accessibility_helper_channel_property_changed (XfconfChannel           *cha
         return;
 
     /* update the xkb settings */
+    xfsettings_metrics_changed (XFSD_HELPER_ACCESSIBILITY, property_name);
+    xfsettings_trace (XFSD_HELPER_ACCESSIBILITY, XFSD_TRACE_APPLY_START, 0);
     xfce_accessibility_helper_set_xkb (helper, mask);
+    xfsettings_metrics_applied (XFSD_HELPER_ACCESSIBILITY);
 }
 
 
@@ -406,6 +420,8 @@ xfce_accessibility_helper_event_filter (GdkXEvent *xevent,
     switch (event->any.xkb_type)
     {
         case XkbControlsNotify:
+            xfsettings_trace (XFSD_HELPER_ACCESSIBILITY, XFSD_TRACE_X_EVENT, event->type);
+
             if (HAS_FLAG (event->ctrls.enabled_ctrl_changes, XkbStickyKeysMask))
             {
                 if (HAS_FLAG (event->ctrls.enabled_ctrls, XkbStickyKeysMask))
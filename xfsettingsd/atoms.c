@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Atom registry of the daemon. The atoms the helpers know about are
+ * interned with a single XInternAtoms call before the helpers start,
+ * that sends all the requests before waiting for the first reply.
+ * Other atoms, like device property names, are interned the first time
+ * they are looked up and cached after that, so the property-changed
+ * paths do not wait for the server each time.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <X11/Xlib.h>
+
+#include "atoms.h"
+#include "debug.h"
+
+
+
+static const gchar *atom_names[] =
+{
+    "ATOM_PAIR",               /* XFSD_ATOM_ATOM_PAIR */
+    "CLIPBOARD",               /* XFSD_ATOM_CLIPBOARD */
+    "CLIPBOARD_MANAGER",       /* XFSD_ATOM_CLIPBOARD_MANAGER */
+    "DELETE",                  /* XFSD_ATOM_DELETE */
+    "Device Enabled",          /* XFSD_ATOM_DEVICE_ENABLED */
+    "FLOAT",                   /* XFSD_ATOM_FLOAT */
+    "INCR",                    /* XFSD_ATOM_INCR */
+    "INSERT_PROPERTY",         /* XFSD_ATOM_INSERT_PROPERTY */
+    "INSERT_SELECTION",        /* XFSD_ATOM_INSERT_SELECTION */
+    "MANAGER",                 /* XFSD_ATOM_MANAGER */
+    "MULTIPLE",                /* XFSD_ATOM_MULTIPLE */
+    "NULL",                    /* XFSD_ATOM_NULL */
+    "Num Lock",                /* XFSD_ATOM_NUM_LOCK */
+    "SAVE_TARGETS",            /* XFSD_ATOM_SAVE_TARGETS */
+    "TARGETS",                 /* XFSD_ATOM_TARGETS */
+    "TIMESTAMP",               /* XFSD_ATOM_TIMESTAMP */
+    "UTF8_STRING",             /* XFSD_ATOM_UTF8_STRING */
+    "_NET_DESKTOP_NAMES",      /* XFSD_ATOM_NET_DESKTOP_NAMES */
+    "_NET_NUMBER_OF_DESKTOPS", /* XFSD_ATOM_NET_NUMBER_OF_DESKTOPS */
+    "_TIMESTAMP_PROP",         /* XFSD_ATOM_TIMESTAMP_PROP */
+    "_XSETTINGS_SETTINGS"      /* XFSD_ATOM_XSETTINGS_SETTINGS */
+};
+
+G_STATIC_ASSERT (G_N_ELEMENTS (atom_names) == XFSD_N_ATOMS);
+
+static Display *atoms_xdisplay = NULL;
+static Atom     atoms[XFSD_N_ATOMS];
+
+/* name -> Atom, for all known atoms */
+static GHashTable *atoms_cache = NULL;
+
+
+
+void
+xfsettings_atoms_init (Display *xdisplay)
+{
+    guint n;
+
+    g_return_if_fail (xdisplay != NULL);
+    g_return_if_fail (atoms_xdisplay == NULL);
+
+    atoms_xdisplay = xdisplay;
+    atoms_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+    /* one round trip for all the atoms */
+    if (!XInternAtoms (xdisplay, (gchar **) atom_names, XFSD_N_ATOMS, False, atoms))
+        g_critical ("Failed to intern the atoms");
+
+    for (n = 0; n < XFSD_N_ATOMS; n++)
+    {
+        if (G_LIKELY (atoms[n] != None))
+        {
+            g_hash_table_insert (atoms_cache, g_strdup (atom_names[n]),
+                                 GUINT_TO_POINTER (atoms[n]));
+        }
+    }
+
+    xfsettings_dbg (XFSD_DEBUG_STARTUP, "interned %d atoms", XFSD_N_ATOMS);
+}
+
+
+
+Atom
+xfsettings_atom (XfsdAtom atom)
+{
+    g_return_val_if_fail (atom < XFSD_N_ATOMS, None);
+    g_return_val_if_fail (atoms_xdisplay != NULL, None);
+
+    return atoms[atom];
+}
+
+
+
+Atom
+xfsettings_atoms_lookup (const gchar *name,
+                         gboolean     only_if_exists)
+{
+    Atom atom;
+
+    g_return_val_if_fail (name != NULL, None);
+    g_return_val_if_fail (atoms_xdisplay != NULL, None);
+
+    atom = GPOINTER_TO_UINT (g_hash_table_lookup (atoms_cache, name));
+    if (G_LIKELY (atom != None))
+        return atom;
+
+    /* a missing atom can be created later on, so None is not cached */
+    atom = XInternAtom (atoms_xdisplay, name, only_if_exists);
+    if (atom != None)
+        g_hash_table_insert (atoms_cache, g_strdup (name), GUINT_TO_POINTER (atom));
+
+    return atom;
+}
+
+
+
+void
+xfsettings_atoms_shutdown (void)
+{
+    if (atoms_cache != NULL)
+    {
+        g_hash_table_destroy (atoms_cache);
+        atoms_cache = NULL;
+    }
+
+    atoms_xdisplay = NULL;
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __ATOMS_H__
+#define __ATOMS_H__
+
+#include <glib.h>
+#include <X11/Xlib.h>
+
+/* keep in sync with atom_names in atoms.c */
+typedef enum
+{
+    XFSD_ATOM_ATOM_PAIR,
+    XFSD_ATOM_CLIPBOARD,
+    XFSD_ATOM_CLIPBOARD_MANAGER,
+    XFSD_ATOM_DELETE,
+    XFSD_ATOM_DEVICE_ENABLED,
+    XFSD_ATOM_FLOAT,
+    XFSD_ATOM_INCR,
+    XFSD_ATOM_INSERT_PROPERTY,
+    XFSD_ATOM_INSERT_SELECTION,
+    XFSD_ATOM_MANAGER,
+    XFSD_ATOM_MULTIPLE,
+    XFSD_ATOM_NULL,
+    XFSD_ATOM_NUM_LOCK,
+    XFSD_ATOM_SAVE_TARGETS,
+    XFSD_ATOM_TARGETS,
+    XFSD_ATOM_TIMESTAMP,
+    XFSD_ATOM_UTF8_STRING,
+    XFSD_ATOM_NET_DESKTOP_NAMES,
+    XFSD_ATOM_NET_NUMBER_OF_DESKTOPS,
+    XFSD_ATOM_TIMESTAMP_PROP,
+    XFSD_ATOM_XSETTINGS_SETTINGS,
+
+    XFSD_N_ATOMS
+}
+XfsdAtom;
+
+void xfsettings_atoms_init     (Display     *xdisplay);
+
+Atom xfsettings_atom           (XfsdAtom     atom);
+
+Atom xfsettings_atoms_lookup   (const gchar *name,
+                                gboolean     only_if_exists);
+
+void xfsettings_atoms_shutdown (void);
+
+#endif /* !__ATOMS_H__ */
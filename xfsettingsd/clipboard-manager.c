@@ -29,6 +29,15 @@
 #ifdef HAVE_STRING_H
 #include <string.h>
 #endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_MEMFD_CREATE
+#include <fcntl.h>
+#endif
 
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
@@ -39,30 +48,133 @@
 
 #include "clipboard-manager.h"
 #include "xsettings.h"
+#include "atoms.h"
+#include "metrics.h"
+#include "trace.h"
+#include "dispatcher.h"
+#include "memory.h"
+#include "xfconf-snapshot.h"
+#include "debug.h"
+
+/* payloads of at least this size are moved out of the heap, 0 to disable */
+#define SPILL_THRESHOLD_PROP    "/Clipboard/SpillThreshold"
+#define SPILL_THRESHOLD_DEFAULT 65536
+
+/* larger payloads are not saved, 0 for no limit */
+#define MAX_PAYLOAD_SIZE_PROP   "/Clipboard/MaxPayloadSize"
+
+/* text payloads of at least this size are compressed in a worker, 0 to disable */
+#define COMPRESS_THRESHOLD_PROP    "/Clipboard/CompressThreshold"
+#define COMPRESS_THRESHOLD_DEFAULT 262144
+
+/* size of the chunks of a compressed payload and
+ * of the buffer it is decompressed in */
+#define COMPRESS_CHUNK_SIZE     65536
 
 struct _GsdClipboardManagerPrivate
 {
-        guint    start_idle_id;
-        Display *display;
-        Window   window;
-        Time     timestamp;
+        guint           start_idle_id;
+        Display        *display;
+        Window          window;
+        Time            timestamp;
+
+        /* limits of the saved data */
+        XfconfChannel  *channel;
+
+        /* list of TargetData */
+        GSList         *contents;
 
-        GSList  *contents;
-        GSList  *conversions;
+        /* target atom -> TargetData in contents */
+        GHashTable     *targets;
 
-        Window   requestor;
-        Atom     property;
-        Time     time;
+        /* number of contents still received incrementally */
+        guint           n_incr;
+
+        /* payload length -> GSList of TargetPayload in contents */
+        GHashTable     *payloads;
+
+        /* type atom -> whether it is text, saves a round trip per save */
+        GHashTable     *text_types;
+
+        /* set of IncrConversion, by requestor and property */
+        GHashTable     *conversions;
+
+        Window          requestor;
+        Atom            property;
+        Time            time;
 };
 
+/* the data of a target is kept in the chunks it was received in, so
+ * an incremental transfer is neither copied on receive nor on send */
 typedef struct
 {
         guchar *data;
         gulong  length;
-        Atom    target;
-        Atom    type;
-        gint    format;
-        gint    refcount;
+} TargetChunk;
+
+typedef struct _TargetPayload TargetPayload;
+
+/* applications offer the same bytes under several targets, those
+ * targets share one payload */
+struct _TargetPayload
+{
+        GArray        *chunks;
+        gulong         length;
+        gint           refcount;
+
+        /* bytes in the chunks, less than length when compressed */
+        gulong         size;
+
+        /* raw deflate stream in g_malloc'ed chunks */
+        guint          compressed : 1;
+
+        /* mapping holding the data of a spilled payload */
+        guchar        *map;
+
+        /* readers at a position in the chunks, the
+         * chunks are only replaced when there are none */
+        guint          n_readers;
+
+        /* set while a worker compresses or spills the payload, it is
+         * cancelled when the worker holds the last reference */
+        GCancellable  *cancellable;
+
+        /* storage made by the worker, waiting for the readers */
+        TargetPayload *pending;
+};
+
+/* compressing or spilling a payload in a worker thread */
+typedef struct
+{
+        TargetPayload *payload;
+        gboolean       compress;
+        gulong         spill_threshold;
+        gint64         time;
+} StoreJob;
+
+/* reads the bytes of a payload in order, decompressing if needed */
+typedef struct
+{
+        TargetPayload *payload;
+        guint          chunk;
+        gulong         chunk_offset;
+
+        /* for compressed payloads */
+        GConverter    *decompressor;
+        guchar        *buffer;
+        gint64         decompress_time;
+} PayloadReader;
+
+typedef struct
+{
+        TargetPayload *payload;
+        Atom           target;
+        Atom           type;
+        gint           format;
+        gint           refcount;
+
+        /* larger than the limit, dropped once received */
+        guint          discard : 1;
 } TargetData;
 
 typedef struct
@@ -72,9 +184,16 @@ typedef struct
         Atom        property;
         Window      requestor;
         gint        offset;
+
+        /* position of the next incremental chunk */
+        PayloadReader reader;
 } IncrConversion;
 
 static void     gsd_clipboard_manager_finalize    (GObject                  *object);
+static void     conversion_free                   (IncrConversion           *rdata);
+static guint    conversion_hash                   (gconstpointer             key);
+static gboolean conversion_equal                  (gconstpointer             a,
+                                                   gconstpointer             b);
 static void     clipboard_manager_watch_cb        (GsdClipboardManager *manager,
                                                    Window               window,
                                                    Bool                 is_start,
@@ -120,6 +239,12 @@ gsd_clipboard_manager_init (GsdClipboardManager *manager)
 
         manager->priv->display = GDK_DISPLAY_XDISPLAY (gdk_display_get_default ());
 
+        manager->priv->targets = g_hash_table_new (g_direct_hash, g_direct_equal);
+        manager->priv->payloads = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                                         NULL, (GDestroyNotify) g_slist_free);
+        manager->priv->text_types = g_hash_table_new (g_direct_hash, g_direct_equal);
+        manager->priv->conversions = g_hash_table_new_full (conversion_hash, conversion_equal,
+                                                            (GDestroyNotify) conversion_free, NULL);
 }
 
 static void
@@ -130,9 +255,515 @@ gsd_clipboard_manager_finalize (GObject *object)
         if (clipboard_manager->priv->start_idle_id !=0)
                 g_source_remove (clipboard_manager->priv->start_idle_id);
 
+        g_hash_table_destroy (clipboard_manager->priv->targets);
+        g_hash_table_destroy (clipboard_manager->priv->payloads);
+        g_hash_table_destroy (clipboard_manager->priv->text_types);
+        g_hash_table_destroy (clipboard_manager->priv->conversions);
+
         G_OBJECT_CLASS (gsd_clipboard_manager_parent_class)->finalize (object);
 }
 
+static TargetPayload *
+target_payload_new (void)
+{
+        TargetPayload *payload;
+
+        payload = g_slice_new (TargetPayload);
+        payload->chunks = g_array_new (FALSE, FALSE, sizeof (TargetChunk));
+        payload->length = 0;
+        payload->refcount = 1;
+        payload->size = 0;
+        payload->compressed = FALSE;
+        payload->map = NULL;
+        payload->n_readers = 0;
+        payload->cancellable = NULL;
+        payload->pending = NULL;
+
+        return payload;
+}
+
+/* received chunks are owned by Xlib, compressed ones by us */
+static void
+target_payload_free_chunks (TargetPayload *payload)
+{
+        TargetChunk *chunk;
+        guint        i;
+
+        for (i = 0; i < payload->chunks->len; i++) {
+                chunk = &g_array_index (payload->chunks, TargetChunk, i);
+                if (payload->compressed)
+                        g_free (chunk->data);
+                else
+                        XFree (chunk->data);
+        }
+
+        g_array_set_size (payload->chunks, 0);
+}
+
+static void
+target_payload_unref (TargetPayload *payload)
+{
+        payload->refcount--;
+
+        /* nobody but the worker uses it anymore */
+        if (payload->refcount == 1 && payload->cancellable != NULL)
+                g_cancellable_cancel (payload->cancellable);
+
+        if (payload->refcount == 0) {
+                if (payload->pending != NULL)
+                        target_payload_unref (payload->pending);
+#ifdef HAVE_SYS_MMAN_H
+                if (payload->map != NULL) {
+                        /* returned to the system right away */
+                        munmap (payload->map, payload->size);
+                } else
+#endif
+                target_payload_free_chunks (payload);
+                g_array_free (payload->chunks, TRUE);
+                g_slice_free (TargetPayload, payload);
+        }
+}
+
+/* copy the data of a large payload out of the heap into a mapping of
+ * its own: freed heap memory is not always returned to the system, an
+ * unmapped payload is. A memfd is used when available so the mapping
+ * is named in /proc/<pid>/maps and its size is sealed. Only reads the
+ * chunks, so it can run in a worker. Returns NULL on failure */
+static guchar *
+target_payload_map (TargetPayload *payload)
+{
+#ifdef HAVE_SYS_MMAN_H
+        guchar      *map = MAP_FAILED;
+        TargetChunk *chunk;
+        gulong       offset;
+        guint        i;
+#ifdef HAVE_MEMFD_CREATE
+        gint         fd;
+
+        fd = memfd_create ("xfsettingsd-clipboard", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (fd != -1) {
+                if (ftruncate (fd, payload->size) == 0)
+                        map = mmap (NULL, payload->size, PROT_READ | PROT_WRITE,
+                                    MAP_SHARED, fd, 0);
+                if (map != MAP_FAILED)
+                        fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+
+                /* the mapping keeps the file alive */
+                close (fd);
+        }
+#endif
+
+        if (map == MAP_FAILED)
+                map = mmap (NULL, payload->size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (map == MAP_FAILED)
+                return NULL;
+
+        offset = 0;
+        for (i = 0; i < payload->chunks->len; i++) {
+                chunk = &g_array_index (payload->chunks, TargetChunk, i);
+                memcpy (map + offset, chunk->data, chunk->length);
+                offset += chunk->length;
+        }
+
+        mprotect (map, payload->size, PROT_READ);
+
+        return map;
+#else
+        return NULL;
+#endif
+}
+
+/* replace the chunks of a payload with its mapping */
+static void
+target_payload_set_map (TargetPayload *payload,
+                        guchar        *map)
+{
+        TargetChunk spilled;
+
+        target_payload_free_chunks (payload);
+
+        spilled.data = map;
+        spilled.length = payload->size;
+        g_array_append_val (payload->chunks, spilled);
+
+        payload->map = map;
+}
+
+static void
+target_payload_spill (TargetPayload *payload)
+{
+        guchar *map;
+
+        /* keep it on the heap if there is no mapping */
+        map = target_payload_map (payload);
+        if (map != NULL)
+                target_payload_set_map (payload, map);
+}
+
+/* compress a text payload into a new payload holding a raw deflate
+ * stream in chunks of COMPRESS_CHUNK_SIZE. Text like logs, CSV and HTML
+ * is repetitive, so a fast level already shrinks it a lot; returns NULL
+ * if that does not save at least a quarter. Only reads the chunks of
+ * the payload, so it can run in a worker */
+static TargetPayload *
+target_payload_compress (TargetPayload *payload,
+                         GCancellable  *cancellable)
+{
+        GConverter       *compressor;
+        GConverterResult  result;
+        GArray           *chunks;
+        TargetChunk      *chunk;
+        TargetChunk       out;
+        TargetPayload    *compressed;
+        gsize             bytes_read, bytes_written;
+        gulong            offset = 0, size = 0;
+        guint             i = 0;
+        GError           *error = NULL;
+
+        compressor = G_CONVERTER (g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW, 1));
+        chunks = g_array_new (FALSE, FALSE, sizeof (TargetChunk));
+        out.data = NULL;
+        out.length = 0;
+
+        do {
+                if (out.data == NULL)
+                        out.data = g_malloc (COMPRESS_CHUNK_SIZE);
+
+                chunk = i < payload->chunks->len
+                        ? &g_array_index (payload->chunks, TargetChunk, i) : NULL;
+                result = g_converter_convert (compressor,
+                                              chunk ? chunk->data + offset : NULL,
+                                              chunk ? chunk->length - offset : 0,
+                                              out.data + out.length,
+                                              COMPRESS_CHUNK_SIZE - out.length,
+                                              chunk ? G_CONVERTER_NO_FLAGS : G_CONVERTER_INPUT_AT_END,
+                                              &bytes_read, &bytes_written, &error);
+                if (result == G_CONVERTER_ERROR) {
+                        g_warning ("Failed to compress clipboard data: %s", error->message);
+                        g_error_free (error);
+                        break;
+                }
+
+                offset += bytes_read;
+                if (chunk && offset == chunk->length) {
+                        i++;
+                        offset = 0;
+                }
+
+                out.length += bytes_written;
+                size += bytes_written;
+                if (out.length == COMPRESS_CHUNK_SIZE || result == G_CONVERTER_FINISHED) {
+                        g_array_append_val (chunks, out);
+                        out.data = NULL;
+                        out.length = 0;
+                }
+        } while (result != G_CONVERTER_FINISHED && size < payload->length / 4 * 3
+                 && !g_cancellable_is_cancelled (cancellable));
+
+        g_object_unref (compressor);
+
+        if (result != G_CONVERTER_FINISHED || size >= payload->length / 4 * 3) {
+                g_free (out.data);
+                for (i = 0; i < chunks->len; i++)
+                        g_free (g_array_index (chunks, TargetChunk, i).data);
+                g_array_free (chunks, TRUE);
+
+                return NULL;
+        }
+
+        compressed = target_payload_new ();
+        g_array_free (compressed->chunks, TRUE);
+        compressed->chunks = chunks;
+        compressed->length = payload->length;
+        compressed->size = size;
+        compressed->compressed = TRUE;
+
+        return compressed;
+}
+
+/* give a payload the storage of another one, which is
+ * then freed together with the old storage */
+static void
+target_payload_replace (TargetPayload *payload,
+                        TargetPayload *storage)
+{
+        TargetPayload old = *payload;
+
+        payload->chunks = storage->chunks;
+        payload->size = storage->size;
+        payload->compressed = storage->compressed;
+        payload->map = storage->map;
+
+        storage->chunks = old.chunks;
+        storage->size = old.size;
+        storage->compressed = old.compressed;
+        storage->map = old.map;
+
+        target_payload_unref (storage);
+}
+
+static void
+store_job_free (gpointer data)
+{
+        g_slice_free (StoreJob, data);
+}
+
+/* runs in a worker: the chunks of the payload are not changed while
+ * a job runs, and its refcount is only touched on the main thread */
+static void
+store_job_thread (GTask        *task,
+                  gpointer      source_object,
+                  gpointer      task_data,
+                  GCancellable *cancellable)
+{
+        StoreJob      *job = task_data;
+        TargetPayload *storage = NULL;
+        guchar        *map;
+        gint64         start;
+
+        start = g_get_monotonic_time ();
+
+        if (job->compress)
+                storage = target_payload_compress (job->payload, cancellable);
+
+        if (storage != NULL) {
+                if (job->spill_threshold > 0 && storage->size >= job->spill_threshold)
+                        target_payload_spill (storage);
+        } else if (job->spill_threshold > 0 && job->payload->size >= job->spill_threshold
+                   && !g_cancellable_is_cancelled (cancellable)) {
+                map = target_payload_map (job->payload);
+                if (map != NULL) {
+                        storage = target_payload_new ();
+                        storage->length = job->payload->length;
+                        storage->size = job->payload->size;
+                        target_payload_set_map (storage, map);
+                }
+        }
+
+        job->time = g_get_monotonic_time () - start;
+
+        g_task_return_pointer (task, storage, (GDestroyNotify) target_payload_unref);
+}
+
+static void
+store_job_done (GObject      *source_object,
+                GAsyncResult *result,
+                gpointer      user_data)
+{
+        TargetPayload *payload = user_data;
+        TargetPayload *storage;
+        StoreJob      *job;
+
+        job = g_task_get_task_data (G_TASK (result));
+        storage = g_task_propagate_pointer (G_TASK (result), NULL);
+
+        g_clear_object (&payload->cancellable);
+
+        if (storage != NULL) {
+                if (storage->compressed)
+                        xfsettings_dbg (XFSD_DEBUG_CLIPBOARD, "clipboard payload compressed from %lu "
+                                        "to %lu bytes in %.3f ms", payload->length,
+                                        storage->size, job->time / 1000.0);
+                else
+                        xfsettings_dbg (XFSD_DEBUG_CLIPBOARD, "clipboard payload of %lu bytes "
+                                        "spilled in %.3f ms", payload->length, job->time / 1000.0);
+
+                /* a running transfer keeps reading the old chunks */
+                if (payload->n_readers == 0)
+                        target_payload_replace (payload, storage);
+                else
+                        payload->pending = storage;
+        }
+
+        /* the reference of the job */
+        target_payload_unref (payload);
+}
+
+/* compressing tens of megabytes takes longer than a frame, so it is
+ * done in a worker and the payload is served as it is meanwhile */
+static void
+target_payload_store (GsdClipboardManager *manager,
+                      TargetPayload       *payload,
+                      gboolean             compress,
+                      gulong               spill_threshold)
+{
+        StoreJob *job;
+        GTask    *task;
+
+        job = g_slice_new0 (StoreJob);
+        job->payload = payload;
+        job->compress = compress;
+        job->spill_threshold = spill_threshold;
+
+        payload->refcount++;
+        payload->cancellable = g_cancellable_new ();
+
+        task = g_task_new (manager, payload->cancellable, store_job_done, payload);
+        g_task_set_task_data (task, job, store_job_free);
+        g_task_run_in_thread (task, store_job_thread);
+        g_object_unref (task);
+}
+
+static void
+payload_reader_init (PayloadReader *reader,
+                     TargetPayload *payload)
+{
+        reader->payload = payload;
+        reader->payload->n_readers++;
+        reader->chunk = 0;
+        reader->chunk_offset = 0;
+        reader->decompressor = NULL;
+        reader->buffer = NULL;
+        reader->decompress_time = 0;
+}
+
+static void
+payload_reader_clear (PayloadReader *reader)
+{
+        TargetPayload *payload = reader->payload;
+
+        if (reader->decompressor)
+                g_object_unref (reader->decompressor);
+        g_free (reader->buffer);
+
+        reader->payload = NULL;
+        reader->decompressor = NULL;
+        reader->buffer = NULL;
+
+        /* the last reader is done, use what a worker made meanwhile */
+        if (payload != NULL && --payload->n_readers == 0
+            && payload->pending != NULL) {
+                target_payload_replace (payload, payload->pending);
+                payload->pending = NULL;
+        }
+}
+
+/* returns the next at most max_length bytes of the payload in data,
+ * 0 at the end. Stored bytes are not copied, compressed bytes are
+ * decompressed in a buffer that is valid until the next read */
+static gulong
+payload_reader_read (PayloadReader  *reader,
+                     gulong          max_length,
+                     guchar        **data)
+{
+        TargetPayload    *payload = reader->payload;
+        TargetChunk      *chunk;
+        GConverterResult  result;
+        gsize             bytes_read, bytes_written;
+        gulong            length = 0;
+        gint64            start;
+        GError           *error = NULL;
+
+        if (!payload->compressed) {
+                if (reader->chunk >= payload->chunks->len)
+                        return 0;
+
+                chunk = &g_array_index (payload->chunks, TargetChunk, reader->chunk);
+                *data = chunk->data + reader->chunk_offset;
+                length = MIN (chunk->length - reader->chunk_offset, max_length);
+
+                reader->chunk_offset += length;
+                if (reader->chunk_offset == chunk->length) {
+                        reader->chunk++;
+                        reader->chunk_offset = 0;
+                }
+
+                return length;
+        }
+
+        /* past the end of the stream */
+        if (reader->chunk > payload->chunks->len)
+                return 0;
+
+        start = g_get_monotonic_time ();
+
+        if (reader->decompressor == NULL) {
+                reader->decompressor =
+                        G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW));
+                reader->buffer = g_malloc (COMPRESS_CHUNK_SIZE);
+        }
+
+        max_length = MIN (max_length, COMPRESS_CHUNK_SIZE);
+        while (length < max_length) {
+                chunk = reader->chunk < payload->chunks->len
+                        ? &g_array_index (payload->chunks, TargetChunk, reader->chunk) : NULL;
+                result = g_converter_convert (reader->decompressor,
+                                              chunk ? chunk->data + reader->chunk_offset : NULL,
+                                              chunk ? chunk->length - reader->chunk_offset : 0,
+                                              reader->buffer + length, max_length - length,
+                                              chunk ? G_CONVERTER_NO_FLAGS : G_CONVERTER_INPUT_AT_END,
+                                              &bytes_read, &bytes_written, &error);
+                if (result == G_CONVERTER_ERROR) {
+                        g_critical ("Failed to decompress clipboard data: %s", error->message);
+                        g_error_free (error);
+                        reader->chunk = payload->chunks->len + 1;
+                        break;
+                }
+
+                length += bytes_written;
+
+                reader->chunk_offset += bytes_read;
+                if (chunk && reader->chunk_offset == chunk->length) {
+                        reader->chunk++;
+                        reader->chunk_offset = 0;
+                }
+
+                if (result == G_CONVERTER_FINISHED) {
+                        reader->chunk = payload->chunks->len + 1;
+                        break;
+                }
+        }
+
+        reader->decompress_time += g_get_monotonic_time () - start;
+
+        *data = reader->buffer;
+
+        return length;
+}
+
+/* compare the bytes of two payloads of the same length, their
+ * data can be split in different chunks or be compressed */
+static gboolean
+target_payload_equal (TargetPayload *a,
+                      TargetPayload *b)
+{
+        PayloadReader reader_a, reader_b;
+        guchar       *data_a = NULL, *data_b = NULL;
+        gulong        length_a = 0, length_b = 0;
+        gulong        length;
+        gboolean      equal = TRUE;
+
+        if (a->length != b->length)
+                return FALSE;
+
+        payload_reader_init (&reader_a, a);
+        payload_reader_init (&reader_b, b);
+
+        while (equal) {
+                if (length_a == 0)
+                        length_a = payload_reader_read (&reader_a, G_MAXULONG, &data_a);
+                if (length_b == 0)
+                        length_b = payload_reader_read (&reader_b, G_MAXULONG, &data_b);
+                if (length_a == 0 || length_b == 0)
+                        break;
+
+                length = MIN (length_a, length_b);
+                equal = memcmp (data_a, data_b, length) == 0;
+
+                data_a += length;
+                length_a -= length;
+                data_b += length;
+                length_b -= length;
+        }
+
+        payload_reader_clear (&reader_a);
+        payload_reader_clear (&reader_b);
+
+        return equal && length_a == length_b;
+}
+
 /* We need to use reference counting for the target data, since we may
  * need to keep the data around after loosing the CLIPBOARD ownership
  * to complete incremental transfers.
@@ -149,19 +780,265 @@ target_data_unref (TargetData *data)
 {
         data->refcount--;
         if (data->refcount == 0) {
-                g_free (data->data);
+                target_payload_unref (data->payload);
                 g_slice_free (TargetData, data);
         }
 }
 
+/* takes the data returned by XGetWindowProperty */
+static void
+target_data_add_chunk (TargetData *tdata,
+                       guchar     *data,
+                       gulong      length)
+{
+        TargetChunk chunk;
+
+        if (length == 0) {
+                if (data)
+                        XFree (data);
+                return;
+        }
+
+        /* only done while receiving, the payload is not shared yet */
+        g_assert (tdata->payload->refcount == 1);
+
+        chunk.data = data;
+        chunk.length = length;
+        g_array_append_val (tdata->payload->chunks, chunk);
+
+        tdata->payload->length += length;
+        tdata->payload->size += length;
+}
+
 static void
 conversion_free (IncrConversion *rdata)
 {
+        payload_reader_clear (&rdata->reader);
         if (rdata->data)
                 target_data_unref (rdata->data);
         g_slice_free (IncrConversion, rdata);
 }
 
+/* a running transfer is identified by the requestor
+ * and the property we append the chunks to */
+static guint
+conversion_hash (gconstpointer key)
+{
+        const IncrConversion *rdata = key;
+
+        return (guint) rdata->requestor * 31 + (guint) rdata->property;
+}
+
+static gboolean
+conversion_equal (gconstpointer a,
+                  gconstpointer b)
+{
+        const IncrConversion *rdata_a = a;
+        const IncrConversion *rdata_b = b;
+
+        return rdata_a->requestor == rdata_b->requestor
+               && rdata_a->property == rdata_b->property;
+}
+
+static void
+add_content (GsdClipboardManager *manager,
+             TargetData          *tdata)
+{
+        manager->priv->contents = g_slist_prepend (manager->priv->contents, tdata);
+        g_hash_table_insert (manager->priv->targets,
+                             GUINT_TO_POINTER (tdata->target), tdata);
+}
+
+static TargetData *
+lookup_content (GsdClipboardManager *manager,
+                Atom                 target)
+{
+        return g_hash_table_lookup (manager->priv->targets, GUINT_TO_POINTER (target));
+}
+
+static void
+clear_contents (GsdClipboardManager *manager)
+{
+        g_slist_foreach (manager->priv->contents, (GFunc) (void (*)(void)) target_data_unref, NULL);
+        g_slist_free (manager->priv->contents);
+        manager->priv->contents = NULL;
+
+        g_hash_table_remove_all (manager->priv->targets);
+        g_hash_table_remove_all (manager->priv->payloads);
+        manager->priv->n_incr = 0;
+}
+
+static void
+remove_content (GsdClipboardManager *manager,
+                TargetData          *tdata)
+{
+        manager->priv->contents = g_slist_remove (manager->priv->contents, tdata);
+        g_hash_table_remove (manager->priv->targets, GUINT_TO_POINTER (tdata->target));
+        target_data_unref (tdata);
+}
+
+static gulong
+clipboard_limit (GsdClipboardManager *manager,
+                 const gchar         *property,
+                 gint                 default_value)
+{
+        gint value;
+
+        value = xfsettings_snapshot_get_int (manager->priv->channel, property, default_value);
+
+        return MAX (value, 0);
+}
+
+/* the type of text targets is the target itself for mime types */
+static gboolean
+clipboard_is_text (GsdClipboardManager *manager,
+                   Atom                 type)
+{
+        gpointer  value;
+        gchar    *name;
+        gboolean  is_text;
+
+        if (type == XA_STRING || type == xfsettings_atom (XFSD_ATOM_UTF8_STRING))
+                return TRUE;
+
+        if (g_hash_table_lookup_extended (manager->priv->text_types,
+                                          GUINT_TO_POINTER (type), NULL, &value))
+                return GPOINTER_TO_INT (value);
+
+        name = XGetAtomName (manager->priv->display, type);
+        is_text = name != NULL
+                  && (g_str_has_prefix (name, "text/")
+                      || strcmp (name, "TEXT") == 0
+                      || strcmp (name, "COMPOUND_TEXT") == 0);
+        if (name)
+                XFree (name);
+
+        g_hash_table_insert (manager->priv->text_types,
+                             GUINT_TO_POINTER (type), GINT_TO_POINTER (is_text));
+
+        return is_text;
+}
+
+/* called when all data of a target is received: if another target in
+ * the contents has the same bytes, use its payload. The payloads are
+ * indexed by length and compared byte for byte, most lengths are unique
+ * so unlike a content hash this does not read every payload */
+static void
+share_payload (GsdClipboardManager *manager,
+               TargetData          *tdata)
+{
+        GSList        *candidates, *list;
+        TargetPayload *payload;
+        gpointer       key;
+        gulong         spill_threshold;
+        gulong         threshold;
+        gboolean       compress;
+
+        if (tdata->payload->length == 0)
+                return;
+
+        key = GSIZE_TO_POINTER (tdata->payload->length);
+        candidates = g_hash_table_lookup (manager->priv->payloads, key);
+
+        for (list = candidates; list; list = list->next) {
+                payload = (TargetPayload *) list->data;
+                if (target_payload_equal (payload, tdata->payload)) {
+                        target_payload_unref (tdata->payload);
+                        payload->refcount++;
+                        tdata->payload = payload;
+                        return;
+                }
+        }
+
+        g_hash_table_steal (manager->priv->payloads, key);
+        g_hash_table_insert (manager->priv->payloads, key,
+                             g_slist_prepend (candidates, tdata->payload));
+
+        /* compressed payloads are only compared to when a later target
+         * has the same length, so those are decompressed rarely */
+        threshold = clipboard_limit (manager, COMPRESS_THRESHOLD_PROP, COMPRESS_THRESHOLD_DEFAULT);
+        compress = threshold > 0 && tdata->payload->length >= threshold
+                   && tdata->format == 8 && clipboard_is_text (manager, tdata->type);
+
+        spill_threshold = clipboard_limit (manager, SPILL_THRESHOLD_PROP, SPILL_THRESHOLD_DEFAULT);
+        if (compress || (spill_threshold > 0 && tdata->payload->size >= spill_threshold))
+                target_payload_store (manager, tdata->payload, compress, spill_threshold);
+}
+
+static void
+clipboard_manager_memory (XfsdMemoryReport *report,
+                          gpointer          user_data)
+{
+        GsdClipboardManager *manager = user_data;
+        GSList              *list;
+        GHashTableIter       iter;
+        gpointer             key;
+        TargetData          *tdata;
+        IncrConversion      *rdata;
+        gsize                n_bytes;
+        GHashTable          *seen;
+        TargetPayload       *payload;
+        gsize                n_spilled = 0, spilled_bytes = 0;
+        gsize                n_compressed = 0, compressed_bytes = 0;
+
+        /* shared payloads are counted once */
+        seen = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+        n_bytes = xfsettings_memory_hash_table_size (manager->priv->targets)
+                  + xfsettings_memory_hash_table_size (manager->priv->payloads);
+        for (list = manager->priv->contents; list; list = list->next) {
+                tdata = (TargetData *) list->data;
+                n_bytes += sizeof (GSList) + sizeof (TargetData);
+                payload = tdata->payload;
+                if (!g_hash_table_add (seen, payload))
+                        continue;
+
+                n_bytes += sizeof (TargetPayload) + payload->chunks->len * sizeof (TargetChunk);
+                if (payload->compressed) {
+                        n_compressed++;
+                        compressed_bytes += payload->size;
+                } else if (payload->map != NULL) {
+                        n_spilled++;
+                        spilled_bytes += payload->size;
+                } else {
+                        n_bytes += payload->size;
+                }
+
+                /* storage made by a worker, waiting for the readers */
+                if (payload->pending != NULL) {
+                        n_bytes += sizeof (TargetPayload);
+                        if (payload->pending->map == NULL)
+                                n_bytes += payload->pending->size;
+                }
+        }
+        xfsettings_memory_add (report, "contents",
+                               g_slist_length (manager->priv->contents), n_bytes);
+        xfsettings_memory_add (report, "contents-spilled", n_spilled, spilled_bytes);
+        xfsettings_memory_add (report, "contents-compressed", n_compressed, compressed_bytes);
+
+        /* the data of a running transfer is only counted here
+         * when the clipboard contents were replaced since */
+        n_bytes = xfsettings_memory_hash_table_size (manager->priv->conversions);
+        g_hash_table_iter_init (&iter, manager->priv->conversions);
+        while (g_hash_table_iter_next (&iter, &key, NULL)) {
+                rdata = (IncrConversion *) key;
+                n_bytes += sizeof (IncrConversion);
+                if (rdata->reader.buffer != NULL)
+                        n_bytes += COMPRESS_CHUNK_SIZE;
+                if (rdata->data != NULL
+                    && lookup_content (manager, rdata->data->target) != rdata->data) {
+                        n_bytes += sizeof (TargetData);
+                        payload = rdata->data->payload;
+                        if (g_hash_table_add (seen, payload))
+                                n_bytes += sizeof (TargetPayload) + payload->size;
+                }
+        }
+        xfsettings_memory_add (report, "conversions",
+                               g_hash_table_size (manager->priv->conversions), n_bytes);
+
+        g_hash_table_destroy (seen);
+}
+
 static void
 send_selection_notify (GsdClipboardManager *manager,
                        Bool                 success)
@@ -254,15 +1131,16 @@ save_targets (GsdClipboardManager *manager,
                     targets[i] != XA_DELETE &&
                     targets[i] != XA_INSERT_PROPERTY &&
                     targets[i] != XA_INSERT_SELECTION &&
-                    targets[i] != XA_PIXMAP) {
+                    targets[i] != XA_PIXMAP &&
+                    lookup_content (manager, targets[i]) == NULL) {
                         tdata = g_slice_new (TargetData);
-                        tdata->data = NULL;
-                        tdata->length = 0;
+                        tdata->payload = target_payload_new ();
                         tdata->target = targets[i];
                         tdata->type = None;
                         tdata->format = 0;
                         tdata->refcount = 1;
-                        manager->priv->contents = g_slist_prepend (manager->priv->contents, tdata);
+                        tdata->discard = FALSE;
+                        add_content (manager, tdata);
 
                         multiple[nout++] = targets[i];
                         multiple[nout++] = targets[i];
@@ -281,28 +1159,6 @@ save_targets (GsdClipboardManager *manager,
                            manager->priv->window, manager->priv->time);
 }
 
-static int
-find_content_target (TargetData *tdata,
-                     Atom       *target)
-{
-        return !(tdata->target == *target);
-}
-
-static int
-find_content_type (TargetData *tdata,
-                   Atom        *type)
-{
-        return !(tdata->type == *type);
-}
-
-static int
-find_conversion_requestor (IncrConversion *rdata,
-                           XEvent         *xev)
-{
-        return !(rdata->requestor == xev->xproperty.window
-                 && rdata->property == xev->xproperty.atom);
-}
-
 static void
 get_property (TargetData          *tdata,
               GsdClipboardManager *manager)
@@ -312,6 +1168,7 @@ get_property (TargetData          *tdata,
         gulong  length;
         gulong  remaining;
         guchar *data;
+        gulong  max_size;
 
         XGetWindowProperty (manager->priv->display,
                             manager->priv->window,
@@ -326,18 +1183,29 @@ get_property (TargetData          *tdata,
                             &remaining,
                             &data);
 
+        max_size = clipboard_limit (manager, MAX_PAYLOAD_SIZE_PROP, 0);
+
         if (type == None) {
-                manager->priv->contents = g_slist_remove (manager->priv->contents, tdata);
-                g_slice_free (TargetData, tdata);
+                remove_content (manager, tdata);
         } else if (type == XA_INCR) {
+                /* deleting the property started the transfer, so an
+                 * oversized target is still read to the end and only
+                 * dropped at the zero-length terminator */
                 tdata->type = type;
-                tdata->length = 0;
+                if (max_size > 0 && format == 32 && length > 0
+                    && (gulong) ((glong *) data)[0] > max_size)
+                        tdata->discard = TRUE;
+                manager->priv->n_incr++;
                 XFree (data);
+        } else if (max_size > 0
+                   && length * clipboard_bytes_per_item (format) > max_size) {
+                XFree (data);
+                remove_content (manager, tdata);
         } else {
                 tdata->type = type;
-                tdata->data = data;
-                tdata->length = length * clipboard_bytes_per_item (format);
                 tdata->format = format;
+                target_data_add_chunk (tdata, data, length * clipboard_bytes_per_item (format));
+                share_payload (manager, tdata);
         }
 }
 
@@ -345,25 +1213,20 @@ static Bool
 receive_incrementally (GsdClipboardManager *manager,
                        XEvent              *xev)
 {
-        GSList     *list;
         TargetData *tdata;
         Atom        type;
         gint        format;
         gulong      length, nitems, remaining;
         guchar     *data;
+        gulong      max_size;
 
         if (xev->xproperty.window != manager->priv->window)
                 return False;
 
-        list = g_slist_find_custom (manager->priv->contents,
-                                    &xev->xproperty.atom,
-                                    (GCompareFunc) find_content_target);
-
-        if (!list)
+        tdata = lookup_content (manager, xev->xproperty.atom);
+        if (!tdata)
                 return False;
 
-        tdata = (TargetData *) list->data;
-
         if (tdata->type != XA_INCR)
                 return False;
 
@@ -378,8 +1241,12 @@ receive_incrementally (GsdClipboardManager *manager,
                 tdata->type = type;
                 tdata->format = format;
 
-                if (!g_slist_find_custom (manager->priv->contents,
-                                          &XA_INCR, (GCompareFunc) find_content_type)) {
+                if (tdata->discard)
+                        remove_content (manager, tdata);
+                else
+                        share_payload (manager, tdata);
+
+                if (--manager->priv->n_incr == 0) {
 
                         /* all incremental transfers done */
                         send_selection_notify (manager, True);
@@ -388,15 +1255,19 @@ receive_incrementally (GsdClipboardManager *manager,
 
                 XFree (data);
         } else {
-                if (!tdata->data) {
-                        tdata->data = data;
-                        tdata->length = length;
-                } else {
-                        tdata->data = g_realloc (tdata->data, tdata->length + length + 1);
-                        memcpy (tdata->data + tdata->length, data, length + 1);
-                        tdata->length += length;
-                        XFree (data);
+                max_size = clipboard_limit (manager, MAX_PAYLOAD_SIZE_PROP, 0);
+                if (!tdata->discard && max_size > 0
+                    && tdata->payload->length + length > max_size) {
+                        /* too large, finish the transfer without saving it */
+                        target_payload_unref (tdata->payload);
+                        tdata->payload = target_payload_new ();
+                        tdata->discard = TRUE;
                 }
+
+                if (tdata->discard)
+                        XFree (data);
+                else /* keep the chunk as it is, no copy */
+                        target_data_add_chunk (tdata, data, length);
         }
 
         return True;
@@ -406,24 +1277,23 @@ static Bool
 send_incrementally (GsdClipboardManager *manager,
                     XEvent              *xev)
 {
-        GSList         *list;
         IncrConversion *rdata;
+        IncrConversion  key;
         gulong          length;
         gulong          items;
         gulong          bytes;
-        guchar         *data;
+        guchar         *data = NULL;
 
-        list = g_slist_find_custom (manager->priv->conversions, xev,
-                                    (GCompareFunc) find_conversion_requestor);
-        if (list == NULL)
+        key.requestor = xev->xproperty.window;
+        key.property = xev->xproperty.atom;
+        rdata = g_hash_table_lookup (manager->priv->conversions, &key);
+        if (rdata == NULL)
                 return False;
 
-        rdata = (IncrConversion *) list->data;
-
-        data = rdata->data->data + rdata->offset;
-        length = rdata->data->length - rdata->offset;
-        if (length > SELECTION_MAX_SIZE)
-                length = SELECTION_MAX_SIZE;
+        /* send from the chunk we are in, the chunks are whole items
+         * so they can be split anywhere; only text is compressed and
+         * its items are bytes */
+        length = payload_reader_read (&rdata->reader, SELECTION_MAX_SIZE, &data);
 
         rdata->offset += length;
 
@@ -436,8 +1306,11 @@ send_incrementally (GsdClipboardManager *manager,
                          data, items);
 
         if (length == 0) {
-                manager->priv->conversions = g_slist_remove (manager->priv->conversions, rdata);
-                conversion_free (rdata);
+                if (rdata->data->payload->compressed)
+                        xfsettings_dbg (XFSD_DEBUG_CLIPBOARD, "served %d clipboard bytes, "
+                                        "%.3f ms decompressing", rdata->offset,
+                                        rdata->reader.decompress_time / 1000.0);
+                g_hash_table_remove (manager->priv->conversions, rdata);
         }
 
         return True;
@@ -495,6 +1368,9 @@ convert_clipboard_manager (GsdClipboardManager *manager,
                                 }
                         }
 
+                        /* a client asked us to save the clipboard */
+                        xfsettings_metrics_changed (XFSD_HELPER_CLIPBOARD, NULL);
+
                         manager->priv->requestor = xev->xselectionrequest.requestor;
                         manager->priv->property = xev->xselectionrequest.property;
                         manager->priv->time = xev->xselectionrequest.time;
@@ -536,11 +1412,14 @@ convert_clipboard_target (IncrConversion      *rdata,
                           GsdClipboardManager *manager)
 {
         TargetData        *tdata;
+        TargetChunk       *chunk;
         Atom              *targets;
         gint               n_targets;
         GSList            *list;
         gulong             items;
         gulong             bytes;
+        guint              i;
+        gint               mode;
         XWindowAttributes  atts;
 
         if (rdata->target == XA_TARGETS) {
@@ -563,15 +1442,12 @@ convert_clipboard_target (IncrConversion      *rdata,
                 g_free (targets);
         } else  {
                 /* Convert from stored CLIPBOARD data */
-                list = g_slist_find_custom (manager->priv->contents,
-                                            &rdata->target,
-                                            (GCompareFunc) find_content_target);
+                tdata = lookup_content (manager, rdata->target);
 
                 /* We got a target that we don't support */
-                if (!list)
+                if (!tdata)
                         return;
 
-                tdata = (TargetData *)list->data;
                 if (tdata->type == XA_INCR) {
                         /* we haven't completely received this target yet  */
                         rdata->property = None;
@@ -580,15 +1456,27 @@ convert_clipboard_target (IncrConversion      *rdata,
 
                 rdata->data = target_data_ref (tdata);
                 bytes = clipboard_bytes_per_item (tdata->format);
-                items = bytes == 0 ? 0 : tdata->length / bytes;
-                if (tdata->length <= SELECTION_MAX_SIZE)
-                        XChangeProperty (manager->priv->display, rdata->requestor,
-                                         rdata->property,
-                                         tdata->type, tdata->format, PropModeReplace,
-                                         tdata->data, items);
-                else {
-                        /* start incremental transfer */
+                items = bytes == 0 ? 0 : tdata->payload->length / bytes;
+                if (tdata->payload->length <= SELECTION_MAX_SIZE
+                    && !tdata->payload->compressed) {
+                        /* append the chunks instead of joining them */
+                        mode = PropModeReplace;
+                        i = 0;
+                        do {
+                                chunk = i < tdata->payload->chunks->len
+                                        ? &g_array_index (tdata->payload->chunks, TargetChunk, i) : NULL;
+                                XChangeProperty (manager->priv->display, rdata->requestor,
+                                                 rdata->property,
+                                                 tdata->type, tdata->format, mode,
+                                                 chunk ? chunk->data : NULL,
+                                                 chunk && bytes != 0 ? chunk->length / bytes : 0);
+                                mode = PropModeAppend;
+                        } while (++i < tdata->payload->chunks->len);
+                } else {
+                        /* start incremental transfer, compressed payloads
+                         * are decompressed a chunk at a time while sending */
                         rdata->offset = 0;
+                        payload_reader_init (&rdata->reader, tdata->payload);
 
                         gdk_x11_display_error_trap_push (gdk_display_get_default ());
 
@@ -616,7 +1504,7 @@ collect_incremental (IncrConversion      *rdata,
                      GsdClipboardManager *manager)
 {
         if (rdata->offset >= 0)
-                manager->priv->conversions = g_slist_prepend (manager->priv->conversions, rdata);
+                g_hash_table_add (manager->priv->conversions, rdata);
         else
                 conversion_free (rdata);
 }
@@ -649,7 +1537,7 @@ convert_clipboard (GsdClipboardManager *manager,
                 }
 
                 for (i = 0; i < nitems; i += 2) {
-                        rdata = g_slice_new (IncrConversion);
+                        rdata = g_slice_new0 (IncrConversion);
                         rdata->requestor = xev->xselectionrequest.requestor;
                         rdata->target = multiple[i];
                         rdata->property = multiple[i+1];
@@ -660,7 +1548,7 @@ convert_clipboard (GsdClipboardManager *manager,
         } else {
                 multiple = NULL;
 
-                rdata = g_slice_new (IncrConversion);
+                rdata = g_slice_new0 (IncrConversion);
                 rdata->requestor = xev->xselectionrequest.requestor;
                 rdata->target = xev->xselectionrequest.target;
                 rdata->property = xev->xselectionrequest.property;
@@ -708,12 +1596,15 @@ clipboard_manager_process_event (GsdClipboardManager *manager,
         Atom   *targets = NULL;
         GSList *tmp;
 
+        if (xev->xany.type == SelectionClear
+            || xev->xany.type == SelectionNotify
+            || xev->xany.type == SelectionRequest)
+                xfsettings_trace (XFSD_HELPER_CLIPBOARD, XFSD_TRACE_X_EVENT, xev->xany.type);
+
         switch (xev->xany.type) {
         case DestroyNotify:
                 if (xev->xdestroywindow.window == manager->priv->requestor) {
-                        g_slist_foreach (manager->priv->contents, (GFunc) (void (*)(void)) target_data_unref, NULL);
-                        g_slist_free (manager->priv->contents);
-                        manager->priv->contents = NULL;
+                        clear_contents (manager);
 
                         clipboard_manager_watch_cb (manager,
                                                     manager->priv->requestor,
@@ -739,9 +1630,7 @@ clipboard_manager_process_event (GsdClipboardManager *manager,
                 if (xev->xselectionclear.selection == XA_CLIPBOARD_MANAGER) {
                         /* We lost the manager selection */
                         if (manager->priv->contents) {
-                                g_slist_foreach (manager->priv->contents, (GFunc) (void (*)(void)) target_data_unref, NULL);
-                                g_slist_free (manager->priv->contents);
-                                manager->priv->contents = NULL;
+                                clear_contents (manager);
 
                                 XSetSelectionOwner (manager->priv->display,
                                                     XA_CLIPBOARD,
@@ -752,9 +1641,7 @@ clipboard_manager_process_event (GsdClipboardManager *manager,
                 }
                 if (xev->xselectionclear.selection == XA_CLIPBOARD) {
                         /* We lost the clipboard selection */
-                        g_slist_foreach (manager->priv->contents, (GFunc) (void (*)(void)) target_data_unref, NULL);
-                        g_slist_free (manager->priv->contents);
-                        manager->priv->contents = NULL;
+                        clear_contents (manager);
                         clipboard_manager_watch_cb (manager,
                                                     manager->priv->requestor,
                                                     False,
@@ -782,6 +1669,8 @@ clipboard_manager_process_event (GsdClipboardManager *manager,
 
                                 save_targets (manager, targets, nitems);
                         } else if (xev->xselection.property == XA_MULTIPLE) {
+                                xfsettings_trace (XFSD_HELPER_CLIPBOARD, XFSD_TRACE_APPLY_START, 0);
+
                                 tmp = g_slist_copy (manager->priv->contents);
                                 g_slist_foreach (tmp, (GFunc) get_property, manager);
                                 g_slist_free (tmp);
@@ -789,6 +1678,7 @@ clipboard_manager_process_event (GsdClipboardManager *manager,
                                 manager->priv->time = xev->xselection.time;
                                 XSetSelectionOwner (manager->priv->display, XA_CLIPBOARD,
                                                     manager->priv->window, manager->priv->time);
+                                xfsettings_metrics_applied (XFSD_HELPER_CLIPBOARD);
 
                                 if (manager->priv->property != None)
                                         XChangeProperty (manager->priv->display,
@@ -797,8 +1687,7 @@ clipboard_manager_process_event (GsdClipboardManager *manager,
                                                          XA_ATOM, 32, PropModeReplace,
                                                          (guchar *)&XA_NULL, 1);
 
-                                if (!g_slist_find_custom (manager->priv->contents,
-                                                          &XA_INCR, (GCompareFunc) find_content_type)) {
+                                if (manager->priv->n_incr == 0) {
                                         /* all transfers done */
                                         send_selection_notify (manager, True);
                                         clipboard_manager_watch_cb (manager,
@@ -810,6 +1699,7 @@ clipboard_manager_process_event (GsdClipboardManager *manager,
                                 }
                         }
                         else if (xev->xselection.property == None) {
+                                xfsettings_metrics_discard (XFSD_HELPER_CLIPBOARD);
                                 send_selection_notify (manager, False);
                                 clipboard_manager_watch_cb (manager,
                                                             manager->priv->requestor,
@@ -862,30 +1752,19 @@ clipboard_manager_watch_cb (GsdClipboardManager *manager,
                             long                 mask,
                             void                *cb_data)
 {
-        GdkWindow  *gdkwin;
-        GdkDisplay *display;
-
-        display = gdk_display_get_default ();
-        gdkwin = gdk_x11_window_lookup_for_display (display, window);
+        if (window == None)
+                return;
 
+        /* the dispatcher routes on the window id, so there is
+         * no need for a foreign gdk window */
         if (is_start) {
-                if (gdkwin == NULL) {
-                        gdkwin = gdk_x11_window_foreign_new_for_display (display, window);
-                } else {
-                        g_object_ref (gdkwin);
-                }
-
-                gdk_window_add_filter (gdkwin,
-                                       (GdkFilterFunc) clipboard_manager_event_filter,
-                                       manager);
+                xfsettings_dispatcher_add_window (window,
+                                                  (GdkFilterFunc) clipboard_manager_event_filter,
+                                                  manager);
         } else {
-                if (gdkwin == NULL) {
-                        return;
-                }
-                gdk_window_remove_filter (gdkwin,
-                                          (GdkFilterFunc) clipboard_manager_event_filter,
-                                          manager);
-                g_object_unref (gdkwin);
+                xfsettings_dispatcher_remove_window (window,
+                                                     (GdkFilterFunc) clipboard_manager_event_filter,
+                                                     manager);
         }
 }
 
@@ -897,19 +1776,20 @@ init_atoms (Display *display)
     if (SELECTION_MAX_SIZE > 0)
       return;
 
-    XA_ATOM_PAIR = XInternAtom (display, "ATOM_PAIR", False);
-    XA_CLIPBOARD_MANAGER = XInternAtom (display, "CLIPBOARD_MANAGER", False);
-    XA_CLIPBOARD = XInternAtom (display, "CLIPBOARD", False);
-    XA_DELETE = XInternAtom (display, "DELETE", False);
-    XA_INCR = XInternAtom (display, "INCR", False);
-    XA_INSERT_PROPERTY = XInternAtom (display, "INSERT_PROPERTY", False);
-    XA_INSERT_SELECTION = XInternAtom (display, "INSERT_SELECTION", False);
-    XA_MANAGER = XInternAtom (display, "MANAGER", False);
-    XA_MULTIPLE = XInternAtom (display, "MULTIPLE", False);
-    XA_NULL = XInternAtom (display, "NULL", False);
-    XA_SAVE_TARGETS = XInternAtom (display, "SAVE_TARGETS", False);
-    XA_TARGETS = XInternAtom (display, "TARGETS", False);
-    XA_TIMESTAMP = XInternAtom (display, "TIMESTAMP", False);
+    /* interned at startup, see atoms.c */
+    XA_ATOM_PAIR = xfsettings_atom (XFSD_ATOM_ATOM_PAIR);
+    XA_CLIPBOARD_MANAGER = xfsettings_atom (XFSD_ATOM_CLIPBOARD_MANAGER);
+    XA_CLIPBOARD = xfsettings_atom (XFSD_ATOM_CLIPBOARD);
+    XA_DELETE = xfsettings_atom (XFSD_ATOM_DELETE);
+    XA_INCR = xfsettings_atom (XFSD_ATOM_INCR);
+    XA_INSERT_PROPERTY = xfsettings_atom (XFSD_ATOM_INSERT_PROPERTY);
+    XA_INSERT_SELECTION = xfsettings_atom (XFSD_ATOM_INSERT_SELECTION);
+    XA_MANAGER = xfsettings_atom (XFSD_ATOM_MANAGER);
+    XA_MULTIPLE = xfsettings_atom (XFSD_ATOM_MULTIPLE);
+    XA_NULL = xfsettings_atom (XFSD_ATOM_NULL);
+    XA_SAVE_TARGETS = xfsettings_atom (XFSD_ATOM_SAVE_TARGETS);
+    XA_TARGETS = xfsettings_atom (XFSD_ATOM_TARGETS);
+    XA_TIMESTAMP = xfsettings_atom (XFSD_ATOM_TIMESTAMP);
 
     max_request_size = XExtendedMaxRequestSize (display);
     if (max_request_size == 0)
@@ -935,9 +1815,11 @@ gsd_clipboard_manager_start (GsdClipboardManager *manager,
         }
 
         manager->priv->contents = NULL;
-        manager->priv->conversions = NULL;
+        manager->priv->n_incr = 0;
         manager->priv->requestor = None;
 
+        manager->priv->channel = xfsettings_snapshot_channel ("xfsettingsd");
+
         manager->priv->window = XCreateSimpleWindow (manager->priv->display,
                                                      DefaultRootWindow (manager->priv->display),
                                                      0, 0, 10, 10, 0,
@@ -989,12 +1871,16 @@ gsd_clipboard_manager_start (GsdClipboardManager *manager,
 
         manager->priv->start_idle_id = 0;
 
+        xfsettings_memory_register (XFSD_HELPER_CLIPBOARD, clipboard_manager_memory, manager);
+
         return TRUE;
 }
 
 void
 gsd_clipboard_manager_stop (GsdClipboardManager *manager)
 {
+        xfsettings_memory_unregister (clipboard_manager_memory, manager);
+
         if (manager->priv->window != None) {
                 clipboard_manager_watch_cb (manager,
                                             manager->priv->window,
@@ -1005,15 +1891,6 @@ gsd_clipboard_manager_stop (GsdClipboardManager *manager)
                 manager->priv->window = None;
         }
 
-        if (manager->priv->conversions != NULL) {
-                g_slist_foreach (manager->priv->conversions, (GFunc) (void (*)(void)) conversion_free, NULL);
-                g_slist_free (manager->priv->conversions);
-                manager->priv->conversions = NULL;
-        }
-
-        if (manager->priv->contents != NULL) {
-                g_slist_foreach (manager->priv->contents, (GFunc) (void (*)(void)) target_data_unref, NULL);
-                g_slist_free (manager->priv->contents);
-                manager->priv->contents = NULL;
-        }
+        g_hash_table_remove_all (manager->priv->conversions);
+        clear_contents (manager);
 }
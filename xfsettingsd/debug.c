@@ -41,6 +41,10 @@ static const GDebugKey dbg_keys[] =
     { "accessibility", XFSD_DEBUG_ACCESSIBILITY },
     { "pointers", XFSD_DEBUG_POINTERS },
     { "displays", XFSD_DEBUG_DISPLAYS },
+    { "clipboard", XFSD_DEBUG_CLIPBOARD },
+    { "xfconf", XFSD_DEBUG_XFCONF },
+    { "stall", XFSD_DEBUG_STALL },
+    { "startup", XFSD_DEBUG_STARTUP },
 };
 
 
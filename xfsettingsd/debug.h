@@ -33,6 +33,10 @@ typedef enum
    XFSD_DEBUG_ACCESSIBILITY      = 1 << 7,
    XFSD_DEBUG_POINTERS           = 1 << 8,
    XFSD_DEBUG_DISPLAYS           = 1 << 9,
+   XFSD_DEBUG_CLIPBOARD          = 1 << 10,
+   XFSD_DEBUG_XFCONF             = 1 << 11,
+   XFSD_DEBUG_STALL              = 1 << 12,
+   XFSD_DEBUG_STARTUP            = 1 << 13,
 }
 XfsdDebugDomain;
 
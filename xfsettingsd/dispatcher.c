@@ -0,0 +1,463 @@
+/*
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Single X event filter for all helpers. Helpers register for the event
+ * types they handle, xkb events by their xkb type, root window property
+ * changes by atom and core events on a window by its XID; an event is
+ * looked up once and only the registered handlers are called, so the
+ * cost of an event does not grow with the number of helpers.
+ *
+ * Handlers are GdkFilterFuncs. Any result other than GDK_FILTER_CONTINUE
+ * stops the dispatch and removes the event from the gdk queue.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <gdk/gdk.h>
+#include <gdk/gdkx.h>
+#include <X11/Xlib.h>
+#include <X11/XKBlib.h>
+#include <X11/extensions/XInput.h>
+
+#ifdef HAVE_XRANDR
+#include <X11/extensions/Xrandr.h>
+#endif
+
+#include "dispatcher.h"
+#include "pointers-defines.h"
+#include "debug.h"
+
+/* event types are 7 bits, the 8th bit is the send_event flag */
+#define N_EVENT_TYPES 128
+
+
+
+typedef struct _XfsdHandler XfsdHandler;
+
+
+
+struct _XfsdHandler
+{
+    /* NULL once the handler is removed */
+    GdkFilterFunc func;
+    gpointer      data;
+};
+
+static gboolean    dispatcher_initialized = FALSE;
+static Window      dispatcher_root = None;
+
+/* extension event bases, -1 if the extension is not available */
+static gint        dispatcher_xkb_base = -1;
+static gint        dispatcher_randr_base = -1;
+static gint        dispatcher_presence_type = -1;
+
+/* lists of XfsdHandler */
+static GSList     *type_handlers[N_EVENT_TYPES];
+static GSList     *xkb_handlers[XkbNumberEvents];
+
+/* Atom -> handlers for root window PropertyNotify */
+static GHashTable *property_handlers = NULL;
+
+/* Window -> handlers for all events on the window */
+static GHashTable *window_handlers = NULL;
+
+/* removed handlers are swept after the dispatch */
+static guint       dispatcher_depth = 0;
+static gboolean    dispatcher_dirty = FALSE;
+
+
+
+static GdkFilterReturn xfsettings_dispatcher_filter (GdkXEvent *gdkxevent,
+                                                     GdkEvent  *event,
+                                                     gpointer   user_data);
+
+
+
+static void
+xfsettings_dispatcher_init (void)
+{
+    GdkDisplay  *gdkdisplay;
+    Display     *xdisplay;
+    gint         opcode, error_base;
+    gint         major = XkbMajorVersion;
+    gint         minor = XkbMinorVersion;
+
+    if (G_LIKELY (dispatcher_initialized))
+        return;
+
+    dispatcher_initialized = TRUE;
+
+    gdkdisplay = gdk_display_get_default ();
+    xdisplay = GDK_DISPLAY_XDISPLAY (gdkdisplay);
+    dispatcher_root = DefaultRootWindow (xdisplay);
+
+    if (!XkbQueryExtension (xdisplay, &opcode, &dispatcher_xkb_base,
+                            &error_base, &major, &minor))
+        dispatcher_xkb_base = -1;
+
+#ifdef HAVE_XRANDR
+    if (!XRRQueryExtension (xdisplay, &dispatcher_randr_base, &error_base))
+        dispatcher_randr_base = -1;
+#endif
+
+#ifdef DEVICE_HOTPLUGGING
+    if (XQueryExtension (xdisplay, INAME, &opcode, &dispatcher_presence_type, &error_base))
+        dispatcher_presence_type = _XiGetDevicePresenceNotifyEvent (xdisplay);
+    else
+        dispatcher_presence_type = -1;
+#endif
+
+    property_handlers = g_hash_table_new (g_direct_hash, g_direct_equal);
+    window_handlers = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+    gdk_window_add_filter (NULL, xfsettings_dispatcher_filter, NULL);
+
+    xfsettings_dbg (XFSD_DEBUG_STARTUP, "event dispatcher (xkb=%d, randr=%d, "
+                    "device-presence=%d)", dispatcher_xkb_base,
+                    dispatcher_randr_base, dispatcher_presence_type);
+}
+
+
+
+static GSList *
+xfsettings_dispatcher_append (GSList        *handlers,
+                              GdkFilterFunc  func,
+                              gpointer       data)
+{
+    XfsdHandler *handler;
+
+    handler = g_slice_new (XfsdHandler);
+    handler->func = func;
+    handler->data = data;
+
+    return g_slist_append (handlers, handler);
+}
+
+
+
+static GSList *
+xfsettings_dispatcher_sweep_list (GSList *handlers)
+{
+    GSList      *li, *lnext;
+    XfsdHandler *handler;
+
+    for (li = handlers; li != NULL; li = lnext)
+    {
+        lnext = li->next;
+        handler = li->data;
+
+        if (handler->func == NULL)
+        {
+            handlers = g_slist_delete_link (handlers, li);
+            g_slice_free (XfsdHandler, handler);
+        }
+    }
+
+    return handlers;
+}
+
+
+
+static void
+xfsettings_dispatcher_sweep_table (GHashTable *table)
+{
+    GHashTableIter  iter;
+    gpointer        value;
+    GSList         *handlers;
+
+    g_hash_table_iter_init (&iter, table);
+    while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+        handlers = xfsettings_dispatcher_sweep_list (value);
+        if (handlers == NULL)
+            g_hash_table_iter_remove (&iter);
+        else if (handlers != value)
+            g_hash_table_iter_replace (&iter, handlers);
+    }
+}
+
+
+
+static void
+xfsettings_dispatcher_sweep (void)
+{
+    guint n;
+
+    /* not while iterating the lists */
+    if (dispatcher_depth > 0 || !dispatcher_dirty)
+        return;
+
+    for (n = 0; n < N_EVENT_TYPES; n++)
+        type_handlers[n] = xfsettings_dispatcher_sweep_list (type_handlers[n]);
+
+    for (n = 0; n < XkbNumberEvents; n++)
+        xkb_handlers[n] = xfsettings_dispatcher_sweep_list (xkb_handlers[n]);
+
+    xfsettings_dispatcher_sweep_table (property_handlers);
+    xfsettings_dispatcher_sweep_table (window_handlers);
+
+    dispatcher_dirty = FALSE;
+}
+
+
+
+static gboolean
+xfsettings_dispatcher_mark (GSList        *handlers,
+                            GdkFilterFunc  func,
+                            gpointer       data,
+                            gboolean       first_only)
+{
+    GSList      *li;
+    XfsdHandler *handler;
+    gboolean     found = FALSE;
+
+    for (li = handlers; li != NULL; li = li->next)
+    {
+        handler = li->data;
+        if (handler->func == func && handler->data == data)
+        {
+            handler->func = NULL;
+            dispatcher_dirty = found = TRUE;
+
+            if (first_only)
+                break;
+        }
+    }
+
+    return found;
+}
+
+
+
+static GdkFilterReturn
+xfsettings_dispatcher_run (GSList    *handlers,
+                           GdkXEvent *gdkxevent,
+                           GdkEvent  *event)
+{
+    GSList      *li;
+    XfsdHandler *handler;
+
+    for (li = handlers; li != NULL; li = li->next)
+    {
+        handler = li->data;
+        if (handler->func != NULL
+            && (*handler->func) (gdkxevent, event, handler->data) != GDK_FILTER_CONTINUE)
+            return GDK_FILTER_REMOVE;
+    }
+
+    return GDK_FILTER_CONTINUE;
+}
+
+
+
+static GdkFilterReturn
+xfsettings_dispatcher_filter (GdkXEvent *gdkxevent,
+                              GdkEvent  *event,
+                              gpointer   user_data)
+{
+    XEvent          *xevent = gdkxevent;
+    XkbEvent        *xkbevent = gdkxevent;
+    GdkFilterReturn  result;
+    gint             type = xevent->type & 0x7f;
+
+    dispatcher_depth++;
+
+    result = xfsettings_dispatcher_run (type_handlers[type], gdkxevent, event);
+
+    if (result == GDK_FILTER_CONTINUE
+        && type == dispatcher_xkb_base
+        && xkbevent->any.xkb_type < XkbNumberEvents)
+    {
+        result = xfsettings_dispatcher_run (xkb_handlers[xkbevent->any.xkb_type],
+                                            gdkxevent, event);
+    }
+
+    if (result == GDK_FILTER_CONTINUE
+        && type == PropertyNotify
+        && xevent->xproperty.window == dispatcher_root)
+    {
+        result = xfsettings_dispatcher_run (g_hash_table_lookup (property_handlers,
+                                                GUINT_TO_POINTER (xevent->xproperty.atom)),
+                                            gdkxevent, event);
+    }
+
+    /* only core events have a window at the same offset, extension
+     * events like the xkb ones store other fields there */
+    if (result == GDK_FILTER_CONTINUE
+        && type < LASTEvent
+        && g_hash_table_size (window_handlers) > 0)
+    {
+        result = xfsettings_dispatcher_run (g_hash_table_lookup (window_handlers,
+                                                GUINT_TO_POINTER (xevent->xany.window)),
+                                            gdkxevent, event);
+    }
+
+    dispatcher_depth--;
+    xfsettings_dispatcher_sweep ();
+
+    return result;
+}
+
+
+
+void
+xfsettings_dispatcher_add (gint          type,
+                           GdkFilterFunc func,
+                           gpointer      data)
+{
+    g_return_if_fail (type >= 0 && type < N_EVENT_TYPES);
+    g_return_if_fail (func != NULL);
+
+    xfsettings_dispatcher_init ();
+
+    type_handlers[type] = xfsettings_dispatcher_append (type_handlers[type], func, data);
+}
+
+
+
+void
+xfsettings_dispatcher_add_xkb (gint          xkb_type,
+                               GdkFilterFunc func,
+                               gpointer      data)
+{
+    g_return_if_fail (xkb_type >= XFSD_XKB_ANY && xkb_type < XkbNumberEvents);
+
+    xfsettings_dispatcher_init ();
+
+    if (dispatcher_xkb_base == -1)
+        return;
+
+    if (xkb_type == XFSD_XKB_ANY)
+        xfsettings_dispatcher_add (dispatcher_xkb_base, func, data);
+    else
+        xkb_handlers[xkb_type] = xfsettings_dispatcher_append (xkb_handlers[xkb_type], func, data);
+}
+
+
+
+void
+xfsettings_dispatcher_add_randr (gint          randr_type,
+                                 GdkFilterFunc func,
+                                 gpointer      data)
+{
+    xfsettings_dispatcher_init ();
+
+    if (dispatcher_randr_base != -1)
+        xfsettings_dispatcher_add (dispatcher_randr_base + randr_type, func, data);
+}
+
+
+
+void
+xfsettings_dispatcher_add_device_presence (GdkFilterFunc func,
+                                           gpointer      data)
+{
+    xfsettings_dispatcher_init ();
+
+    if (dispatcher_presence_type != -1)
+        xfsettings_dispatcher_add (dispatcher_presence_type, func, data);
+}
+
+
+
+void
+xfsettings_dispatcher_add_root_property (Atom          atom,
+                                         GdkFilterFunc func,
+                                         gpointer      data)
+{
+    GSList *handlers;
+
+    g_return_if_fail (atom != None);
+    g_return_if_fail (func != NULL);
+
+    xfsettings_dispatcher_init ();
+
+    handlers = g_hash_table_lookup (property_handlers, GUINT_TO_POINTER (atom));
+    handlers = xfsettings_dispatcher_append (handlers, func, data);
+    g_hash_table_insert (property_handlers, GUINT_TO_POINTER (atom), handlers);
+}
+
+
+
+void
+xfsettings_dispatcher_add_window (Window        window,
+                                  GdkFilterFunc func,
+                                  gpointer      data)
+{
+    GSList *handlers;
+
+    g_return_if_fail (window != None);
+    g_return_if_fail (func != NULL);
+
+    xfsettings_dispatcher_init ();
+
+    handlers = g_hash_table_lookup (window_handlers, GUINT_TO_POINTER (window));
+    handlers = xfsettings_dispatcher_append (handlers, func, data);
+    g_hash_table_insert (window_handlers, GUINT_TO_POINTER (window), handlers);
+}
+
+
+
+void
+xfsettings_dispatcher_remove_window (Window        window,
+                                     GdkFilterFunc func,
+                                     gpointer      data)
+{
+    if (!dispatcher_initialized)
+        return;
+
+    /* like gdk_window_remove_filter, one registration at a time */
+    if (xfsettings_dispatcher_mark (g_hash_table_lookup (window_handlers,
+                                        GUINT_TO_POINTER (window)),
+                                    func, data, TRUE))
+        xfsettings_dispatcher_sweep ();
+}
+
+
+
+void
+xfsettings_dispatcher_remove (GdkFilterFunc func,
+                              gpointer      data)
+{
+    GHashTableIter iter;
+    gpointer       value;
+    guint          n;
+
+    if (!dispatcher_initialized)
+        return;
+
+    for (n = 0; n < N_EVENT_TYPES; n++)
+        xfsettings_dispatcher_mark (type_handlers[n], func, data, FALSE);
+
+    for (n = 0; n < XkbNumberEvents; n++)
+        xfsettings_dispatcher_mark (xkb_handlers[n], func, data, FALSE);
+
+    g_hash_table_iter_init (&iter, property_handlers);
+    while (g_hash_table_iter_next (&iter, NULL, &value))
+        xfsettings_dispatcher_mark (value, func, data, FALSE);
+
+    g_hash_table_iter_init (&iter, window_handlers);
+    while (g_hash_table_iter_next (&iter, NULL, &value))
+        xfsettings_dispatcher_mark (value, func, data, FALSE);
+
+    xfsettings_dispatcher_sweep ();
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __DISPATCHER_H__
+#define __DISPATCHER_H__
+
+#include <glib.h>
+#include <gdk/gdk.h>
+#include <X11/Xlib.h>
+
+/* event type passed to xfsettings_dispatcher_add_xkb() for all xkb events */
+#define XFSD_XKB_ANY (-1)
+
+void xfsettings_dispatcher_add                 (gint           type,
+                                                GdkFilterFunc  func,
+                                                gpointer       data);
+
+void xfsettings_dispatcher_add_xkb             (gint           xkb_type,
+                                                GdkFilterFunc  func,
+                                                gpointer       data);
+
+void xfsettings_dispatcher_add_randr           (gint           randr_type,
+                                                GdkFilterFunc  func,
+                                                gpointer       data);
+
+void xfsettings_dispatcher_add_device_presence (GdkFilterFunc  func,
+                                                gpointer       data);
+
+void xfsettings_dispatcher_add_root_property   (Atom           atom,
+                                                GdkFilterFunc  func,
+                                                gpointer       data);
+
+void xfsettings_dispatcher_add_window          (Window         window,
+                                                GdkFilterFunc  func,
+                                                gpointer       data);
+
+void xfsettings_dispatcher_remove_window       (Window         window,
+                                                GdkFilterFunc  func,
+                                                gpointer       data);
+
+void xfsettings_dispatcher_remove              (GdkFilterFunc  func,
+                                                gpointer       data);
+
+#endif /* !__DISPATCHER_H__ */
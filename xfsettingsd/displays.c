@@ -37,6 +37,12 @@
 #include <X11/extensions/Xrandr.h>
 
 #include "debug.h"
+#include "metrics.h"
+#include "trace.h"
+#include "xfconf-snapshot.h"
+#include "xstats.h"
+#include "dispatcher.h"
+#include "memory.h"
 #include "displays.h"
 #ifdef HAVE_UPOWERGLIB
 #include "displays-upower.h"
@@ -90,6 +96,8 @@ static GPtrArray       *xfce_displays_helper_list_crtcs                     (Xfc
 static XfceRRCrtc      *xfce_displays_helper_find_crtc_by_id                (XfceDisplaysHelper      *helper,
                                                                              RRCrtc                   id);
 static void             xfce_displays_helper_free_crtc                      (XfceRRCrtc              *crtc);
+static void             xfce_displays_helper_memory                         (XfsdMemoryReport        *report,
+                                                                             gpointer                 user_data);
 static XfceRRCrtc      *xfce_displays_helper_find_usable_crtc               (XfceDisplaysHelper      *helper,
                                                                              XfceRROutput            *output);
 static void             xfce_displays_helper_get_topleftmost_pos            (XfceRRCrtc              *crtc,
@@ -106,8 +114,9 @@ static void             xfce_displays_helper_apply_crtc                     (Xfc
                                                                              XfceDisplaysHelper      *helper);
 static void             xfce_displays_helper_set_outputs                    (XfceRRCrtc              *crtc,
                                                                              XfceRROutput            *output);
+static gboolean         xfce_displays_helper_has_changes                    (XfceDisplaysHelper      *helper);
 static void             xfce_displays_helper_apply_all                      (XfceDisplaysHelper      *helper);
-static void             xfce_displays_helper_channel_apply                  (XfceDisplaysHelper      *helper,
+static gboolean         xfce_displays_helper_channel_apply                  (XfceDisplaysHelper      *helper,
                                                                              const gchar             *scheme);
 static void             xfce_displays_helper_channel_property_changed       (XfconfChannel           *channel,
                                                                              const gchar             *property_name,
@@ -209,8 +218,9 @@ xfce_displays_helper_class_init (XfceDisplaysHelperClass *klass)
 static void
 xfce_displays_helper_init (XfceDisplaysHelper *helper)
 {
-    gint major = 0, minor = 0;
-    gint error_base, err;
+    gint            major = 0, minor = 0;
+    gint            error_base, err;
+    XfsdXStatsScope xstats;
 
 #ifdef HAVE_UPOWERGLIB
     helper->power = NULL;
@@ -221,6 +231,8 @@ xfce_displays_helper_init (XfceDisplaysHelper *helper)
     helper->crtcs = NULL;
     helper->handler = 0;
 
+    xfsettings_memory_register (XFSD_HELPER_DISPLAYS, xfce_displays_helper_memory, helper);
+
     /* get the default display */
     helper->display = gdk_display_get_default ();
     helper->xdisplay = gdk_x11_display_get_xdisplay (helper->display);
@@ -233,12 +245,12 @@ xfce_displays_helper_init (XfceDisplaysHelper *helper)
         if (XRRQueryVersion (helper->xdisplay, &major, &minor)
             && (major > 1 || (major == 1 && minor >= 2)))
         {
-            gdk_x11_display_error_trap_push (gdk_display_get_default ());
+            xfsettings_xstats_trap_push (&xstats, XFSD_HELPER_DISPLAYS, "get-resources");
             /* get the screen resource */
             helper->resources = XRRGetScreenResources (helper->xdisplay,
                                                        GDK_WINDOW_XID (helper->root_window));
             gdk_display_flush (gdk_display_get_default ());
-            err = gdk_x11_display_error_trap_pop (gdk_display_get_default ());
+            err = xfsettings_xstats_trap_pop (&xstats);
             if (err)
             {
                 g_critical ("XRRGetScreenResources failed (err: %d). "
@@ -246,6 +258,10 @@ xfce_displays_helper_init (XfceDisplaysHelper *helper)
                 return;
             }
 
+#ifdef HAS_RANDR_ONE_POINT_THREE
+            helper->has_1_3 = (major > 1 || (major == 1 && minor >= 3));
+#endif
+
             /* get all existing CRTCs and connected outputs */
             helper->crtcs = xfce_displays_helper_list_crtcs (helper);
             helper->outputs = xfce_displays_helper_list_outputs (helper);
@@ -257,9 +273,9 @@ xfce_displays_helper_init (XfceDisplaysHelper *helper)
             gdk_x11_register_standard_event_type (helper->display,
                                                   helper->event_base,
                                                   RRNotify + 1);
-            gdk_window_add_filter (helper->root_window,
-                                   xfce_displays_helper_screen_on_event,
-                                   helper);
+            xfsettings_dispatcher_add_randr (RRScreenChangeNotify,
+                                             xfce_displays_helper_screen_on_event,
+                                             helper);
 
 #ifdef HAVE_UPOWERGLIB
             helper->power = g_object_new (XFCE_TYPE_DISPLAYS_UPOWER, NULL);
@@ -270,7 +286,7 @@ xfce_displays_helper_init (XfceDisplaysHelper *helper)
 #endif
 
             /* open the channel */
-            helper->channel = xfconf_channel_get ("displays");
+            helper->channel = xfsettings_snapshot_channel ("displays");
 
             /* remove any leftover apply property before setting the monitor */
             xfconf_channel_reset_property (helper->channel, APPLY_SCHEME_PROP, FALSE);
@@ -281,9 +297,6 @@ xfce_displays_helper_init (XfceDisplaysHelper *helper)
                                                 G_CALLBACK (xfce_displays_helper_channel_property_changed),
                                                 helper);
 
-#ifdef HAS_RANDR_ONE_POINT_THREE
-            helper->has_1_3 = (major > 1 || (major == 1 && minor >= 3));
-#endif
             /* restore the default scheme */
             xfce_displays_helper_channel_apply (helper, DEFAULT_SCHEME_NAME);
         }
@@ -308,6 +321,8 @@ xfce_displays_helper_dispose (GObject *object)
 {
     XfceDisplaysHelper *helper = XFCE_DISPLAYS_HELPER (object);
 
+    xfsettings_memory_unregister (xfce_displays_helper_memory, helper);
+
     if (helper->handler > 0)
     {
         g_signal_handler_disconnect (G_OBJECT (helper->channel),
@@ -325,9 +340,7 @@ xfce_displays_helper_dispose (GObject *object)
     }
 #endif
 
-    gdk_window_remove_filter (helper->root_window,
-                              xfce_displays_helper_screen_on_event,
-                              helper);
+    xfsettings_dispatcher_remove (xfce_displays_helper_screen_on_event, helper);
 
     if (helper->outputs)
     {
@@ -372,7 +385,8 @@ xfce_displays_helper_finalize (GObject *object)
 static void
 xfce_displays_helper_reload (XfceDisplaysHelper *helper)
 {
-    gint err;
+    gint            err;
+    XfsdXStatsScope xstats;
 
     xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Refreshing RandR cache.");
 
@@ -380,7 +394,7 @@ xfce_displays_helper_reload (XfceDisplaysHelper *helper)
     g_ptr_array_unref (helper->outputs);
     g_ptr_array_unref (helper->crtcs);
 
-    gdk_x11_display_error_trap_push (gdk_display_get_default ());
+    xfsettings_xstats_trap_push (&xstats, XFSD_HELPER_DISPLAYS, "reload-resources");
 
     /* Free the screen resources */
     XRRFreeScreenResources (helper->resources);
@@ -399,7 +413,7 @@ xfce_displays_helper_reload (XfceDisplaysHelper *helper)
                                                GDK_WINDOW_XID (helper->root_window));
 
     gdk_display_flush (gdk_display_get_default ());
-    err = gdk_x11_display_error_trap_pop (gdk_display_get_default ());
+    err = xfsettings_xstats_trap_pop (&xstats);
     if (err)
         g_critical ("Failed to reload the RandR cache (err: %d).", err);
 
@@ -432,6 +446,7 @@ xfce_displays_helper_screen_on_event (GdkXEvent *xevent,
 
     if (event_num == RRScreenChangeNotify)
     {
+        xfsettings_trace (XFSD_HELPER_DISPLAYS, XFSD_TRACE_X_EVENT, e->type);
         xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "RRScreenChangeNotify event received.");
 
         old_outputs = g_ptr_array_ref (helper->outputs);
@@ -539,7 +554,7 @@ G_GNUC_END_IGNORE_DEPRECATIONS
                 xfce_displays_helper_apply_all (helper);
 
             /* Start the minimal dialog according to the user preferences */
-            if (changed && xfconf_channel_get_bool (helper->channel, NOTIFY_PROP, FALSE))
+            if (changed && xfsettings_snapshot_get_bool (helper->channel, NOTIFY_PROP, FALSE))
                 xfce_spawn_command_line_on_screen (NULL, "xfce4-display-settings -m", FALSE,
                                                    FALSE, NULL);
         }
@@ -863,11 +878,12 @@ xfce_displays_helper_load_from_xfconf (XfceDisplaysHelper *helper,
 static GPtrArray *
 xfce_displays_helper_list_outputs (XfceDisplaysHelper *helper)
 {
-    GPtrArray     *outputs;
-    XRROutputInfo *output_info;
-    XfceRROutput  *output;
-    XfceRRCrtc    *crtc;
-    gint           best_dist, dist, n, m, l, err;
+    GPtrArray       *outputs;
+    XRROutputInfo   *output_info;
+    XfceRROutput    *output;
+    XfceRRCrtc      *crtc;
+    gint             best_dist, dist, n, m, l, err;
+    XfsdXStatsScope  xstats;
 
     g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->xdisplay && helper->resources);
 
@@ -877,10 +893,10 @@ xfce_displays_helper_list_outputs (XfceDisplaysHelper *helper)
     outputs = g_ptr_array_new_with_free_func ((GDestroyNotify) xfce_displays_helper_free_output);
     for (n = 0; n < helper->resources->noutput; ++n)
     {
-        gdk_x11_display_error_trap_push (gdk_display_get_default ());
+        xfsettings_xstats_trap_push (&xstats, XFSD_HELPER_DISPLAYS, "get-output-info");
         output_info = XRRGetOutputInfo (helper->xdisplay, helper->resources, helper->resources->outputs[n]);
         gdk_display_flush (gdk_display_get_default ());
-        err = gdk_x11_display_error_trap_pop (gdk_display_get_default ());
+        err = xfsettings_xstats_trap_pop (&xstats);
         if (err || !output_info)
         {
             g_warning ("Failed to load info for output %lu (err: %d). Skipping.",
@@ -970,10 +986,14 @@ xfce_displays_helper_free_output (XfceRROutput *output)
 static GPtrArray *
 xfce_displays_helper_list_crtcs (XfceDisplaysHelper *helper)
 {
-    GPtrArray   *crtcs;
-    XRRCrtcInfo *crtc_info;
-    XfceRRCrtc  *crtc;
-    gint         n, err;
+    GPtrArray                   *crtcs;
+    XRRCrtcInfo                 *crtc_info;
+    XfceRRCrtc                  *crtc;
+    gint                         n, err;
+    XfsdXStatsScope              xstats;
+#ifdef HAS_RANDR_ONE_POINT_THREE
+    XRRCrtcTransformAttributes  *attributes;
+#endif
 
     g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->xdisplay && helper->resources);
 
@@ -983,10 +1003,10 @@ xfce_displays_helper_list_crtcs (XfceDisplaysHelper *helper)
     {
         xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Detected CRTC %lu.", helper->resources->crtcs[n]);
 
-        gdk_x11_display_error_trap_push (gdk_display_get_default ());
+        xfsettings_xstats_trap_push (&xstats, XFSD_HELPER_DISPLAYS, "get-crtc-info");
         crtc_info = XRRGetCrtcInfo (helper->xdisplay, helper->resources, helper->resources->crtcs[n]);
         gdk_display_flush (gdk_display_get_default ());
-        err = gdk_x11_display_error_trap_pop (gdk_display_get_default ());
+        err = xfsettings_xstats_trap_pop (&xstats);
         if (err || !crtc_info)
         {
             g_warning ("Failed to load info for CRTC %lu (err: %d). Skipping.",
@@ -1019,6 +1039,26 @@ xfce_displays_helper_list_crtcs (XfceDisplaysHelper *helper)
         crtc->changed = FALSE;
         XRRFreeCrtcInfo (crtc_info);
 
+        /* current scaling, so applying the same scale is not a change */
+        crtc->scalex = crtc->scaley = 1.0;
+#ifdef HAS_RANDR_ONE_POINT_THREE
+        if (helper->has_1_3)
+        {
+            attributes = NULL;
+            xfsettings_xstats_trap_push (&xstats, XFSD_HELPER_DISPLAYS, "get-crtc-transform");
+            if (XRRGetCrtcTransform (helper->xdisplay, crtc->id, &attributes)
+                && attributes != NULL)
+            {
+                crtc->scalex = XFixedToDouble (attributes->currentTransform.matrix[0][0]);
+                crtc->scaley = XFixedToDouble (attributes->currentTransform.matrix[1][1]);
+            }
+            xfsettings_xstats_trap_pop (&xstats);
+
+            if (attributes != NULL)
+                XFree (attributes);
+        }
+#endif
+
         /* cache it */
         g_ptr_array_add (crtcs, crtc);
     }
@@ -1064,6 +1104,62 @@ xfce_displays_helper_free_crtc (XfceRRCrtc *crtc)
 
 
 
+static void
+xfce_displays_helper_memory (XfsdMemoryReport *report,
+                             gpointer          user_data)
+{
+    XfceDisplaysHelper *helper = XFCE_DISPLAYS_HELPER (user_data);
+    XfceRRCrtc         *crtc;
+    XfceRROutput       *output;
+    gsize               n_bytes;
+    guint               n;
+    gint                m;
+
+    if (helper->resources != NULL)
+    {
+        /* Xlib allocates the resources in one block */
+        n_bytes = sizeof (XRRScreenResources)
+                  + helper->resources->ncrtc * sizeof (RRCrtc)
+                  + helper->resources->noutput * sizeof (RROutput)
+                  + helper->resources->nmode * sizeof (XRRModeInfo);
+        for (m = 0; m < helper->resources->nmode; ++m)
+            n_bytes += helper->resources->modes[m].nameLength + 1;
+
+        xfsettings_memory_add (report, "screen-resources", 1, n_bytes);
+    }
+
+    if (helper->crtcs != NULL)
+    {
+        n_bytes = sizeof (GPtrArray) + helper->crtcs->len * sizeof (gpointer);
+        for (n = 0; n < helper->crtcs->len; ++n)
+        {
+            crtc = g_ptr_array_index (helper->crtcs, n);
+            n_bytes += sizeof (XfceRRCrtc)
+                       + (crtc->noutput + crtc->npossible) * sizeof (RROutput);
+        }
+
+        xfsettings_memory_add (report, "crtcs", helper->crtcs->len, n_bytes);
+    }
+
+    if (helper->outputs != NULL)
+    {
+        n_bytes = sizeof (GPtrArray) + helper->outputs->len * sizeof (gpointer);
+        for (n = 0; n < helper->outputs->len; ++n)
+        {
+            output = g_ptr_array_index (helper->outputs, n);
+            n_bytes += sizeof (XfceRROutput) + sizeof (XRROutputInfo)
+                       + output->info->ncrtc * sizeof (RRCrtc)
+                       + output->info->nclone * sizeof (RROutput)
+                       + output->info->nmode * sizeof (RRMode)
+                       + output->info->nameLen + 1;
+        }
+
+        xfsettings_memory_add (report, "outputs", helper->outputs->len, n_bytes);
+    }
+}
+
+
+
 static XfceRRCrtc *
 xfce_displays_helper_find_usable_crtc (XfceDisplaysHelper *helper,
                                        XfceRROutput       *output)
@@ -1312,9 +1408,44 @@ xfce_displays_helper_set_outputs (XfceRRCrtc   *crtc,
 
 
 
+static gboolean
+xfce_displays_helper_has_changes (XfceDisplaysHelper *helper)
+{
+    XfceRRCrtc *crtc;
+    guint       n;
+
+    for (n = 0; n < helper->crtcs->len; ++n)
+    {
+        crtc = g_ptr_array_index (helper->crtcs, n);
+        if (crtc->changed)
+            return TRUE;
+    }
+
+G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+    if (helper->width != gdk_screen_width ()
+        || helper->height != gdk_screen_height ()
+        || helper->mm_width != gdk_screen_width_mm ()
+        || helper->mm_height != gdk_screen_height_mm ())
+        return TRUE;
+G_GNUC_END_IGNORE_DEPRECATIONS
+
+#ifdef HAS_RANDR_ONE_POINT_THREE
+    if (helper->has_1_3
+        && (RROutput) helper->primary != XRRGetOutputPrimary (helper->xdisplay,
+                                                              GDK_WINDOW_XID (helper->root_window)))
+        return TRUE;
+#endif
+
+    return FALSE;
+}
+
+
+
 static void
 xfce_displays_helper_apply_all (XfceDisplaysHelper *helper)
 {
+    XfsdXStatsScope xstats;
+
     g_assert (XFCE_IS_DISPLAYS_HELPER (helper) && helper->crtcs);
 
     helper->mm_width = helper->mm_height = helper->width = helper->height = 0;
@@ -1324,7 +1455,15 @@ xfce_displays_helper_apply_all (XfceDisplaysHelper *helper)
     g_ptr_array_foreach (helper->crtcs, (GFunc) xfce_displays_helper_get_topleftmost_pos, helper);
     g_ptr_array_foreach (helper->crtcs, (GFunc) xfce_displays_helper_normalize_crtc, helper);
 
-    gdk_x11_display_error_trap_push (gdk_display_get_default ());
+    /* don't grab the server for a configuration that is already active */
+    if (!xfce_displays_helper_has_changes (helper))
+    {
+        xfsettings_xstats_elided (XFSD_HELPER_DISPLAYS, "apply");
+        xfsettings_dbg (XFSD_DEBUG_DISPLAYS, "Configuration already active, nothing to apply.");
+        return;
+    }
+
+    xfsettings_xstats_trap_push (&xstats, XFSD_HELPER_DISPLAYS, "apply");
 
     /* grab server to prevent clients from thinking no output is enabled */
     gdk_x11_display_grab (helper->display);
@@ -1347,7 +1486,7 @@ xfce_displays_helper_apply_all (XfceDisplaysHelper *helper)
     /* release the grab, changes are done */
     gdk_x11_display_ungrab (helper->display);
     gdk_display_flush (gdk_display_get_default ());
-    if (gdk_x11_display_error_trap_pop (gdk_display_get_default ()) != 0)
+    if (xfsettings_xstats_trap_pop (&xstats) != 0)
     {
         g_critical ("Failed to apply display settings");
     }
@@ -1355,13 +1494,14 @@ xfce_displays_helper_apply_all (XfceDisplaysHelper *helper)
 
 
 
-static void
+static gboolean
 xfce_displays_helper_channel_apply (XfceDisplaysHelper *helper,
                                     const gchar        *scheme)
 {
     gchar       property[512];
     guint       n, nactive;
     GHashTable *saved_outputs;
+    gboolean    applied = FALSE;
 
     saved_outputs = NULL;
 #ifdef HAS_RANDR_ONE_POINT_THREE
@@ -1370,7 +1510,7 @@ xfce_displays_helper_channel_apply (XfceDisplaysHelper *helper,
 
     /* finally the list of saved outputs from xfconf */
     g_snprintf (property, sizeof (property), "/%s", scheme);
-    saved_outputs = xfconf_channel_get_properties (helper->channel, property);
+    saved_outputs = xfsettings_snapshot_get_properties (helper->channel, property);
 
     /* nothing saved, nothing to do */
     if (saved_outputs == NULL)
@@ -1397,11 +1537,14 @@ xfce_displays_helper_channel_apply (XfceDisplaysHelper *helper,
 
     /* apply settings */
     xfce_displays_helper_apply_all (helper);
+    applied = TRUE;
 
 err_cleanup:
     /* Free the xfconf properties */
     if (saved_outputs)
         g_hash_table_destroy (saved_outputs);
+
+    return applied;
 }
 
 
@@ -1415,8 +1558,14 @@ xfce_displays_helper_channel_property_changed (XfconfChannel      *channel,
     if (G_UNLIKELY (G_VALUE_HOLDS_STRING (value) &&
         g_strcmp0 (property_name, APPLY_SCHEME_PROP) == 0))
     {
-        /* apply */
-        xfce_displays_helper_channel_apply (helper, g_value_get_string (value));
+        /* apply; hotplug applies are not measured, they
+         * are not caused by a change in xfconf */
+        xfsettings_metrics_changed (XFSD_HELPER_DISPLAYS, property_name);
+        xfsettings_trace (XFSD_HELPER_DISPLAYS, XFSD_TRACE_APPLY_START, 0);
+        if (xfce_displays_helper_channel_apply (helper, g_value_get_string (value)))
+            xfsettings_metrics_applied (XFSD_HELPER_DISPLAYS);
+        else
+            xfsettings_metrics_discard (XFSD_HELPER_DISPLAYS);
         /* remove the apply property */
         xfconf_channel_reset_property (channel, APPLY_SCHEME_PROP, FALSE);
     }
@@ -1471,7 +1620,7 @@ xfce_displays_helper_toggle_internal (gpointer           *power,
     else if (!lvds->active && !lid_is_closed)
     {
         /* re-activate it because the user opened the lid */
-        saved_outputs = xfconf_channel_get_properties (helper->channel, "/" DEFAULT_SCHEME_NAME);
+        saved_outputs = xfsettings_snapshot_get_properties (helper->channel, "/" DEFAULT_SCHEME_NAME);
         if (saved_outputs)
         {
             /* first, ensure the position of the other outputs is correct */
@@ -0,0 +1,372 @@
+/*
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Watches the fontconfig configuration and font directories. All watches
+ * are kept in an index on the directory path, so a new fontconfig state
+ * only adds and removes the directories that differ from the previous one
+ * instead of recreating every monitor. Configuration files are watched
+ * through their parent directory, so the many files in conf.d share a
+ * single watch. Files directly in the home directory, like ~/.fonts.conf,
+ * are watched themselves, a watch on $HOME would fire all the time.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "fontconfig-monitor.h"
+#include "debug.h"
+
+
+
+typedef struct _XfceFontconfigWatch XfceFontconfigWatch;
+
+
+
+static void xfce_fontconfig_monitor_finalize   (GObject             *object);
+static void xfce_fontconfig_monitor_watch_free (gpointer             data);
+
+
+
+struct _XfceFontconfigMonitorClass
+{
+    GObjectClass __parent__;
+
+    void         (*changed) (XfceFontconfigMonitor *monitor,
+                             const gchar           *path);
+};
+
+struct _XfceFontconfigMonitor
+{
+    GObject     __parent__;
+
+    /* directory path -> XfceFontconfigWatch */
+    GHashTable *watches;
+
+    /* full paths of the loaded configuration files */
+    GHashTable *config_files;
+
+    /* increased on each update, to find watches that are gone */
+    guint       generation;
+
+    /* bytes used by the index, excluding the monitors */
+    gsize       index_size;
+};
+
+enum
+{
+    WATCH_CONFIG   = 1 << 0,
+    WATCH_FONT_DIR = 1 << 1,
+    WATCH_FILE     = 1 << 2
+};
+
+struct _XfceFontconfigWatch
+{
+    XfceFontconfigMonitor *monitor;
+    GFileMonitor          *file_monitor;
+    gchar                 *path;
+    guint                  flags;
+    guint                  generation;
+};
+
+enum
+{
+    CHANGED,
+    LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL] = {0};
+
+
+
+G_DEFINE_TYPE (XfceFontconfigMonitor, xfce_fontconfig_monitor, G_TYPE_OBJECT);
+
+
+
+static void
+xfce_fontconfig_monitor_class_init (XfceFontconfigMonitorClass *klass)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+    gobject_class->finalize = xfce_fontconfig_monitor_finalize;
+
+    signals[CHANGED] =
+        g_signal_new ("changed",
+                      XFCE_TYPE_FONTCONFIG_MONITOR,
+                      G_SIGNAL_RUN_LAST,
+                      G_STRUCT_OFFSET (XfceFontconfigMonitorClass, changed),
+                      NULL, NULL,
+                      g_cclosure_marshal_VOID__STRING,
+                      G_TYPE_NONE, 1, G_TYPE_STRING);
+}
+
+
+
+static void
+xfce_fontconfig_monitor_init (XfceFontconfigMonitor *monitor)
+{
+    monitor->watches = g_hash_table_new_full (g_str_hash, g_str_equal,
+        NULL, xfce_fontconfig_monitor_watch_free);
+    monitor->config_files = g_hash_table_new_full (g_str_hash, g_str_equal,
+        g_free, NULL);
+}
+
+
+
+static void
+xfce_fontconfig_monitor_finalize (GObject *object)
+{
+    XfceFontconfigMonitor *monitor = XFCE_FONTCONFIG_MONITOR (object);
+
+    g_hash_table_destroy (monitor->watches);
+    g_hash_table_destroy (monitor->config_files);
+
+    (*G_OBJECT_CLASS (xfce_fontconfig_monitor_parent_class)->finalize) (object);
+}
+
+
+
+static gsize
+xfce_fontconfig_monitor_watch_size (XfceFontconfigWatch *watch)
+{
+    /* watch, path and the hash table slot (hash, key and value) */
+    return sizeof (XfceFontconfigWatch) + strlen (watch->path) + 1
+           + sizeof (guint) + 2 * sizeof (gpointer);
+}
+
+
+
+static void
+xfce_fontconfig_monitor_watch_free (gpointer data)
+{
+    XfceFontconfigWatch *watch = data;
+
+    watch->monitor->index_size -= xfce_fontconfig_monitor_watch_size (watch);
+
+    g_signal_handlers_disconnect_by_data (G_OBJECT (watch->file_monitor), watch);
+    g_file_monitor_cancel (watch->file_monitor);
+    g_object_unref (G_OBJECT (watch->file_monitor));
+
+    g_free (watch->path);
+    g_slice_free (XfceFontconfigWatch, watch);
+}
+
+
+
+static void
+xfce_fontconfig_monitor_watch_changed (GFileMonitor        *file_monitor,
+                                       GFile               *file,
+                                       GFile               *other_file,
+                                       GFileMonitorEvent    event_type,
+                                       XfceFontconfigWatch *watch)
+{
+    gchar    *path;
+    gchar    *basename;
+    gboolean  relevant = FALSE;
+
+    if (event_type == G_FILE_MONITOR_EVENT_PRE_UNMOUNT
+        || event_type == G_FILE_MONITOR_EVENT_UNMOUNTED)
+        return;
+
+    path = g_file_get_path (file);
+    if (G_UNLIKELY (path == NULL))
+        return;
+
+    if ((watch->flags & WATCH_FONT_DIR) != 0)
+    {
+        /* fontconfig writes a .uuid file in font directories,
+         * this does not change the font list */
+        basename = g_path_get_basename (path);
+        relevant = strcmp (basename, ".uuid") != 0;
+        g_free (basename);
+    }
+
+    if (!relevant && (watch->flags & WATCH_CONFIG) != 0)
+    {
+        /* a loaded config file or a new one in conf.d */
+        relevant = g_hash_table_contains (watch->monitor->config_files, path)
+                   || g_str_has_suffix (path, ".conf");
+    }
+
+    if (relevant)
+    {
+        xfsettings_dbg_filtered (XFSD_DEBUG_FONTCONFIG, "\"%s\" changed", path);
+        g_signal_emit (G_OBJECT (watch->monitor), signals[CHANGED], 0, watch->path);
+    }
+
+    g_free (path);
+}
+
+
+
+static void
+xfce_fontconfig_monitor_watch (XfceFontconfigMonitor *monitor,
+                               const gchar           *path,
+                               guint                  flags,
+                               guint                 *n_added)
+{
+    XfceFontconfigWatch *watch;
+    GFile               *file;
+    GFileMonitor        *file_monitor;
+
+    watch = g_hash_table_lookup (monitor->watches, path);
+    if (watch != NULL)
+    {
+        /* still in use, keep the existing monitor; the flags
+         * are collected again for each generation */
+        if (watch->generation != monitor->generation)
+            watch->flags = flags;
+        else
+            watch->flags |= flags;
+        watch->generation = monitor->generation;
+        return;
+    }
+
+    file = g_file_new_for_path (path);
+    if ((flags & WATCH_FILE) != 0)
+        file_monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE, NULL, NULL);
+    else
+        file_monitor = g_file_monitor_directory (file, G_FILE_MONITOR_NONE, NULL, NULL);
+    g_object_unref (G_OBJECT (file));
+
+    if (G_UNLIKELY (file_monitor == NULL))
+        return;
+
+    watch = g_slice_new0 (XfceFontconfigWatch);
+    watch->monitor = monitor;
+    watch->file_monitor = file_monitor;
+    watch->path = g_strdup (path);
+    watch->flags = flags;
+    watch->generation = monitor->generation;
+
+    g_signal_connect (G_OBJECT (file_monitor), "changed",
+        G_CALLBACK (xfce_fontconfig_monitor_watch_changed), watch);
+
+    g_hash_table_insert (monitor->watches, watch->path, watch);
+    monitor->index_size += xfce_fontconfig_monitor_watch_size (watch);
+
+    (*n_added)++;
+}
+
+
+
+static gboolean
+xfce_fontconfig_monitor_watch_expired (gpointer key,
+                                       gpointer value,
+                                       gpointer data)
+{
+    XfceFontconfigWatch *watch = value;
+
+    return watch->generation != GPOINTER_TO_UINT (data);
+}
+
+
+
+XfceFontconfigMonitor *
+xfce_fontconfig_monitor_new (void)
+{
+    return g_object_new (XFCE_TYPE_FONTCONFIG_MONITOR, NULL);
+}
+
+
+
+void
+xfce_fontconfig_monitor_update (XfceFontconfigMonitor  *monitor,
+                                gchar                 **config_files,
+                                gchar                 **font_dirs)
+{
+    guint  i;
+    gchar *dirname;
+    guint  n_added = 0;
+    guint  n_removed;
+
+    g_return_if_fail (XFCE_IS_FONTCONFIG_MONITOR (monitor));
+
+    monitor->generation++;
+
+    g_hash_table_remove_all (monitor->config_files);
+
+    if (config_files != NULL)
+    {
+        for (i = 0; config_files[i] != NULL; i++)
+        {
+            g_hash_table_add (monitor->config_files, g_strdup (config_files[i]));
+
+            /* watch included directories themselves, files
+             * through their parent directory */
+            if (g_file_test (config_files[i], G_FILE_TEST_IS_DIR))
+            {
+                xfce_fontconfig_monitor_watch (monitor, config_files[i],
+                                               WATCH_CONFIG, &n_added);
+            }
+            else
+            {
+                dirname = g_path_get_dirname (config_files[i]);
+                if (strcmp (dirname, g_get_home_dir ()) == 0)
+                    xfce_fontconfig_monitor_watch (monitor, config_files[i],
+                                                   WATCH_CONFIG | WATCH_FILE, &n_added);
+                else
+                    xfce_fontconfig_monitor_watch (monitor, dirname,
+                                                   WATCH_CONFIG, &n_added);
+                g_free (dirname);
+            }
+        }
+    }
+
+    if (font_dirs != NULL)
+    {
+        for (i = 0; font_dirs[i] != NULL; i++)
+            xfce_fontconfig_monitor_watch (monitor, font_dirs[i],
+                                           WATCH_FONT_DIR, &n_added);
+    }
+
+    /* drop the directories that are no longer used */
+    n_removed = g_hash_table_foreach_remove (monitor->watches,
+        xfce_fontconfig_monitor_watch_expired,
+        GUINT_TO_POINTER (monitor->generation));
+
+    xfsettings_dbg (XFSD_DEBUG_FONTCONFIG,
+                    "monitoring %u directories (%u added, %u removed, "
+                    "index=%"G_GSIZE_FORMAT" bytes)",
+                    g_hash_table_size (monitor->watches), n_added, n_removed,
+                    monitor->index_size);
+}
+
+
+
+void
+xfce_fontconfig_monitor_get_stats (XfceFontconfigMonitor *monitor,
+                                   guint                 *n_watches,
+                                   gsize                 *index_size)
+{
+    g_return_if_fail (XFCE_IS_FONTCONFIG_MONITOR (monitor));
+
+    if (n_watches != NULL)
+        *n_watches = g_hash_table_size (monitor->watches);
+
+    if (index_size != NULL)
+        *index_size = monitor->index_size;
+}
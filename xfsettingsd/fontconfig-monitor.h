@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __FONTCONFIG_MONITOR_H__
+#define __FONTCONFIG_MONITOR_H__
+
+#include <glib-object.h>
+
+typedef struct _XfceFontconfigMonitorClass XfceFontconfigMonitorClass;
+typedef struct _XfceFontconfigMonitor      XfceFontconfigMonitor;
+
+#define XFCE_TYPE_FONTCONFIG_MONITOR            (xfce_fontconfig_monitor_get_type ())
+#define XFCE_FONTCONFIG_MONITOR(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), XFCE_TYPE_FONTCONFIG_MONITOR, XfceFontconfigMonitor))
+#define XFCE_FONTCONFIG_MONITOR_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), XFCE_TYPE_FONTCONFIG_MONITOR, XfceFontconfigMonitorClass))
+#define XFCE_IS_FONTCONFIG_MONITOR(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), XFCE_TYPE_FONTCONFIG_MONITOR))
+#define XFCE_IS_FONTCONFIG_MONITOR_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), XFCE_TYPE_FONTCONFIG_MONITOR))
+#define XFCE_FONTCONFIG_MONITOR_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), XFCE_TYPE_FONTCONFIG_MONITOR, XfceFontconfigMonitorClass))
+
+GType                  xfce_fontconfig_monitor_get_type  (void) G_GNUC_CONST;
+
+XfceFontconfigMonitor *xfce_fontconfig_monitor_new       (void);
+
+void                   xfce_fontconfig_monitor_update    (XfceFontconfigMonitor  *monitor,
+                                                          gchar                 **config_files,
+                                                          gchar                 **font_dirs);
+
+void                   xfce_fontconfig_monitor_get_stats (XfceFontconfigMonitor  *monitor,
+                                                          guint                  *n_watches,
+                                                          gsize                  *index_size);
+
+#endif /* !__FONTCONFIG_MONITOR_H__ */
@@ -27,6 +27,9 @@
 #include <xfconf/xfconf.h>
 #include <libxfce4util/libxfce4util.h>
 #include "gtk-decorations.h"
+#include "metrics.h"
+#include "trace.h"
+#include "xfconf-snapshot.h"
 
 #define DEFAULT_LAYOUT "O|HMC"
 
@@ -126,7 +129,10 @@ xfce_decorations_helper_channel_property_changed (XfconfChannel         *channel
 {
     if (strcmp (property_name, "/general/button_layout") == 0)
     {
+        xfsettings_metrics_changed (XFSD_HELPER_GTK_DECORATIONS, property_name);
+        xfsettings_trace (XFSD_HELPER_GTK_DECORATIONS, XFSD_TRACE_APPLY_START, 0);
         xfce_decorations_set_decoration_layout (helper, g_value_get_string (value));
+        xfsettings_metrics_applied (XFSD_HELPER_GTK_DECORATIONS);
     }
 }
 
@@ -135,11 +141,11 @@ xfce_decorations_helper_init (XfceDecorationsHelper *helper)
 {
     const gchar *layout;
 
-    helper->wm_channel = xfconf_channel_get ("xfwm4");
+    helper->wm_channel = xfsettings_snapshot_channel ("xfwm4");
     helper->xsettings_channel = xfconf_channel_get ("xsettings");
 
-    layout = xfconf_channel_get_string  (helper->wm_channel,
-                                         "/general/button_layout", DEFAULT_LAYOUT);
+    layout = xfsettings_snapshot_get_string (helper->wm_channel,
+                                             "/general/button_layout", DEFAULT_LAYOUT);
     xfce_decorations_set_decoration_layout (helper, layout);
 
     /* monitor WM channel changes */
@@ -42,6 +42,10 @@
 #endif /* HAVE_LIBXKLAVIER */
 
 #include "debug.h"
+#include "metrics.h"
+#include "trace.h"
+#include "xfconf-snapshot.h"
+#include "dispatcher.h"
 #include "keyboard-layout.h"
 
 static void xfce_keyboard_layout_helper_finalize                  (GObject                       *object);
@@ -90,6 +94,16 @@ struct _XfceKeyboardLayoutHelper
 #endif /* HAVE_LIBXKLAVIER */
 };
 
+#ifdef HAVE_LIBXKLAVIER
+/* core events used by xkl_engine_filter_events, other
+ * traffic like pointer motion is not passed to libxklavier */
+static const gint xkl_event_types[] =
+{
+    FocusIn, FocusOut, PropertyNotify, CreateNotify, DestroyNotify,
+    UnmapNotify, MapNotify, MappingNotify, GravityNotify, ReparentNotify
+};
+#endif /* HAVE_LIBXKLAVIER */
+
 G_DEFINE_TYPE (XfceKeyboardLayoutHelper, xfce_keyboard_layout_helper, G_TYPE_OBJECT);
 
 static void
@@ -104,13 +118,17 @@ xfce_keyboard_layout_helper_class_init (XfceKeyboardLayoutHelperClass *klass)
 static void
 xfce_keyboard_layout_helper_init (XfceKeyboardLayoutHelper *helper)
 {
+#ifdef HAVE_LIBXKLAVIER
+    guint i;
+#endif /* HAVE_LIBXKLAVIER */
+
     /* init */
     helper->channel = NULL;
 
     /* open the channel */
-    helper->channel = xfconf_channel_get ("keyboard-layout");
+    helper->channel = xfsettings_snapshot_channel ("keyboard-layout");
 
-    helper->xkb_disable_settings = xfconf_channel_get_bool (helper->channel, "/Default/XkbDisable", TRUE);
+    helper->xkb_disable_settings = xfsettings_snapshot_get_bool (helper->channel, "/Default/XkbDisable", TRUE);
 
 #ifdef HAVE_LIBXKLAVIER
     /* monitor channel changes */
@@ -121,7 +139,10 @@ xfce_keyboard_layout_helper_init (XfceKeyboardLayoutHelper *helper)
     xkl_config_rec_get_from_server (helper->config, helper->engine);
     helper->system_keyboard_model = g_strdup (helper->config->model);
 
-    gdk_window_add_filter (NULL, (GdkFilterFunc) handle_xevent, helper);
+    for (i = 0; i < G_N_ELEMENTS (xkl_event_types); i++)
+        xfsettings_dispatcher_add (xkl_event_types[i], (GdkFilterFunc) handle_xevent, helper);
+    xfsettings_dispatcher_add_xkb (XFSD_XKB_ANY, (GdkFilterFunc) handle_xevent, helper);
+    xfsettings_dispatcher_add_device_presence ((GdkFilterFunc) handle_xevent, helper);
     g_signal_connect (helper->engine, "X-new-device",
                       G_CALLBACK (xfce_keyboard_layout_reset_xkl_config), helper);
     xkl_engine_start_listen (helper->engine, XKLL_TRACK_KEYBOARD_STATE);
@@ -144,7 +165,7 @@ xfce_keyboard_layout_helper_finalize (GObject *object)
     XfceKeyboardLayoutHelper *helper = XFCE_KEYBOARD_LAYOUT_HELPER (object);
 
     xkl_engine_stop_listen (helper->engine, XKLL_TRACK_KEYBOARD_STATE);
-    gdk_window_remove_filter (NULL, (GdkFilterFunc) handle_xevent, helper);
+    xfsettings_dispatcher_remove ((GdkFilterFunc) handle_xevent, helper);
     g_object_unref (helper->config);
     g_object_unref (helper->engine);
     g_free (helper->system_keyboard_model);
@@ -191,7 +212,7 @@ xfce_keyboard_layout_helper_set_model (XfceKeyboardLayoutHelper *helper)
 
     if (!helper->xkb_disable_settings)
     {
-        xkbmodel = xfconf_channel_get_string (helper->channel, "/Default/XkbModel", NULL);
+        xkbmodel = xfsettings_snapshot_get_string (helper->channel, "/Default/XkbModel", NULL);
         if (!xkbmodel || !*xkbmodel)
         {
             /* If xkb model is not set by user, we want to try to use the system default */
@@ -226,8 +247,8 @@ xfce_keyboard_layout_helper_set (XfceKeyboardLayoutHelper *helper,
     if (!helper->xkb_disable_settings)
     {
         xfconf_values  = g_strjoinv (",", *xkl_config_option);
-        xkl_values  = xfconf_channel_get_string (helper->channel,
-                                                 xfconf_option_name, xfconf_values);
+        xkl_values  = xfsettings_snapshot_get_string (helper->channel,
+                                                      xfconf_option_name, xfconf_values);
 
         if (g_strcmp0 (xfconf_values, xkl_values) != 0)
         {
@@ -318,8 +339,8 @@ xfce_keyboard_layout_helper_set_option (XfceKeyboardLayoutHelper *helper,
         xkl_option_value = xfce_keyboard_layout_get_option (helper->config->options,
                                                             xkb_option_name, &other_options);
 
-        option_value = xfconf_channel_get_string (helper->channel, xfconf_option_name,
-                                                  xkl_option_value);
+        option_value = xfsettings_snapshot_get_string (helper->channel, xfconf_option_name,
+                                                       xkl_option_value);
         if (g_strcmp0 (option_value, xkl_option_value) != 0)
         {
             gchar *options_string;
@@ -373,6 +394,9 @@ xfce_keyboard_layout_helper_channel_property_changed (XfconfChannel      *channe
 {
     g_return_if_fail (helper->channel == channel);
 
+    xfsettings_metrics_changed (XFSD_HELPER_KEYBOARD_LAYOUT, property_name);
+    xfsettings_trace (XFSD_HELPER_KEYBOARD_LAYOUT, XFSD_TRACE_APPLY_START, 0);
+
     if (strcmp (property_name, "/Default/XkbDisable") == 0)
     {
         helper->xkb_disable_settings = g_value_get_boolean (value);
@@ -404,6 +428,8 @@ xfce_keyboard_layout_helper_channel_property_changed (XfconfChannel      *channe
     }
 
     xfce_keyboard_layout_helper_process_xmodmap ();
+
+    xfsettings_metrics_applied (XFSD_HELPER_KEYBOARD_LAYOUT);
 }
 
 static GdkFilterReturn
@@ -429,7 +455,7 @@ xfce_keyboard_layout_reset_xkl_config (XklEngine *xklengine,
         xkl_config_rec_reset (helper->config);
         xkl_config_rec_get_from_server (helper->config, helper->engine);
 
-        xfconf_model = xfconf_channel_get_string (helper->channel, "/Default/XkbModel", NULL);
+        xfconf_model = xfsettings_snapshot_get_string (helper->channel, "/Default/XkbModel", NULL);
         if (xfconf_model && *xfconf_model &&
             g_strcmp0 (xfconf_model, helper->config->model) != 0 &&
             g_strcmp0 (helper->system_keyboard_model, helper->config->model) != 0)
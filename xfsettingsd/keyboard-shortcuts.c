@@ -40,6 +40,8 @@
 #include <libxfce4kbd-private/xfce-shortcuts-grabber.h>
 
 #include "debug.h"
+#include "metrics.h"
+#include "trace.h"
 #include "keyboard-shortcuts.h"
 
 
@@ -143,7 +145,10 @@ xfce_keyboard_shortcuts_helper_shortcut_added (XfceShortcutsProvider       *prov
                                                XfceKeyboardShortcutsHelper *helper)
 {
   g_return_if_fail (XFCE_IS_KEYBOARD_SHORTCUTS_HELPER (helper));
+  xfsettings_metrics_changed (XFSD_HELPER_KEYBOARD_SHORTCUTS, shortcut);
+  xfsettings_trace (XFSD_HELPER_KEYBOARD_SHORTCUTS, XFSD_TRACE_APPLY_START, 0);
   xfce_shortcuts_grabber_add (helper->grabber, shortcut);
+  xfsettings_metrics_applied (XFSD_HELPER_KEYBOARD_SHORTCUTS);
 
   xfsettings_dbg (XFSD_DEBUG_KEYBOARD_SHORTCUTS, "add \"%s\"", shortcut);
 }
@@ -156,7 +161,10 @@ xfce_keyboard_shortcuts_helper_shortcut_removed (XfceShortcutsProvider       *pr
                                                  XfceKeyboardShortcutsHelper *helper)
 {
   g_return_if_fail (XFCE_IS_KEYBOARD_SHORTCUTS_HELPER (helper));
+  xfsettings_metrics_changed (XFSD_HELPER_KEYBOARD_SHORTCUTS, shortcut);
+  xfsettings_trace (XFSD_HELPER_KEYBOARD_SHORTCUTS, XFSD_TRACE_APPLY_START, 0);
   xfce_shortcuts_grabber_remove (helper->grabber, shortcut);
+  xfsettings_metrics_applied (XFSD_HELPER_KEYBOARD_SHORTCUTS);
 
   xfsettings_dbg (XFSD_DEBUG_KEYBOARD_SHORTCUTS, "remove \"%s\"", shortcut);
 }
@@ -41,6 +41,13 @@
 #include <libxfce4util/libxfce4util.h>
 
 #include "debug.h"
+#include "atoms.h"
+#include "metrics.h"
+#include "trace.h"
+#include "xfconf-snapshot.h"
+#include "xstats.h"
+#include "xtrap.h"
+#include "dispatcher.h"
 #include "keyboards.h"
 
 
@@ -52,10 +59,11 @@ static void xfce_keyboards_helper_channel_property_changed  (XfconfChannel
                                                              const gchar              *property_name,
                                                              const GValue             *value,
                                                              XfceKeyboardsHelper      *helper);
-static void xfce_keyboards_helper_restore_numlock_state     (XfconfChannel            *channel);
+static void xfce_keyboards_helper_restore_numlock_state     (XfceKeyboardsHelper      *helper);
 static void xfce_keyboards_helper_save_numlock_state        (XfconfChannel            *channel);
 static gboolean xfce_keyboards_helper_device_is_keyboard    (XID xid);
-static void xfce_keyboards_helper_set_all_settings          (XfceKeyboardsHelper      *helper);
+static void xfce_keyboards_helper_set_all_settings          (XfceKeyboardsHelper      *helper,
+                                                            gboolean                  force);
 #ifdef DEVICE_HOTPLUGGING
 static GdkFilterReturn  xfce_keyboards_helper_event_filter  (GdkXEvent                *xevent,
                                                              GdkEvent                 *gdk_event,
@@ -77,6 +85,10 @@ struct _XfceKeyboardsHelper
     /* xfconf channel */
     XfconfChannel *channel;
 
+    /* state of the server, only set while applying all settings */
+    XkbDescPtr     live;
+    guint          live_locked_mods;
+
 #ifdef DEVICE_HOTPLUGGING
     /* device presence event type */
     gint device_presence_event_type;
@@ -109,10 +121,12 @@ xfce_keyboards_helper_init (XfceKeyboardsHelper *helper)
     Display *xdisplay;
 #ifdef DEVICE_HOTPLUGGING
     XEventClass event_class;
+    XfsdXStatsScope xstats;
 #endif
 
     /* init */
     helper->channel = NULL;
+    helper->live = NULL;
 
     /* get the default display */
     xdisplay = gdk_x11_display_get_xdisplay (gdk_display_get_default ());
@@ -122,7 +136,7 @@ xfce_keyboards_helper_init (XfceKeyboardsHelper *helper)
         xfsettings_dbg (XFSD_DEBUG_KEYBOARDS, "initialized xkb %d.%d", marjor_ver, minor_ver);
 
         /* open the channel */
-        helper->channel = xfconf_channel_get ("keyboards");
+        helper->channel = xfsettings_snapshot_channel ("keyboards");
 
         /* monitor channel changes */
         g_signal_connect (G_OBJECT (helper->channel), "property-changed",
@@ -132,20 +146,20 @@ xfce_keyboards_helper_init (XfceKeyboardsHelper *helper)
         if (G_LIKELY (xdisplay != NULL))
         {
             /* monitor device changes */
-            gdk_x11_display_error_trap_push (gdk_display_get_default ());
+            xfsettings_xstats_trap_push (&xstats, XFSD_HELPER_KEYBOARDS, "select-events");
             DevicePresence (xdisplay, helper->device_presence_event_type, event_class);
             XSelectExtensionEvent (xdisplay, RootWindow (xdisplay, DefaultScreen (xdisplay)), &event_class, 1);
 
             /* add an event filter */
-            if (gdk_x11_display_error_trap_pop (gdk_display_get_default ()) == 0)
-                gdk_window_add_filter (NULL, xfce_keyboards_helper_event_filter, helper);
+            if (xfsettings_xstats_trap_pop (&xstats) == 0)
+                xfsettings_dispatcher_add_device_presence (xfce_keyboards_helper_event_filter, helper);
             else
                 g_warning ("Failed to create device filter");
         }
 #endif
 
         /* load keyboard settings */
-        xfce_keyboards_helper_set_all_settings (helper);
+        xfce_keyboards_helper_set_all_settings (helper, FALSE);
     }
     else
     {
@@ -161,6 +175,10 @@ xfce_keyboards_helper_finalize (GObject *object)
 {
     XfceKeyboardsHelper *helper = XFCE_KEYBOARDS_HELPER (object);
 
+#ifdef DEVICE_HOTPLUGGING
+    xfsettings_dispatcher_remove (xfce_keyboards_helper_event_filter, helper);
+#endif
+
     /* Save the numlock state */
     xfce_keyboards_helper_save_numlock_state (helper->channel);
 
@@ -176,15 +194,25 @@ xfce_keyboards_helper_set_auto_repeat_mode (XfceKeyboardsHelper *helper)
     gboolean         repeat;
 
     /* load setting */
-    repeat = xfconf_channel_get_bool (helper->channel, "/Default/KeyRepeat", TRUE);
+    repeat = xfsettings_snapshot_get_bool (helper->channel, "/Default/KeyRepeat", TRUE);
+
+    /* nothing to do if the server already has it */
+    if (helper->live != NULL
+        && ((helper->live->ctrls->enabled_ctrls & XkbRepeatKeysMask) != 0) == repeat)
+    {
+        xfsettings_xstats_elided (XFSD_HELPER_KEYBOARDS, "auto-repeat");
+        xfsettings_dbg (XFSD_DEBUG_KEYBOARDS, "auto repeat already %s", repeat ? "on" : "off");
+        return;
+    }
 
     /* set key repeat */
     values.auto_repeat_mode = repeat ? 1 : 0;
 
-    gdk_x11_display_error_trap_push (gdk_display_get_default ());
+    xfsettings_xtrap_begin (XFSD_HELPER_KEYBOARDS, "auto-repeat");
+    xfsettings_xtrap_push ("change keyboard repeat mode");
     XChangeKeyboardControl (GDK_DISPLAY_XDISPLAY(gdk_display_get_default()), KBAutoRepeatMode, &values);
-    if (gdk_x11_display_error_trap_pop (gdk_display_get_default ()) != 0)
-        g_critical ("Failed to change keyboard repeat mode");
+    xfsettings_xtrap_pop ();
+    xfsettings_xtrap_commit ();
 
     xfsettings_dbg (XFSD_DEBUG_KEYBOARDS, "set auto repeat %s", repeat ? "on" : "off");
 }
@@ -196,37 +224,52 @@ xfce_keyboards_helper_set_repeat_rate (XfceKeyboardsHelper *helper)
 {
     XkbDescPtr xkb;
     gint       delay, rate;
+    guint      interval;
 
     /* load settings */
-    delay = xfconf_channel_get_int (helper->channel, "/Default/KeyRepeat/Delay", 500);
-    rate = xfconf_channel_get_int (helper->channel, "/Default/KeyRepeat/Rate", 20);
+    delay = xfsettings_snapshot_get_int (helper->channel, "/Default/KeyRepeat/Delay", 500);
+    rate = xfsettings_snapshot_get_int (helper->channel, "/Default/KeyRepeat/Rate", 20);
+    interval = rate != 0 ? 1000 / rate : 0;
+
+    /* nothing to do if the server already has it */
+    if (helper->live != NULL
+        && helper->live->ctrls->repeat_delay == (guint) delay
+        && helper->live->ctrls->repeat_interval == interval)
+    {
+        xfsettings_xstats_elided (XFSD_HELPER_KEYBOARDS, "repeat-rate");
+        xfsettings_dbg (XFSD_DEBUG_KEYBOARDS, "key repeat already set (delay=%d, rate=%d)",
+                        delay, interval);
+        return;
+    }
 
-    gdk_x11_display_error_trap_push (gdk_display_get_default ());
+    xfsettings_xtrap_begin (XFSD_HELPER_KEYBOARDS, "repeat-rate");
 
-    /* allocate xkb structure */
+    /* allocate xkb structure, the server only reads the fields in the
+     * mask, so there is no need to fetch the current controls first */
     xkb = XkbAllocKeyboard ();
-    if (G_LIKELY (xkb))
+    if (G_LIKELY (xkb)
+        && XkbAllocControls (xkb, XkbRepeatKeysMask) == Success)
     {
-        /* load controls */
-        XkbGetControls (GDK_DISPLAY_XDISPLAY(gdk_display_get_default()), XkbRepeatKeysMask, xkb);
-
         /* set new values */
         xkb->ctrls->repeat_delay = delay;
-        xkb->ctrls->repeat_interval = rate != 0 ? 1000 / rate : 0;
+        xkb->ctrls->repeat_interval = interval;
 
         /* set updated controls */
+        xfsettings_xtrap_push ("change the keyboard repeat");
         XkbSetControls (GDK_DISPLAY_XDISPLAY(gdk_display_get_default()), XkbRepeatKeysMask, xkb);
+        xfsettings_xtrap_pop ();
 
         xfsettings_dbg (XFSD_DEBUG_KEYBOARDS, "set key repeat (delay=%d, rate=%d)",
                         xkb->ctrls->repeat_delay, xkb->ctrls->repeat_interval);
 
         /* cleanup */
         XkbFreeControls (xkb, XkbRepeatKeysMask, True);
-        XFree (xkb);
     }
 
-    if (gdk_x11_display_error_trap_pop (gdk_display_get_default ()) != 0)
-        g_critical ("Failed to change the keyboard repeat");
+    if (G_LIKELY (xkb))
+        XFree (xkb);
+
+    xfsettings_xtrap_commit ();
 }
 
 
@@ -242,40 +285,57 @@ xfce_keyboards_helper_channel_property_changed (XfconfChannel      *channel,
     if (strcmp (property_name, "/Default/KeyRepeat") == 0)
     {
         /* update auto repeat mode */
+        xfsettings_metrics_changed (XFSD_HELPER_KEYBOARDS, property_name);
+        xfsettings_trace (XFSD_HELPER_KEYBOARDS, XFSD_TRACE_APPLY_START, 0);
         xfce_keyboards_helper_set_auto_repeat_mode (helper);
+        xfsettings_metrics_applied (XFSD_HELPER_KEYBOARDS);
     }
     else if (strcmp (property_name, "/Default/KeyRepeat/Delay") == 0
              || strcmp (property_name, "/Default/KeyRepeat/Rate") == 0)
     {
         /* update repeat rate */
+        xfsettings_metrics_changed (XFSD_HELPER_KEYBOARDS, property_name);
+        xfsettings_trace (XFSD_HELPER_KEYBOARDS, XFSD_TRACE_APPLY_START, 0);
         xfce_keyboards_helper_set_repeat_rate (helper);
+        xfsettings_metrics_applied (XFSD_HELPER_KEYBOARDS);
     }
 }
 
 
 
 static void
-xfce_keyboards_helper_restore_numlock_state (XfconfChannel *channel)
+xfce_keyboards_helper_restore_numlock_state (XfceKeyboardsHelper *helper)
 {
     unsigned int  numlock_mask;
     Display      *dpy;
     gboolean      state;
 
-    if (xfconf_channel_has_property (channel, "/Default/Numlock")
-        && xfconf_channel_get_bool (channel, "/Default/RestoreNumlock", TRUE))
+    if (xfsettings_snapshot_has_property (helper->channel, "/Default/Numlock")
+        && xfsettings_snapshot_get_bool (helper->channel, "/Default/RestoreNumlock", TRUE))
     {
-        state = xfconf_channel_get_bool (channel, "/Default/Numlock", FALSE);
+        state = xfsettings_snapshot_get_bool (helper->channel, "/Default/Numlock", FALSE);
 
-        gdk_x11_display_error_trap_push (gdk_display_get_default ());
+        xfsettings_xtrap_begin (XFSD_HELPER_KEYBOARDS, "restore-numlock");
+        xfsettings_xtrap_push ("change numlock modifier");
 
         dpy = GDK_DISPLAY_XDISPLAY (gdk_display_get_default ());
         numlock_mask = XkbKeysymToModifiers (dpy, XK_Num_Lock);
-        XkbLockModifiers (dpy, XkbUseCoreKbd, numlock_mask, state ? numlock_mask : 0);
 
-        if (gdk_x11_display_error_trap_pop (gdk_display_get_default ()) != 0)
-            g_critical ("Failed to change numlock modifier");
+        /* nothing to do if the server already has it */
+        if (helper->live != NULL
+            && (helper->live_locked_mods & numlock_mask) == (state ? numlock_mask : 0))
+        {
+            xfsettings_xstats_elided (XFSD_HELPER_KEYBOARDS, "restore-numlock");
+            xfsettings_dbg (XFSD_DEBUG_KEYBOARDS, "numlock already %s", state ? "on" : "off");
+        }
+        else
+        {
+            XkbLockModifiers (dpy, XkbUseCoreKbd, numlock_mask, state ? numlock_mask : 0);
+            xfsettings_dbg (XFSD_DEBUG_KEYBOARDS, "set numlock %s", state ? "on" : "off");
+        }
 
-        xfsettings_dbg (XFSD_DEBUG_KEYBOARDS, "set numlock %s", state ? "on" : "off");
+        xfsettings_xtrap_pop ();
+        xfsettings_xtrap_commit ();
     }
     else
     {
@@ -288,17 +348,18 @@ xfce_keyboards_helper_restore_numlock_state (XfconfChannel *channel)
 static void
 xfce_keyboards_helper_save_numlock_state (XfconfChannel *channel)
 {
-    Display *dpy;
-    Bool     numlock_state;
-    Atom     numlock;
+    Display         *dpy;
+    Bool             numlock_state;
+    Atom             numlock;
+    XfsdXStatsScope  xstats;
 
-    gdk_x11_display_error_trap_push (gdk_display_get_default ());
+    xfsettings_xstats_trap_push (&xstats, XFSD_HELPER_KEYBOARDS, "save-numlock");
 
     dpy = GDK_DISPLAY_XDISPLAY (gdk_display_get_default ());
-    numlock = XInternAtom(dpy, "Num Lock", False);
+    numlock = xfsettings_atom (XFSD_ATOM_NUM_LOCK);
     XkbGetNamedIndicator (dpy, numlock, NULL, &numlock_state, NULL, NULL);
 
-    if (gdk_x11_display_error_trap_pop (gdk_display_get_default ()) != 0)
+    if (xfsettings_xstats_trap_pop (&xstats) != 0)
         g_critical ("Failed to get numlock state");
 
     xfsettings_dbg (XFSD_DEBUG_KEYBOARDS, "save numlock %s", numlock_state ? "on" : "off");
@@ -309,11 +370,48 @@ xfce_keyboards_helper_save_numlock_state (XfconfChannel *channel)
 
 
 static void
-xfce_keyboards_helper_set_all_settings (XfceKeyboardsHelper *helper)
+xfce_keyboards_helper_set_all_settings (XfceKeyboardsHelper *helper,
+                                        gboolean             force)
 {
+        Display     *xdisplay = GDK_DISPLAY_XDISPLAY (gdk_display_get_default ());
+        XkbStateRec  state;
+
+        /* sync once for all the settings */
+        xfsettings_xtrap_begin (XFSD_HELPER_KEYBOARDS, "apply-all");
+
+        /* read what the server has, so on a restart we don't push settings
+         * that are already active; a hotplugged keyboard starts with the
+         * server defaults and the core keyboard state says nothing about
+         * it, so everything is written when forced */
+        helper->live = force ? NULL : XkbAllocKeyboard ();
+        if (helper->live != NULL)
+        {
+            xfsettings_xtrap_push ("get the keyboard state");
+            if (XkbGetControls (xdisplay, XkbRepeatKeysMask | XkbControlsEnabledMask,
+                                helper->live) == Success
+                && XkbGetState (xdisplay, XkbUseCoreKbd, &state) == Success)
+            {
+                helper->live_locked_mods = state.locked_mods;
+            }
+            else
+            {
+                XkbFreeKeyboard (helper->live, XkbAllComponentsMask, True);
+                helper->live = NULL;
+            }
+            xfsettings_xtrap_pop ();
+        }
+
         xfce_keyboards_helper_set_auto_repeat_mode (helper);
         xfce_keyboards_helper_set_repeat_rate (helper);
-        xfce_keyboards_helper_restore_numlock_state (helper->channel);
+        xfce_keyboards_helper_restore_numlock_state (helper);
+
+        if (helper->live != NULL)
+        {
+            XkbFreeKeyboard (helper->live, XkbAllComponentsMask, True);
+            helper->live = NULL;
+        }
+
+        xfsettings_xtrap_commit ();
 }
 
 
@@ -329,7 +427,7 @@ xfce_keyboards_helper_device_is_keyboard (XID xid)
     gint         n, ndevices;
     Display     *xdisplay = GDK_DISPLAY_XDISPLAY(gdk_display_get_default());
 
-    keyboard_type = XInternAtom (xdisplay, XI_KEYBOARD, True);
+    keyboard_type = xfsettings_atoms_lookup (XI_KEYBOARD, TRUE);
     device_list = XListInputDevices(xdisplay, &ndevices);
     device_found = FALSE;
     for (n = 0; n < ndevices; n++)
@@ -371,7 +469,8 @@ xfce_keyboards_helper_event_filter (GdkXEvent *xevent,
         return GDK_FILTER_CONTINUE;
 
     /* New keyboard added. Need to reapply settings. */
-    xfce_keyboards_helper_set_all_settings (helper);
+    xfsettings_trace (XFSD_HELPER_KEYBOARDS, XFSD_TRACE_X_EVENT, event->type);
+    xfce_keyboards_helper_set_all_settings (helper, TRUE);
 
     return GDK_FILTER_CONTINUE;
 }
@@ -43,6 +43,7 @@
 #include <gdk/gdkx.h>
 #include <X11/X.h>
 #include <X11/Xlib.h>
+#include <X11/Xatom.h>
 #endif
 
 #include <xfconf/xfconf.h>
@@ -52,6 +53,14 @@
 #include <locale.h>
 
 #include "debug.h"
+#include "atoms.h"
+#include "metrics.h"
+#include "memory.h"
+#include "stall.h"
+#include "trace.h"
+#include "xfconf-snapshot.h"
+#include "xstats.h"
+#include "dispatcher.h"
 #include "accessibility.h"
 #include "pointers.h"
 #include "keyboards.h"
@@ -76,6 +85,7 @@
 static gboolean opt_version = FALSE;
 static gboolean opt_no_daemon = FALSE;
 static gboolean opt_replace = FALSE;
+static gboolean opt_quit_after_startup = FALSE;
 static guint owner_id;
 
 struct t_data_set
@@ -93,17 +103,266 @@ struct t_data_set
     GObject              *displays_helper;
 #endif
     GObject              *workspaces_helper;
+
+    /* staged startup of the helpers */
+    gint64                startup_time;
+    guint                 startup_stage;
+    guint                 startup_id;
+    guint                 workspaces_deferred : 1;
 };
 
+typedef gboolean (*HelperStartFunc) (struct t_data_set *s_data);
+
 
 static GOptionEntry option_entries[] =
 {
     { "version", 'V', 0, G_OPTION_ARG_NONE, &opt_version, N_("Version information"), NULL },
     { "no-daemon", 0, 0, G_OPTION_ARG_NONE, &opt_no_daemon, N_("Do not fork to the background"), NULL },
     { "replace", 0, 0, G_OPTION_ARG_NONE, &opt_replace, N_("Replace running xsettings daemon (if any)"), NULL },
+    { "quit-after-startup", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE, &opt_quit_after_startup, NULL, NULL },
     { NULL }
 };
 
+static gboolean
+start_displays (struct t_data_set *s_data)
+{
+#ifdef HAVE_XRANDR
+    s_data->displays_helper = g_object_new (XFCE_TYPE_DISPLAYS_HELPER, NULL);
+#endif
+    return TRUE;
+}
+
+static gboolean
+start_pointers (struct t_data_set *s_data)
+{
+    s_data->pointer_helper = g_object_new (XFCE_TYPE_POINTERS_HELPER, NULL);
+    return TRUE;
+}
+
+static gboolean
+start_keyboards (struct t_data_set *s_data)
+{
+    s_data->keyboards_helper = g_object_new (XFCE_TYPE_KEYBOARDS_HELPER, NULL);
+    return TRUE;
+}
+
+static gboolean
+start_accessibility (struct t_data_set *s_data)
+{
+    s_data->accessibility_helper = g_object_new (XFCE_TYPE_ACCESSIBILITY_HELPER, NULL);
+    return TRUE;
+}
+
+static gboolean
+start_shortcuts (struct t_data_set *s_data)
+{
+    s_data->shortcuts_helper = g_object_new (XFCE_TYPE_KEYBOARD_SHORTCUTS_HELPER, NULL);
+    return TRUE;
+}
+
+static gboolean
+start_keyboard_layout (struct t_data_set *s_data)
+{
+    s_data->keyboard_layout_helper = g_object_new (XFCE_TYPE_KEYBOARD_LAYOUT_HELPER, NULL);
+    return TRUE;
+}
+
+static gboolean
+start_gtk_decorations (struct t_data_set *s_data)
+{
+    s_data->gtk_decorations_helper = g_object_new (XFCE_TYPE_DECORATIONS_HELPER, NULL);
+    return TRUE;
+}
+
+static gboolean
+start_clipboard (struct t_data_set *s_data)
+{
+    if (g_getenv ("XFSETTINGSD_NO_CLIPBOARD") != NULL)
+        return FALSE;
+
+    s_data->clipboard_daemon = g_object_new (GSD_TYPE_CLIPBOARD_MANAGER, NULL);
+    if (!gsd_clipboard_manager_start (GSD_CLIPBOARD_MANAGER (s_data->clipboard_daemon), opt_replace))
+    {
+        UNREF_GOBJECT (G_OBJECT (s_data->clipboard_daemon));
+        s_data->clipboard_daemon = NULL;
+
+        g_printerr (G_LOG_DOMAIN ": %s\n", "Another clipboard manager is already running.");
+    }
+
+    return TRUE;
+}
+
+static void
+start_workspaces_real (struct t_data_set *s_data)
+{
+    gint64 start_time;
+
+    if (s_data->workspaces_helper != NULL)
+        return;
+
+    start_time = g_get_monotonic_time ();
+    s_data->workspaces_helper = g_object_new (XFCE_TYPE_WORKSPACES_HELPER, NULL);
+    xfsettings_metrics_startup (XFSD_HELPER_WORKSPACES,
+                                start_time - s_data->startup_time,
+                                g_get_monotonic_time () - start_time);
+}
+
+static void start_workspaces_cancel (struct t_data_set *s_data);
+
+static void
+start_workspaces_channel_changed (XfconfChannel     *channel,
+                                  const gchar       *property,
+                                  const GValue      *value,
+                                  struct t_data_set *s_data)
+{
+    /* other xfwm4 settings do not need the helper */
+    if (!g_str_has_prefix (property, "/general/workspace_"))
+        return;
+
+    start_workspaces_cancel (s_data);
+    start_workspaces_real (s_data);
+}
+
+static GdkFilterReturn
+start_workspaces_filter (GdkXEvent *gdkxevent,
+                         GdkEvent  *event,
+                         gpointer   data)
+{
+    struct t_data_set *s_data = data;
+    XEvent            *xevent = gdkxevent;
+
+    if (xevent->type == PropertyNotify
+        && xevent->xproperty.atom == xfsettings_atom (XFSD_ATOM_NET_NUMBER_OF_DESKTOPS))
+    {
+        /* a window manager started */
+        start_workspaces_cancel (s_data);
+        start_workspaces_real (s_data);
+    }
+
+    return GDK_FILTER_CONTINUE;
+}
+
+/* stop waiting for workspace names or a window manager */
+static void
+start_workspaces_cancel (struct t_data_set *s_data)
+{
+    if (!s_data->workspaces_deferred)
+        return;
+
+    xfsettings_dispatcher_remove (start_workspaces_filter, s_data);
+    g_signal_handlers_disconnect_by_func (G_OBJECT (xfconf_channel_get ("xfwm4")),
+        G_CALLBACK (start_workspaces_channel_changed), s_data);
+
+    s_data->workspaces_deferred = FALSE;
+}
+
+static gboolean
+start_workspaces (struct t_data_set *s_data)
+{
+    GdkWindow *root_window;
+    Display   *xdisplay;
+    Atom       type;
+    gint       format;
+    gulong     nitems, bytes_after;
+    guchar    *data = NULL;
+    gboolean   has_wm;
+
+    /* nothing to do without workspace names or a window manager,
+     * start as soon as one of them shows up */
+    if (!xfsettings_snapshot_has_property (xfsettings_snapshot_channel ("xfwm4"), "/general/workspace_names"))
+    {
+        root_window = gdk_get_default_root_window ();
+        xdisplay = GDK_WINDOW_XDISPLAY (root_window);
+
+        gdk_x11_display_error_trap_push (gdk_display_get_default ());
+        has_wm = XGetWindowProperty (xdisplay, GDK_WINDOW_XID (root_window),
+                                     xfsettings_atom (XFSD_ATOM_NET_NUMBER_OF_DESKTOPS),
+                                     0, 1, False, XA_CARDINAL, &type, &format,
+                                     &nitems, &bytes_after, &data) == Success
+                 && type == XA_CARDINAL;
+        gdk_x11_display_error_trap_pop_ignored (gdk_display_get_default ());
+
+        if (data != NULL)
+            XFree (data);
+
+        if (!has_wm)
+        {
+            xfsettings_dbg (XFSD_DEBUG_WORKSPACES, "no workspace names and window manager, deferred");
+
+            gdk_window_set_events (root_window, gdk_window_get_events (root_window)
+                                   | GDK_PROPERTY_CHANGE_MASK);
+            xfsettings_dispatcher_add_root_property (xfsettings_atom (XFSD_ATOM_NET_NUMBER_OF_DESKTOPS),
+                                                     start_workspaces_filter, s_data);
+            g_signal_connect (G_OBJECT (xfconf_channel_get ("xfwm4")), "property-changed",
+                              G_CALLBACK (start_workspaces_channel_changed), s_data);
+            s_data->workspaces_deferred = TRUE;
+
+            return FALSE;
+        }
+    }
+
+    s_data->workspaces_helper = g_object_new (XFCE_TYPE_WORKSPACES_HELPER, NULL);
+
+    return TRUE;
+}
+
+/* helpers started after the xsettings helper, one per main loop
+ * iteration, so events are handled while the daemon starts */
+static const struct
+{
+    XfsdHelper      helper;
+    HelperStartFunc start;
+}
+helper_stages[] =
+{
+    { XFSD_HELPER_DISPLAYS, start_displays },
+    { XFSD_HELPER_POINTERS, start_pointers },
+    { XFSD_HELPER_KEYBOARDS, start_keyboards },
+    { XFSD_HELPER_ACCESSIBILITY, start_accessibility },
+    { XFSD_HELPER_KEYBOARD_SHORTCUTS, start_shortcuts },
+    { XFSD_HELPER_KEYBOARD_LAYOUT, start_keyboard_layout },
+    { XFSD_HELPER_WORKSPACES, start_workspaces },
+    { XFSD_HELPER_GTK_DECORATIONS, start_gtk_decorations },
+    { XFSD_HELPER_CLIPBOARD, start_clipboard }
+};
+
+static gboolean
+startup_stage (gpointer user_data)
+{
+    struct t_data_set *s_data = user_data;
+    gint64             start_time;
+    guint              n = s_data->startup_stage++;
+
+    if (n >= G_N_ELEMENTS (helper_stages))
+    {
+        xfsettings_dbg (XFSD_DEBUG_STARTUP, "startup done in %.1f ms",
+                        (g_get_monotonic_time () - s_data->startup_time) / 1000.0);
+
+        s_data->startup_id = 0;
+
+        /* for timing the startup from a script, e.g. under Xvfb */
+        if (G_UNLIKELY (opt_quit_after_startup))
+        {
+            g_printerr (G_LOG_DOMAIN ": startup done in %.1f ms\n",
+                        (g_get_monotonic_time () - s_data->startup_time) / 1000.0);
+            xfsettings_xstats_dump ();
+            gtk_main_quit ();
+        }
+
+        return FALSE;
+    }
+
+    start_time = g_get_monotonic_time ();
+    if (helper_stages[n].start (s_data))
+    {
+        xfsettings_metrics_startup (helper_stages[n].helper,
+                                    start_time - s_data->startup_time,
+                                    g_get_monotonic_time () - start_time);
+    }
+
+    return TRUE;
+}
+
 static void
 on_name_lost (GDBusConnection *connection,
               const gchar     *name,
@@ -122,8 +381,10 @@ on_name_acquired (GDBusConnection *connection,
     GBusNameOwnerFlags         dbus_flags;
     struct t_data_set         *s_data;
     GError                    *error = NULL;
+    gint64                     start_time;
 
     s_data = (struct t_data_set*) user_data;
+    s_data->startup_time = g_get_monotonic_time ();
 
     /* connect to session always, even if we quit below.  this way the
      * session manager won't wait for us to time out. */
@@ -138,34 +399,22 @@ on_name_acquired (GDBusConnection *connection,
         g_clear_error (&error);
     }
 
-    /* launch settings manager */
+    /* launch settings manager first, so clients get their theme as
+     * soon as possible */
+    start_time = g_get_monotonic_time ();
     s_data->xsettings_helper = g_object_new (XFCE_TYPE_XSETTINGS_HELPER, NULL);
     xfce_xsettings_helper_register (XFCE_XSETTINGS_HELPER (s_data->xsettings_helper),
                                     gdk_display_get_default (), opt_replace);
+    gdk_display_flush (gdk_display_get_default ());
+    xfsettings_metrics_startup (XFSD_HELPER_XSETTINGS,
+                                start_time - s_data->startup_time,
+                                g_get_monotonic_time () - start_time);
 
-    /* create the sub daemons */
-#ifdef HAVE_XRANDR
-    s_data->displays_helper = g_object_new (XFCE_TYPE_DISPLAYS_HELPER, NULL);
-#endif
-    s_data->pointer_helper = g_object_new (XFCE_TYPE_POINTERS_HELPER, NULL);
-    s_data->keyboards_helper = g_object_new (XFCE_TYPE_KEYBOARDS_HELPER, NULL);
-    s_data->accessibility_helper = g_object_new (XFCE_TYPE_ACCESSIBILITY_HELPER, NULL);
-    s_data->shortcuts_helper = g_object_new (XFCE_TYPE_KEYBOARD_SHORTCUTS_HELPER, NULL);
-    s_data->keyboard_layout_helper = g_object_new (XFCE_TYPE_KEYBOARD_LAYOUT_HELPER, NULL);
-    s_data->workspaces_helper = g_object_new (XFCE_TYPE_WORKSPACES_HELPER, NULL);
-    s_data->gtk_decorations_helper = g_object_new (XFCE_TYPE_DECORATIONS_HELPER, NULL);
-
-    if (g_getenv ("XFSETTINGSD_NO_CLIPBOARD") == NULL)
-    {
-        s_data->clipboard_daemon = g_object_new (GSD_TYPE_CLIPBOARD_MANAGER, NULL);
-        if (!gsd_clipboard_manager_start (GSD_CLIPBOARD_MANAGER (s_data->clipboard_daemon), opt_replace))
-        {
-            UNREF_GOBJECT (G_OBJECT (s_data->clipboard_daemon));
-            s_data->clipboard_daemon = NULL;
+    /* create the sub daemons from the main loop */
+    s_data->startup_id = g_idle_add (startup_stage, s_data);
 
-            g_printerr (G_LOG_DOMAIN ": %s\n", "Another clipboard manager is already running.");
-        }
-    }
+    /* read-only settings propagation metrics */
+    xfsettings_metrics_export (connection);
 
     /* Update the name flags to allow replacement */
     dbus_flags = G_BUS_NAME_OWNER_FLAGS_ALLOW_REPLACEMENT;
@@ -180,6 +429,17 @@ signal_handler (gint signum,
     gtk_main_quit ();
 }
 
+static void
+signal_handler_trace (gint signum,
+                      gpointer user_data)
+{
+    /* write the event trace, X round trips, stalls and memory to stderr */
+    xfsettings_trace_dump ();
+    xfsettings_xstats_dump ();
+    xfsettings_stall_dump ();
+    xfsettings_memory_dump ();
+}
+
 static gint
 daemonize (void)
 {
@@ -286,6 +546,12 @@ main (gint argc, gchar **argv)
 
     setlocale(LC_NUMERIC,"C");
 
+    /* intern the atoms of all helpers at once */
+    xfsettings_atoms_init (GDK_DISPLAY_XDISPLAY (gdk_display_get_default ()));
+
+    /* watch the main loop for helpers blocking it */
+    xfsettings_stall_init ();
+
     /* Initialize our data set */
     memset (&s_data, 0, sizeof (struct t_data_set));
 
@@ -349,6 +615,8 @@ main (gint argc, gchar **argv)
     {
         for (i = 0; i < G_N_ELEMENTS (signums); i++)
             xfce_posix_signal_handler_set_handler (signums[i], signal_handler, NULL, NULL);
+
+        xfce_posix_signal_handler_set_handler (SIGUSR1, signal_handler_trace, NULL, NULL);
     }
 
     gtk_main();
@@ -356,10 +624,17 @@ main (gint argc, gchar **argv)
     /* release the dbus name */
     if (dbus_connection != NULL)
     {
+        xfsettings_metrics_unexport ();
         g_bus_unown_name (owner_id);
         g_dbus_connection_close_sync (dbus_connection, NULL, NULL);
     }
 
+    /* stop a startup that is still running */
+    if (s_data.startup_id != 0)
+        g_source_remove (s_data.startup_id);
+
+    start_workspaces_cancel (&s_data);
+
     /* release the sub daemons */
     UNREF_GOBJECT(s_data.xsettings_helper);
 
@@ -380,6 +655,9 @@ main (gint argc, gchar **argv)
         UNREF_GOBJECT (s_data.clipboard_daemon);
     }
 
+    xfsettings_stall_shutdown ();
+    xfsettings_snapshot_shutdown ();
+    xfsettings_atoms_shutdown ();
     xfconf_shutdown ();
 
     UNREF_GOBJECT (s_data.sm_client);
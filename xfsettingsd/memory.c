@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Memory accounting of the helpers. A helper registers a function that
+ * adds the live size of its data structures by category to a report;
+ * the functions only run when a report is requested, so there is no
+ * bookkeeping on the allocation paths. The sizes are estimates from the
+ * structure sizes and the payload lengths, allocator overhead is not
+ * counted.
+ *
+ * The report is written to stderr on SIGUSR1 and is available with the
+ * GetMemory method of the metrics interface.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "memory.h"
+#include "metrics.h"
+
+
+
+typedef struct _XfsdMemoryProvider XfsdMemoryProvider;
+typedef struct _XfsdMemoryEntry    XfsdMemoryEntry;
+
+
+
+struct _XfsdMemoryProvider
+{
+    XfsdHelper      helper;
+    XfsdMemoryFunc  func;
+    gpointer        user_data;
+};
+
+struct _XfsdMemoryEntry
+{
+    XfsdHelper   helper;
+    const gchar *category;
+    guint64      n_objects;
+    guint64      n_bytes;
+};
+
+struct _XfsdMemoryReport
+{
+    /* helper of the provider that is running */
+    XfsdHelper  helper;
+
+    /* array of XfsdMemoryEntry */
+    GArray     *entries;
+};
+
+/* list of XfsdMemoryProvider */
+static GSList *memory_providers = NULL;
+
+
+
+static XfsdMemoryReport *
+xfsettings_memory_report_new (void)
+{
+    XfsdMemoryReport   *report;
+    XfsdMemoryProvider *provider;
+    GSList             *li;
+
+    report = g_slice_new (XfsdMemoryReport);
+    report->entries = g_array_new (FALSE, FALSE, sizeof (XfsdMemoryEntry));
+
+    for (li = memory_providers; li != NULL; li = li->next)
+    {
+        provider = li->data;
+        report->helper = provider->helper;
+        provider->func (report, provider->user_data);
+    }
+
+    return report;
+}
+
+
+
+static void
+xfsettings_memory_report_free (XfsdMemoryReport *report)
+{
+    g_array_free (report->entries, TRUE);
+    g_slice_free (XfsdMemoryReport, report);
+}
+
+
+
+void
+xfsettings_memory_register (XfsdHelper     helper,
+                            XfsdMemoryFunc func,
+                            gpointer       user_data)
+{
+    XfsdMemoryProvider *provider;
+
+    g_return_if_fail (helper < XFSD_N_HELPERS);
+    g_return_if_fail (func != NULL);
+
+    provider = g_slice_new (XfsdMemoryProvider);
+    provider->helper = helper;
+    provider->func = func;
+    provider->user_data = user_data;
+
+    /* keep the report in the order of the helpers */
+    memory_providers = g_slist_append (memory_providers, provider);
+}
+
+
+
+void
+xfsettings_memory_unregister (XfsdMemoryFunc func,
+                              gpointer       user_data)
+{
+    XfsdMemoryProvider *provider;
+    GSList             *li;
+
+    for (li = memory_providers; li != NULL; li = li->next)
+    {
+        provider = li->data;
+        if (provider->func == func && provider->user_data == user_data)
+        {
+            memory_providers = g_slist_delete_link (memory_providers, li);
+            g_slice_free (XfsdMemoryProvider, provider);
+
+            return;
+        }
+    }
+}
+
+
+
+void
+xfsettings_memory_add (XfsdMemoryReport *report,
+                       const gchar      *category,
+                       gsize             n_objects,
+                       gsize             n_bytes)
+{
+    XfsdMemoryEntry *entry;
+    XfsdMemoryEntry  new_entry;
+    guint            i;
+
+    g_return_if_fail (report != NULL);
+    g_return_if_fail (category != NULL);
+
+    /* merge categories reported more than once, like per screen data;
+     * the category is a static string so comparing pointers is fine */
+    for (i = 0; i < report->entries->len; i++)
+    {
+        entry = &g_array_index (report->entries, XfsdMemoryEntry, i);
+        if (entry->helper == report->helper && entry->category == category)
+        {
+            entry->n_objects += n_objects;
+            entry->n_bytes += n_bytes;
+
+            return;
+        }
+    }
+
+    new_entry.helper = report->helper;
+    new_entry.category = category;
+    new_entry.n_objects = n_objects;
+    new_entry.n_bytes = n_bytes;
+    g_array_append_val (report->entries, new_entry);
+}
+
+
+
+gsize
+xfsettings_memory_hash_table_size (GHashTable *table)
+{
+    guint size;
+
+    if (table == NULL)
+        return 0;
+
+    /* the table keeps its arrays of keys, values and hashes at a power
+     * of two size with a load of at most 3/4 */
+    size = g_hash_table_size (table);
+    size = g_bit_storage (MAX (size * 4 / 3, 8) - 1);
+
+    return (2 * sizeof (gpointer) + sizeof (guint)) << size;
+}
+
+
+
+GVariant *
+xfsettings_memory_collect (void)
+{
+    XfsdMemoryReport *report;
+    XfsdMemoryEntry  *entry;
+    GVariantBuilder   builder;
+    guint             i;
+
+    report = xfsettings_memory_report_new ();
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sstt)"));
+    for (i = 0; i < report->entries->len; i++)
+    {
+        entry = &g_array_index (report->entries, XfsdMemoryEntry, i);
+        g_variant_builder_add (&builder, "(sstt)",
+                               xfsettings_metrics_helper_name (entry->helper),
+                               entry->category, entry->n_objects, entry->n_bytes);
+    }
+
+    xfsettings_memory_report_free (report);
+
+    return g_variant_builder_end (&builder);
+}
+
+
+
+void
+xfsettings_memory_dump (void)
+{
+    XfsdMemoryReport *report;
+    XfsdMemoryEntry  *entry;
+    guint64           n_bytes = 0;
+    guint             i;
+
+    report = xfsettings_memory_report_new ();
+
+    for (i = 0; i < report->entries->len; i++)
+        n_bytes += g_array_index (report->entries, XfsdMemoryEntry, i).n_bytes;
+
+    g_printerr (PACKAGE_NAME ": %" G_GUINT64_FORMAT " bytes in helper data\n", n_bytes);
+
+    for (i = 0; i < report->entries->len; i++)
+    {
+        entry = &g_array_index (report->entries, XfsdMemoryEntry, i);
+        g_printerr ("  %-18s %-20s %8" G_GUINT64_FORMAT " objects %10"
+                    G_GUINT64_FORMAT " bytes\n",
+                    xfsettings_metrics_helper_name (entry->helper),
+                    entry->category, entry->n_objects, entry->n_bytes);
+    }
+
+    xfsettings_memory_report_free (report);
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __MEMORY_H__
+#define __MEMORY_H__
+
+#include <glib.h>
+
+#include "metrics.h"
+
+typedef struct _XfsdMemoryReport XfsdMemoryReport;
+
+typedef void (*XfsdMemoryFunc) (XfsdMemoryReport *report,
+                                gpointer          user_data);
+
+void      xfsettings_memory_register        (XfsdHelper        helper,
+                                             XfsdMemoryFunc    func,
+                                             gpointer          user_data);
+
+void      xfsettings_memory_unregister      (XfsdMemoryFunc    func,
+                                             gpointer          user_data);
+
+void      xfsettings_memory_add             (XfsdMemoryReport *report,
+                                             const gchar      *category,
+                                             gsize             n_objects,
+                                             gsize             n_bytes);
+
+gsize     xfsettings_memory_hash_table_size (GHashTable       *table);
+
+GVariant *xfsettings_memory_collect         (void);
+
+void      xfsettings_memory_dump            (void);
+
+#endif /* !__MEMORY_H__ */
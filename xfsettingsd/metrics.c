@@ -0,0 +1,416 @@
+/*
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Settings propagation metrics. Each helper reports when it received an
+ * xfconf change and when the resulting change was sent to the X server;
+ * the time between the first pending change and the X side effect is
+ * recorded in a histogram per helper. A change handler that returns
+ * without touching the X server discards the pending change, so it is
+ * not charged to the next unrelated apply. The numbers are available on the
+ * session bus under the daemon's name:
+ *
+ *   gdbus call --session --dest org.xfce.SettingsDaemon \
+ *              --object-path /org/xfce/SettingsDaemon \
+ *              --method org.xfce.SettingsDaemon.Metrics.GetHelperMetrics
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "metrics.h"
+#include "memory.h"
+#include "stall.h"
+#include "trace.h"
+#include "xstats.h"
+#include "debug.h"
+
+#define METRICS_OBJECT_PATH "/org/xfce/SettingsDaemon"
+#define METRICS_INTERFACE   "org.xfce.SettingsDaemon.Metrics"
+
+
+
+typedef struct _XfsdHelperMetrics XfsdHelperMetrics;
+
+
+
+/* upper bounds of the latency buckets in microseconds, the
+ * last bucket holds everything above the last bound */
+static const guint64 metrics_buckets[] =
+{
+    1000, 2000, 5000, 10000, 20000, 50000,
+    100000, 200000, 500000, 1000000, 2000000
+};
+
+#define N_BUCKETS (G_N_ELEMENTS (metrics_buckets) + 1)
+
+struct _XfsdHelperMetrics
+{
+    /* number of xfconf changes received */
+    guint64 n_changes;
+
+    /* number of times the result was sent to the X server */
+    guint64 n_applied;
+
+    /* number of pending changes that were never sent */
+    guint64 n_discarded;
+
+    /* monotonic time of the first change not applied yet, 0 if none */
+    gint64  pending_since;
+
+    /* latency of the applied changes */
+    guint64 n_samples;
+    guint64 total_us;
+    guint64 max_us;
+    guint64 histogram[N_BUCKETS];
+
+    /* startup of the helper relative to the daemon start, in usec */
+    gint64  startup_offset;
+    gint64  startup_duration;
+    guint   started : 1;
+};
+
+static const gchar *helper_names[] =
+{
+    "xsettings",
+    "displays",
+    "pointers",
+    "keyboards",
+    "accessibility",
+    "keyboard-shortcuts",
+    "keyboard-layout",
+    "workspaces",
+    "gtk-decorations",
+    "clipboard"
+};
+
+G_STATIC_ASSERT (G_N_ELEMENTS (helper_names) == XFSD_N_HELPERS);
+
+static XfsdHelperMetrics  metrics[XFSD_N_HELPERS];
+static GDBusConnection   *metrics_connection = NULL;
+static guint              metrics_registration_id = 0;
+
+static const gchar metrics_introspection_xml[] =
+  "<node>"
+  "  <interface name='" METRICS_INTERFACE "'>"
+  "    <method name='GetHelperMetrics'>"
+  "      <arg type='a{sa{sv}}' name='metrics' direction='out'/>"
+  "    </method>"
+  "    <method name='GetHistogramBuckets'>"
+  "      <arg type='at' name='upper_bounds_usec' direction='out'/>"
+  "    </method>"
+  "    <method name='GetStartupReport'>"
+  "      <arg type='a(sxx)' name='helpers' direction='out'/>"
+  "    </method>"
+  "    <method name='DumpTrace'>"
+  "      <arg type='a(xsss)' name='events' direction='out'/>"
+  "    </method>"
+  "    <method name='GetXStats'>"
+  "      <arg type='a(ssttttt)' name='paths' direction='out'/>"
+  "    </method>"
+  "    <method name='GetMemory'>"
+  "      <arg type='a(sstt)' name='categories' direction='out'/>"
+  "    </method>"
+  "    <method name='GetStalls'>"
+  "      <arg type='a(stx)' name='helpers' direction='out'/>"
+  "      <arg type='a(xxss)' name='stalls' direction='out'/>"
+  "    </method>"
+  "  </interface>"
+  "</node>";
+
+
+
+const gchar *
+xfsettings_metrics_helper_name (XfsdHelper helper)
+{
+    g_return_val_if_fail (helper < XFSD_N_HELPERS, NULL);
+
+    return helper_names[helper];
+}
+
+
+
+void
+xfsettings_metrics_changed (XfsdHelper   helper,
+                            const gchar *property)
+{
+    XfsdHelperMetrics *m;
+
+    g_return_if_fail (helper < XFSD_N_HELPERS);
+
+    xfsettings_trace_property (helper, property);
+
+    m = &metrics[helper];
+    m->n_changes++;
+
+    /* coalesced changes are measured from the first one */
+    if (m->pending_since == 0)
+        m->pending_since = g_get_monotonic_time ();
+}
+
+
+
+void
+xfsettings_metrics_applied (XfsdHelper helper)
+{
+    XfsdHelperMetrics *m;
+    guint64            latency;
+    guint              i;
+
+    g_return_if_fail (helper < XFSD_N_HELPERS);
+
+    m = &metrics[helper];
+    m->n_applied++;
+
+    /* not caused by an xfconf change, e.g. a device hotplug */
+    if (m->pending_since == 0)
+    {
+        xfsettings_trace (helper, XFSD_TRACE_APPLY_END, 0);
+        return;
+    }
+
+    latency = g_get_monotonic_time () - m->pending_since;
+    m->pending_since = 0;
+
+    xfsettings_trace (helper, XFSD_TRACE_APPLY_END, MIN (latency, G_MAXUINT32));
+
+    m->n_samples++;
+    m->total_us += latency;
+    m->max_us = MAX (m->max_us, latency);
+
+    for (i = 0; i < G_N_ELEMENTS (metrics_buckets); i++)
+        if (latency <= metrics_buckets[i])
+            break;
+    m->histogram[i]++;
+}
+
+
+
+void
+xfsettings_metrics_discard (XfsdHelper helper)
+{
+    XfsdHelperMetrics *m;
+
+    g_return_if_fail (helper < XFSD_N_HELPERS);
+
+    m = &metrics[helper];
+    if (m->pending_since == 0)
+        return;
+
+    m->pending_since = 0;
+    m->n_discarded++;
+}
+
+
+
+void
+xfsettings_metrics_startup (XfsdHelper helper,
+                            gint64     offset,
+                            gint64     duration)
+{
+    g_return_if_fail (helper < XFSD_N_HELPERS);
+
+    metrics[helper].startup_offset = offset;
+    metrics[helper].startup_duration = duration;
+    metrics[helper].started = TRUE;
+
+    xfsettings_dbg (XFSD_DEBUG_STARTUP, "%s started at %.1f ms in %.1f ms",
+                    helper_names[helper], offset / 1000.0, duration / 1000.0);
+}
+
+
+
+static GVariant *
+xfsettings_metrics_get_startup_report (void)
+{
+    GVariantBuilder builder;
+    guint           n;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sxx)"));
+
+    for (n = 0; n < XFSD_N_HELPERS; n++)
+    {
+        if (!metrics[n].started)
+            continue;
+
+        g_variant_builder_add (&builder, "(sxx)", helper_names[n],
+                               metrics[n].startup_offset,
+                               metrics[n].startup_duration);
+    }
+
+    return g_variant_builder_end (&builder);
+}
+
+
+
+static GVariant *
+xfsettings_metrics_get_helper_metrics (void)
+{
+    GVariantBuilder    builder;
+    GVariantBuilder    dict;
+    XfsdHelperMetrics *m;
+    guint              n;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{sv}}"));
+
+    for (n = 0; n < XFSD_N_HELPERS; n++)
+    {
+        m = &metrics[n];
+
+        g_variant_builder_init (&dict, G_VARIANT_TYPE_VARDICT);
+        g_variant_builder_add (&dict, "{sv}", "changes",
+                               g_variant_new_uint64 (m->n_changes));
+        g_variant_builder_add (&dict, "{sv}", "applied",
+                               g_variant_new_uint64 (m->n_applied));
+        g_variant_builder_add (&dict, "{sv}", "discarded",
+                               g_variant_new_uint64 (m->n_discarded));
+        g_variant_builder_add (&dict, "{sv}", "samples",
+                               g_variant_new_uint64 (m->n_samples));
+        g_variant_builder_add (&dict, "{sv}", "latency-total-usec",
+                               g_variant_new_uint64 (m->total_us));
+        g_variant_builder_add (&dict, "{sv}", "latency-max-usec",
+                               g_variant_new_uint64 (m->max_us));
+        g_variant_builder_add (&dict, "{sv}", "latency-histogram",
+                               g_variant_new_fixed_array (G_VARIANT_TYPE_UINT64,
+                                                          m->histogram, N_BUCKETS,
+                                                          sizeof (guint64)));
+
+        g_variant_builder_add (&builder, "{sa{sv}}", helper_names[n], &dict);
+    }
+
+    return g_variant_builder_end (&builder);
+}
+
+
+
+static void
+xfsettings_metrics_method_call (GDBusConnection       *connection,
+                                const gchar           *sender,
+                                const gchar           *object_path,
+                                const gchar           *interface_name,
+                                const gchar           *method_name,
+                                GVariant              *parameters,
+                                GDBusMethodInvocation *invocation,
+                                gpointer               user_data)
+{
+    if (g_strcmp0 (method_name, "GetHelperMetrics") == 0)
+    {
+        g_dbus_method_invocation_return_value (invocation,
+            g_variant_new ("(@a{sa{sv}})", xfsettings_metrics_get_helper_metrics ()));
+    }
+    else if (g_strcmp0 (method_name, "GetHistogramBuckets") == 0)
+    {
+        g_dbus_method_invocation_return_value (invocation,
+            g_variant_new ("(@at)",
+                           g_variant_new_fixed_array (G_VARIANT_TYPE_UINT64,
+                                                      metrics_buckets,
+                                                      G_N_ELEMENTS (metrics_buckets),
+                                                      sizeof (guint64))));
+    }
+    else if (g_strcmp0 (method_name, "GetStartupReport") == 0)
+    {
+        g_dbus_method_invocation_return_value (invocation,
+            g_variant_new ("(@a(sxx))", xfsettings_metrics_get_startup_report ()));
+    }
+    else if (g_strcmp0 (method_name, "DumpTrace") == 0)
+    {
+        g_dbus_method_invocation_return_value (invocation,
+            g_variant_new ("(@a(xsss))", xfsettings_trace_collect ()));
+    }
+    else if (g_strcmp0 (method_name, "GetXStats") == 0)
+    {
+        g_dbus_method_invocation_return_value (invocation,
+            g_variant_new ("(@a(ssttttt))", xfsettings_xstats_collect ()));
+    }
+    else if (g_strcmp0 (method_name, "GetMemory") == 0)
+    {
+        g_dbus_method_invocation_return_value (invocation,
+            g_variant_new ("(@a(sstt))", xfsettings_memory_collect ()));
+    }
+    else if (g_strcmp0 (method_name, "GetStalls") == 0)
+    {
+        g_dbus_method_invocation_return_value (invocation,
+                                               xfsettings_stall_collect ());
+    }
+    else
+    {
+        g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                                               G_DBUS_ERROR_UNKNOWN_METHOD,
+                                               "Unknown method %s", method_name);
+    }
+}
+
+
+
+static const GDBusInterfaceVTable metrics_vtable =
+{
+    xfsettings_metrics_method_call,
+    NULL,
+    NULL
+};
+
+
+
+void
+xfsettings_metrics_export (GDBusConnection *connection)
+{
+    GDBusNodeInfo *info;
+    GError        *error = NULL;
+
+    g_return_if_fail (G_IS_DBUS_CONNECTION (connection));
+
+    if (metrics_registration_id != 0)
+        return;
+
+    info = g_dbus_node_info_new_for_xml (metrics_introspection_xml, NULL);
+    g_assert (info != NULL);
+
+    metrics_registration_id =
+        g_dbus_connection_register_object (connection, METRICS_OBJECT_PATH,
+                                           info->interfaces[0], &metrics_vtable,
+                                           NULL, NULL, &error);
+    g_dbus_node_info_unref (info);
+
+    if (metrics_registration_id == 0)
+    {
+        g_warning ("Failed to export the metrics interface: %s", error->message);
+        g_error_free (error);
+        return;
+    }
+
+    metrics_connection = g_object_ref (connection);
+}
+
+
+
+void
+xfsettings_metrics_unexport (void)
+{
+    if (metrics_registration_id == 0)
+        return;
+
+    g_dbus_connection_unregister_object (metrics_connection, metrics_registration_id);
+    g_object_unref (metrics_connection);
+
+    metrics_connection = NULL;
+    metrics_registration_id = 0;
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <gio/gio.h>
+
+typedef enum
+{
+    XFSD_HELPER_XSETTINGS,
+    XFSD_HELPER_DISPLAYS,
+    XFSD_HELPER_POINTERS,
+    XFSD_HELPER_KEYBOARDS,
+    XFSD_HELPER_ACCESSIBILITY,
+    XFSD_HELPER_KEYBOARD_SHORTCUTS,
+    XFSD_HELPER_KEYBOARD_LAYOUT,
+    XFSD_HELPER_WORKSPACES,
+    XFSD_HELPER_GTK_DECORATIONS,
+    XFSD_HELPER_CLIPBOARD,
+
+    XFSD_N_HELPERS
+}
+XfsdHelper;
+
+const gchar *xfsettings_metrics_helper_name (XfsdHelper       helper);
+
+void         xfsettings_metrics_changed     (XfsdHelper       helper,
+                                             const gchar     *property);
+
+void         xfsettings_metrics_applied     (XfsdHelper       helper);
+
+void         xfsettings_metrics_discard     (XfsdHelper       helper);
+
+void         xfsettings_metrics_startup     (XfsdHelper       helper,
+                                             gint64           offset,
+                                             gint64           duration);
+
+void         xfsettings_metrics_export      (GDBusConnection *connection);
+
+void         xfsettings_metrics_unexport    (void);
+
+#endif /* !__METRICS_H__ */
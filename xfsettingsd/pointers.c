@@ -42,17 +42,18 @@
 #include <locale.h>
 
 #include "debug.h"
+#include "atoms.h"
+#include "metrics.h"
+#include "trace.h"
+#include "xfconf-snapshot.h"
+#include "xstats.h"
+#include "xtrap.h"
+#include "dispatcher.h"
 #include "pointers.h"
 #include "pointers-defines.h"
 
 #define MAX_DENOMINATOR (100.00)
 
-#ifdef XI_PROP_ENABLED
-#define DEVICE_ENABLED XI_PROP_ENABLED
-#else
-#define DEVICE_ENABLED "Device Enabled"
-#endif /* XI_PROP_ENABLED */
-
 static void             xfce_pointers_helper_finalize                 (GObject            *object);
 static void             xfce_pointers_helper_syndaemon_stop           (XfcePointersHelper *helper);
 static void             xfce_pointers_helper_syndaemon_check          (XfcePointersHelper *helper);
@@ -131,6 +132,7 @@ xfce_pointers_helper_init (XfcePointersHelper *helper)
     Display           *xdisplay;
 #ifdef DEVICE_HOTPLUGGING
     XEventClass        event_class;
+    XfsdXStatsScope    xstats;
 #endif
 
     /* get the default display */
@@ -159,7 +161,7 @@ xfce_pointers_helper_init (XfcePointersHelper *helper)
                         version->major_version, version->minor_version);
 
         /* open the channel */
-        helper->channel = xfconf_channel_get ("pointers");
+        helper->channel = xfsettings_snapshot_channel ("pointers");
 
         /* restore the pointer devices */
         xfce_pointers_helper_restore_devices (helper, NULL);
@@ -175,13 +177,13 @@ xfce_pointers_helper_init (XfcePointersHelper *helper)
         if (G_LIKELY (xdisplay != NULL))
         {
             /* monitor device changes */
-            gdk_x11_display_error_trap_push (gdk_display_get_default ());
+            xfsettings_xstats_trap_push (&xstats, XFSD_HELPER_POINTERS, "select-events");
             DevicePresence (xdisplay, helper->device_presence_event_type, event_class);
             XSelectExtensionEvent (xdisplay, RootWindow (xdisplay, DefaultScreen (xdisplay)), &event_class, 1);
 
             /* add an event filter */
-            if (gdk_x11_display_error_trap_pop (gdk_display_get_default ()) == 0)
-                gdk_window_add_filter (NULL, xfce_pointers_helper_event_filter, helper);
+            if (xfsettings_xstats_trap_pop (&xstats) == 0)
+                xfsettings_dispatcher_add_device_presence (xfce_pointers_helper_event_filter, helper);
             else
                 g_warning ("Failed to create device filter");
         }
@@ -194,6 +196,10 @@ xfce_pointers_helper_init (XfcePointersHelper *helper)
 static void
 xfce_pointers_helper_finalize (GObject *object)
 {
+#ifdef DEVICE_HOTPLUGGING
+    xfsettings_dispatcher_remove (xfce_pointers_helper_event_filter, object);
+#endif
+
     xfce_pointers_helper_syndaemon_stop (XFCE_POINTERS_HELPER (object));
 
     (*G_OBJECT_CLASS (xfce_pointers_helper_parent_class)->finalize) (object);
@@ -206,18 +212,19 @@ static gboolean
 xfce_pointers_is_enabled (Display *xdisplay,
                           XDevice *device)
 {
-    Atom     prop, type;
-    gulong   n_items, bytes_after;
-    gint     rc, format;
-    guchar  *data;
-    gboolean enabled;
-
-    prop = XInternAtom (xdisplay, DEVICE_ENABLED, False);
-    gdk_x11_display_error_trap_push (gdk_display_get_default ());
+    Atom            prop, type;
+    gulong          n_items, bytes_after;
+    gint            rc, format;
+    guchar         *data;
+    gboolean        enabled;
+    XfsdXStatsScope xstats;
+
+    prop = xfsettings_atom (XFSD_ATOM_DEVICE_ENABLED);
+    xfsettings_xstats_trap_push (&xstats, XFSD_HELPER_POINTERS, "is-enabled");
     rc = XGetDeviceProperty (xdisplay, device, prop, 0, 1, False,
                              XA_INTEGER, &type, &format, &n_items,
                              &bytes_after, &data);
-    gdk_x11_display_error_trap_pop_ignored (gdk_display_get_default ());
+    xfsettings_xstats_trap_pop (&xstats);
     if (rc == Success)
     {
         enabled = (gboolean) *data;
@@ -234,17 +241,18 @@ static gboolean
 xfce_pointers_is_libinput (Display *xdisplay,
                            XDevice *device)
 {
-    Atom     prop, type;
-    gulong   n_items, bytes_after;
-    gint     rc, format;
-    guchar  *data;
-
-    prop = XInternAtom (xdisplay, LIBINPUT_PROP_LEFT_HANDED, False);
-    gdk_x11_display_error_trap_push (gdk_display_get_default ());
+    Atom            prop, type;
+    gulong          n_items, bytes_after;
+    gint            rc, format;
+    guchar         *data;
+    XfsdXStatsScope xstats;
+
+    prop = xfsettings_atoms_lookup (LIBINPUT_PROP_LEFT_HANDED, FALSE);
+    xfsettings_xstats_trap_push (&xstats, XFSD_HELPER_POINTERS, "is-libinput");
     rc = XGetDeviceProperty (xdisplay, device, prop, 0, 1, False,
                              XA_INTEGER, &type, &format, &n_items,
                              &bytes_after, &data);
-    gdk_x11_display_error_trap_pop_ignored (gdk_display_get_default ());
+    xfsettings_xstats_trap_pop (&xstats);
     if (rc == Success)
     {
         XFree (data);
@@ -279,31 +287,32 @@ static void
 xfce_pointers_helper_syndaemon_check (XfcePointersHelper *helper)
 {
 #ifdef DEVICE_PROPERTIES
-    Display     *xdisplay = GDK_DISPLAY_XDISPLAY(gdk_display_get_default());
-    XDeviceInfo *device_list;
-    XDevice     *device;
-    gint         n, ndevices;
-    Atom         touchpad_type;
-    Atom         touchpad_off_prop;
-    Atom        *props;
-    gint         i, nprops;
-    gboolean     have_synaptics = FALSE;
-    gdouble      disable_duration;
-    gchar        disable_duration_string[64];
-    gchar       *args[] = { "syndaemon", "-i", disable_duration_string, "-K", "-R", NULL };
-    GError      *error = NULL;
+    Display         *xdisplay = GDK_DISPLAY_XDISPLAY(gdk_display_get_default());
+    XDeviceInfo     *device_list;
+    XDevice         *device;
+    gint             n, ndevices;
+    Atom             touchpad_type;
+    Atom             touchpad_off_prop;
+    Atom            *props;
+    gint             i, nprops;
+    gboolean         have_synaptics = FALSE;
+    gdouble          disable_duration;
+    gchar            disable_duration_string[64];
+    gchar           *args[] = { "syndaemon", "-i", disable_duration_string, "-K", "-R", NULL };
+    GError          *error = NULL;
+    XfsdXStatsScope  xstats;
 
     /* only stop a running daemon */
-    if (!xfconf_channel_get_bool (helper->channel, "/DisableTouchpadWhileTyping", FALSE))
+    if (!xfsettings_snapshot_get_bool (helper->channel, "/DisableTouchpadWhileTyping", FALSE))
         goto start_stop_daemon;
 
-    gdk_x11_display_error_trap_push (gdk_display_get_default ());
+    xfsettings_xstats_trap_push (&xstats, XFSD_HELPER_POINTERS, "syndaemon-list-devices");
     device_list = XListInputDevices (xdisplay, &ndevices);
-    if (gdk_x11_display_error_trap_pop (gdk_display_get_default ()) != 0 || device_list == NULL)
+    if (xfsettings_xstats_trap_pop (&xstats) != 0 || device_list == NULL)
         goto start_stop_daemon;
 
-    touchpad_type = XInternAtom (xdisplay, XI_TOUCHPAD, True);
-    touchpad_off_prop = XInternAtom (xdisplay, "Synaptics Off", True);
+    touchpad_type = xfsettings_atoms_lookup (XI_TOUCHPAD, TRUE);
+    touchpad_off_prop = xfsettings_atoms_lookup ("Synaptics Off", TRUE);
 
     for (n = 0; n < ndevices; n++)
     {
@@ -311,18 +320,18 @@ xfce_pointers_helper_syndaemon_check (XfcePointersHelper *helper)
         if (device_list[n].type != touchpad_type)
             continue;
 
-        gdk_x11_display_error_trap_push (gdk_display_get_default ());
+        xfsettings_xstats_trap_push (&xstats, XFSD_HELPER_POINTERS, "syndaemon-open-device");
         device = XOpenDevice (xdisplay, device_list[n].id);
-        if (gdk_x11_display_error_trap_pop (gdk_display_get_default ()) != 0 || device == NULL)
+        if (xfsettings_xstats_trap_pop (&xstats) != 0 || device == NULL)
         {
             g_critical ("Unable to open device %s", device_list[n].name);
             break;
         }
 
         /* look for the Synaptics Off property */
-        gdk_x11_display_error_trap_push (gdk_display_get_default ());
+        xfsettings_xstats_trap_push (&xstats, XFSD_HELPER_POINTERS, "syndaemon-list-properties");
         props = XListDeviceProperties (xdisplay, device, &nprops);
-        if (gdk_x11_display_error_trap_pop (gdk_display_get_default ()) == 0
+        if (xfsettings_xstats_trap_pop (&xstats) == 0
             && props != NULL)
         {
             for (i = 0; !have_synaptics && i < nprops; i++)
@@ -346,9 +355,9 @@ xfce_pointers_helper_syndaemon_check (XfcePointersHelper *helper)
 
     if (have_synaptics)
     {
-        disable_duration = xfconf_channel_get_double (helper->channel,
-                                                      "/DisableTouchpadDuration",
-                                                      2.0);
+        disable_duration = xfsettings_snapshot_get_double (helper->channel,
+                                                           "/DisableTouchpadDuration",
+                                                           2.0);
         setlocale(LC_NUMERIC, "C"); /* syndaemon needs a dot for the float. Nothing localized! */
         g_snprintf (disable_duration_string, sizeof (disable_duration_string),
                     "%.1f", disable_duration);
@@ -415,13 +424,14 @@ xfce_pointers_helper_change_button_mapping (XDeviceInfo *device_info,
                                             gint         right_handed,
                                             gint         reverse_scrolling)
 {
-    XAnyClassPtr  ptr;
-    gshort        num_buttons = 0;
-    guchar       *buttonmap;
-    gboolean      map_changed = FALSE;
-    gint          n;
-    gint          right_button;
-    GString      *readable_map;
+    XAnyClassPtr     ptr;
+    gshort           num_buttons = 0;
+    guchar          *buttonmap;
+    gboolean         map_changed = FALSE;
+    gint             n;
+    gint             right_button;
+    GString         *readable_map;
+    XfsdXStatsScope  xstats;
 
 #ifdef HAVE_LIBINPUT
     if (xfce_pointers_is_libinput (xdisplay, device))
@@ -474,9 +484,9 @@ xfce_pointers_helper_change_button_mapping (XDeviceInfo *device_info,
     /* allocate the button map */
     buttonmap = g_new0 (guchar, num_buttons);
 
-    gdk_x11_display_error_trap_push (gdk_display_get_default ());
+    xfsettings_xstats_trap_push (&xstats, XFSD_HELPER_POINTERS, "get-button-mapping");
     XGetDeviceButtonMapping (xdisplay, device, buttonmap, num_buttons);
-    if (gdk_x11_display_error_trap_pop (gdk_display_get_default ()) != 0)
+    if (xfsettings_xstats_trap_pop (&xstats) != 0)
     {
         g_warning ("Failed to get button mapping");
         goto leave;
@@ -510,9 +520,9 @@ xfce_pointers_helper_change_button_mapping (XDeviceInfo *device_info,
     /* only set on changes */
     if (map_changed)
     {
-        gdk_x11_display_error_trap_push (gdk_display_get_default ());
+        xfsettings_xstats_trap_push (&xstats, XFSD_HELPER_POINTERS, "set-button-mapping");
         XSetDeviceButtonMapping (xdisplay, device, buttonmap, num_buttons);
-        if (gdk_x11_display_error_trap_pop (gdk_display_get_default ()) != 0)
+        if (xfsettings_xstats_trap_pop (&xstats) != 0)
             g_warning ("Failed to set button mapping");
 
         /* don't put a hard time on ourselves and make debugging a lot better */
@@ -525,6 +535,7 @@ xfce_pointers_helper_change_button_mapping (XDeviceInfo *device_info,
     }
     else
     {
+        xfsettings_xstats_elided (XFSD_HELPER_POINTERS, "set-button-mapping");
         xfsettings_dbg (XFSD_DEBUG_POINTERS, "[%s] buttonmap not changed",
                         device_info->name);
     }
@@ -554,12 +565,14 @@ xfce_pointers_helper_change_feedback (XDeviceInfo *device_info,
                                       gdouble      acceleration)
 {
     XFeedbackState      *states, *pt;
+    XPtrFeedbackState   *state;
     gint                 num_feedbacks;
     XPtrFeedbackControl  feedback;
     gint                 n;
     gulong               mask = 0;
     gint                 num, denom, gcd;
     gboolean             found = FALSE;
+    XfsdXStatsScope      xstats;
 
 #ifdef HAVE_LIBINPUT
     if (xfce_pointers_is_libinput (xdisplay, device))
@@ -577,9 +590,9 @@ xfce_pointers_helper_change_feedback (XDeviceInfo *device_info,
     }
 #endif /* HAVE_LIBINPUT */
     /* get the feedback states for this device */
-    gdk_x11_display_error_trap_push (gdk_display_get_default ());
+    xfsettings_xstats_trap_push (&xstats, XFSD_HELPER_POINTERS, "get-feedback");
     states = XGetFeedbackControl (xdisplay, device, &num_feedbacks);
-    if (gdk_x11_display_error_trap_pop (gdk_display_get_default ()) != 0 || states == NULL)
+    if (xfsettings_xstats_trap_pop (&xstats) != 0 || states == NULL)
     {
         g_critical ("Failed to get the feedback states of device %s",
                     device_info->name);
@@ -638,15 +651,28 @@ xfce_pointers_helper_change_feedback (XDeviceInfo *device_info,
             mask |= DvThreshold;
         }
 
+        /* nothing to do if the server already has it, resets are always sent */
+        state = (XPtrFeedbackState *) pt;
+        if ((!(mask & DvThreshold)
+             || (threshold > 0 && state->threshold == threshold))
+            && (!(mask & DvAccelNum)
+                || (acceleration >= 0
+                    && state->accelNum * feedback.accelDenom == feedback.accelNum * state->accelDenom)))
+        {
+            xfsettings_xstats_elided (XFSD_HELPER_POINTERS, "set-feedback");
+            xfsettings_dbg (XFSD_DEBUG_POINTERS, "[%s] feedback not changed",
+                            device_info->name);
+            break;
+        }
+
         /* update the feedback of the device */
-        gdk_x11_display_error_trap_push (gdk_display_get_default ());
+        xfsettings_xtrap_begin (XFSD_HELPER_POINTERS, "set-feedback");
+        xfsettings_xtrap_push ("set feedback states for device %s",
+                               device_info->name);
         XChangeFeedbackControl (xdisplay, device, mask,
                                 (XFeedbackControl *) &feedback);
-        if (gdk_x11_display_error_trap_pop (gdk_display_get_default ()) != 0)
-        {
-            g_warning ("Failed to set feedback states for device %s",
-                       device_info->name);
-        }
+        xfsettings_xtrap_pop ();
+        xfsettings_xtrap_commit ();
 
         xfsettings_dbg (XFSD_DEBUG_POINTERS,
                         "[%s] change feedback (threshold=%d, "
@@ -674,7 +700,10 @@ xfce_pointers_helper_change_mode (XDeviceInfo  *device_info,
                                   Display      *xdisplay,
                                   const gchar  *mode_name)
 {
-    gint mode;
+    gint            mode;
+    XAnyClassPtr    ptr;
+    gint            n;
+    XfsdXStatsScope xstats;
 
     if (strcmp (mode_name, "RELATIVE") == 0)
         mode = Relative;
@@ -686,9 +715,28 @@ xfce_pointers_helper_change_mode (XDeviceInfo  *device_info,
         return;
     }
 
-    gdk_x11_display_error_trap_push (gdk_display_get_default ());
+    /* nothing to do if the device is already in this mode */
+    for (n = 0, ptr = device_info->inputclassinfo; n < device_info->num_classes; n++)
+    {
+        if (ptr->class == ValuatorClass)
+        {
+            if (((XValuatorInfoPtr) ptr)->mode == mode)
+            {
+                xfsettings_xstats_elided (XFSD_HELPER_POINTERS, "set-mode");
+                xfsettings_dbg (XFSD_DEBUG_POINTERS, "[%s] mode already %s",
+                                device_info->name, mode_name);
+                return;
+            }
+            break;
+        }
+
+        /* advance the offset */
+        ptr = (XAnyClassPtr) ((gchar *) ptr + ptr->length);
+    }
+
+    xfsettings_xstats_trap_push (&xstats, XFSD_HELPER_POINTERS, "set-mode");
     XSetDeviceMode (xdisplay, device, mode);
-    if (gdk_x11_display_error_trap_pop (gdk_display_get_default ()) != 0)
+    if (xfsettings_xstats_trap_pop (&xstats) != 0)
         g_critical ("Failed to change the device mode");
 
     xfsettings_dbg (XFSD_DEBUG_POINTERS,
@@ -739,18 +787,21 @@ xfce_pointers_helper_change_property (XDeviceInfo  *device_info,
                                       const gchar  *prop_name,
                                       const GValue *value)
 {
-    Atom         *props;
-    gint          n, n_props;
-    Atom          prop;
-    gchar        *atom_name;
-    Atom          type;
-    gint          format;
-    gulong        n_items, bytes_after, i;
-    gulong        n_succeeds;
-    Atom          float_atom;
-    GPtrArray    *array = NULL;
-    int           rc;
-    const GValue *val;
+    Atom            *props;
+    gint             n, n_props;
+    Atom             prop;
+    gchar           *atom_name;
+    Atom             type;
+    gint             format;
+    gulong           n_items, bytes_after, i;
+    gulong           n_succeeds;
+    Atom             float_atom;
+    GPtrArray       *array = NULL;
+    int              rc;
+    const GValue    *val;
+    gsize            data_size;
+    gpointer         old_data = NULL;
+    XfsdXStatsScope  xstats;
     union {
         guchar *c;
         gshort *s;
@@ -762,10 +813,10 @@ xfce_pointers_helper_change_property (XDeviceInfo  *device_info,
     /* assuming the device property never contained underscores... */
     atom_name = g_strdup (prop_name);
     g_strdelimit (atom_name, "_", ' ');
-    prop = XInternAtom (xdisplay, atom_name, True);
+    prop = xfsettings_atoms_lookup (atom_name, TRUE);
     g_free (atom_name);
 
-    /* because of the True in XInternAtom we quit here if the property
+    /* because of the True in the lookup we quit here if the property
      * does not exists on any of the devices */
     if (prop == None)
         return;
@@ -776,17 +827,17 @@ xfce_pointers_helper_change_property (XDeviceInfo  *device_info,
      * see: https://bugs.freedesktop.org/show_bug.cgi?id=89296
      * and: http://lists.x.org/archives/xorg-devel/2015-February/045716.html
      */
-    if (prop != XInternAtom (xdisplay, DEVICE_ENABLED, True) &&
+    if (prop != xfsettings_atom (XFSD_ATOM_DEVICE_ENABLED) &&
         !xfce_pointers_is_enabled (xdisplay, device))
         return;
 #endif /* HAVE_LIBINPUT */
 
-    gdk_x11_display_error_trap_push (gdk_display_get_default ());
+    xfsettings_xstats_trap_push (&xstats, XFSD_HELPER_POINTERS, "list-properties");
     props = XListDeviceProperties (xdisplay, device, &n_props);
-    if (gdk_x11_display_error_trap_pop (gdk_display_get_default ()) || props == NULL)
+    if (xfsettings_xstats_trap_pop (&xstats) || props == NULL)
         return;
 
-    float_atom = XInternAtom (xdisplay, "FLOAT", False);
+    float_atom = xfsettings_atom (XFSD_ATOM_FLOAT);
 
     for (n = 0; n < n_props; n++)
     {
@@ -794,12 +845,21 @@ xfce_pointers_helper_change_property (XDeviceInfo  *device_info,
         if (props[n] != prop)
             continue;
 
-        gdk_x11_display_error_trap_push (gdk_display_get_default ());
+        xfsettings_xstats_trap_push (&xstats, XFSD_HELPER_POINTERS, "get-property");
         rc = XGetDeviceProperty (xdisplay, device, prop, 0, 1000, False,
                                  AnyPropertyType, &type, &format,
                                  &n_items, &bytes_after, &data.c);
-        if (!gdk_x11_display_error_trap_pop (gdk_display_get_default ()) && rc == Success)
+        if (!xfsettings_xstats_trap_pop (&xstats) && rc == Success)
         {
+            /* keep the current value to skip writes that don't change it */
+            if (format == 8)
+                data_size = n_items * sizeof (guchar);
+            else if (format == 16)
+                data_size = n_items * sizeof (gshort);
+            else
+                data_size = n_items * sizeof (glong);
+            old_data = g_memdup (data.c, data_size);
+
             if (n_items == 1
                 && (G_VALUE_HOLDS_INT (value)
                     || G_VALUE_HOLDS_STRING (value)
@@ -855,7 +915,7 @@ xfce_pointers_helper_change_property (XDeviceInfo  *device_info,
                          && format == 32)
                 {
                     /* set atom (reference to a string) */
-                    data.a[i] = XInternAtom (xdisplay, g_value_get_string (val), False);
+                    data.a[i] = xfsettings_atoms_lookup (g_value_get_string (val), FALSE);
                 }
                 else if (G_VALUE_HOLDS_DOUBLE (val) /* xfconf doesn't support floats */
                          && type == float_atom
@@ -874,17 +934,24 @@ xfce_pointers_helper_change_property (XDeviceInfo  *device_info,
                 n_succeeds++;
             }
 
-            if (n_succeeds == n_items)
+            if (n_succeeds == n_items
+                && data_size > 0
+                && memcmp (old_data, data.c, data_size) == 0)
+            {
+                xfsettings_xstats_elided (XFSD_HELPER_POINTERS, "set-property");
+                xfsettings_dbg (XFSD_DEBUG_POINTERS,
+                                "[%s] Device property %s not changed",
+                                device_info->name, prop_name);
+            }
+            else if (n_succeeds == n_items)
             {
-                gdk_x11_display_error_trap_push (gdk_display_get_default ());
+                xfsettings_xtrap_begin (XFSD_HELPER_POINTERS, "set-property");
+                xfsettings_xtrap_push ("set device property %s for %s",
+                                       prop_name, device_info->name);
                 XChangeDeviceProperty (xdisplay, device, prop, type, format,
                                        PropModeReplace, data.c, n_items);
-                XSync (xdisplay, FALSE);
-                if (gdk_x11_display_error_trap_pop (gdk_display_get_default ()))
-                {
-                    g_critical ("Failed to set device property %s for %s",
-                                prop_name, device_info->name);
-                }
+                xfsettings_xtrap_pop ();
+                xfsettings_xtrap_commit ();
 
                 xfsettings_dbg (XFSD_DEBUG_POINTERS,
                                 "[%s] Changed device property %s",
@@ -898,6 +965,7 @@ xfce_pointers_helper_change_property (XDeviceInfo  *device_info,
         break;
     }
 
+    g_free (old_data);
     XFree (props);
 }
 #endif /* DEVICE_PROPERTIES || HAVE_LIBINPUT */
@@ -939,16 +1007,20 @@ xfce_pointers_helper_restore_devices (XfcePointersHelper *helper,
     GHashTable      *props;
     XfcePointerData  pointer_data;
 #endif
+    XfsdXStatsScope  xstats;
     const gchar     *mode;
 
-    gdk_x11_display_error_trap_push (gdk_display_get_default ());
+    xfsettings_xstats_trap_push (&xstats, XFSD_HELPER_POINTERS, "list-devices");
     device_list = XListInputDevices (xdisplay, &ndevices);
-    if (gdk_x11_display_error_trap_pop (gdk_display_get_default ()) != 0 || device_list == NULL)
+    if (xfsettings_xstats_trap_pop (&xstats) != 0 || device_list == NULL)
     {
         g_message ("No input devices found");
         return;
     }
 
+    /* sync once for all the devices */
+    xfsettings_xtrap_begin (XFSD_HELPER_POINTERS, "restore-devices");
+
     for (n = 0; n < ndevices; n++)
     {
         /* filter the pointer devices */
@@ -962,9 +1034,9 @@ xfce_pointers_helper_restore_devices (XfcePointersHelper *helper,
             continue;
 
         /* open the device */
-        gdk_x11_display_error_trap_push (gdk_display_get_default ());
+        xfsettings_xstats_trap_push (&xstats, XFSD_HELPER_POINTERS, "open-device");
         device = XOpenDevice (xdisplay, device_info->id);
-        if (gdk_x11_display_error_trap_pop (gdk_display_get_default ()) != 0 || device == NULL)
+        if (xfsettings_xstats_trap_pop (&xstats) != 0 || device == NULL)
         {
             g_critical ("Unable to open device %s", device_info->name);
             continue;
@@ -975,10 +1047,10 @@ xfce_pointers_helper_restore_devices (XfcePointersHelper *helper,
 
         /* read buttonmap properties */
         g_snprintf (prop, sizeof (prop), "/%s/RightHanded", device_name);
-        right_handed = xfconf_channel_get_bool (helper->channel, prop, -1);
+        right_handed = xfsettings_snapshot_get_bool (helper->channel, prop, -1);
 
         g_snprintf (prop, sizeof (prop), "/%s/ReverseScrolling", device_name);
-        reverse_scrolling = xfconf_channel_get_bool (helper->channel, prop, -1);
+        reverse_scrolling = xfsettings_snapshot_get_bool (helper->channel, prop, -1);
 
         if (right_handed != -1 || reverse_scrolling != -1)
         {
@@ -988,10 +1060,10 @@ xfce_pointers_helper_restore_devices (XfcePointersHelper *helper,
 
         /* read feedback settings */
         g_snprintf (prop, sizeof (prop), "/%s/Threshold", device_name);
-        threshold = xfconf_channel_get_int (helper->channel, prop, -1);
+        threshold = xfsettings_snapshot_get_int (helper->channel, prop, -1);
 
         g_snprintf (prop, sizeof (prop), "/%s/Acceleration", device_name);
-        acceleration = xfconf_channel_get_double (helper->channel, prop, -1.00);
+        acceleration = xfsettings_snapshot_get_double (helper->channel, prop, -1.00);
 
         if (threshold != -1 || acceleration != -1.00)
         {
@@ -1009,7 +1081,7 @@ xfce_pointers_helper_restore_devices (XfcePointersHelper *helper,
 #ifdef DEVICE_PROPERTIES
         /* set device properties */
         g_snprintf (prop, sizeof (prop), "/%s/Properties", device_name);
-        props = xfconf_channel_get_properties (helper->channel, prop);
+        props = xfsettings_snapshot_get_properties (helper->channel, prop);
 
         if (props != NULL)
         {
@@ -1028,6 +1100,8 @@ xfce_pointers_helper_restore_devices (XfcePointersHelper *helper,
         XCloseDevice (xdisplay, device);
     }
 
+    xfsettings_xtrap_commit ();
+
     XFreeDeviceList (device_list);
 }
 
@@ -1039,12 +1113,13 @@ xfce_pointers_helper_channel_property_changed (XfconfChannel      *channel,
                                                const GValue       *value,
                                                XfcePointersHelper *helper)
 {
-    Display      *xdisplay = GDK_DISPLAY_XDISPLAY(gdk_display_get_default());
-    XDeviceInfo  *device_list, *device_info;
-    XDevice      *device;
-    gint          n, ndevices;
-    gchar       **names;
-    gchar        *device_name;
+    Display          *xdisplay = GDK_DISPLAY_XDISPLAY(gdk_display_get_default());
+    XDeviceInfo      *device_list, *device_info;
+    XDevice          *device;
+    gint              n, ndevices;
+    gchar           **names;
+    gchar            *device_name;
+    XfsdXStatsScope   xstats;
 
     if (G_UNLIKELY (property_name == NULL))
          return;
@@ -1062,11 +1137,16 @@ xfce_pointers_helper_channel_property_changed (XfconfChannel      *channel,
 
     if (names != NULL && g_strv_length (names) >= 2)
     {
-        gdk_x11_display_error_trap_push (gdk_display_get_default ());
+        xfsettings_metrics_changed (XFSD_HELPER_POINTERS, property_name);
+        xfsettings_trace (XFSD_HELPER_POINTERS, XFSD_TRACE_APPLY_START, 0);
+
+        xfsettings_xstats_trap_push (&xstats, XFSD_HELPER_POINTERS, "list-devices");
         device_list = XListInputDevices (xdisplay, &ndevices);
-        if (gdk_x11_display_error_trap_pop (gdk_display_get_default ()) != 0 || device_list == NULL)
+        if (xfsettings_xstats_trap_pop (&xstats) != 0 || device_list == NULL)
         {
             g_message ("No input devices found");
+            xfsettings_metrics_discard (XFSD_HELPER_POINTERS);
+            g_strfreev (names);
             return;
         }
 
@@ -1083,9 +1163,9 @@ xfce_pointers_helper_channel_property_changed (XfconfChannel      *channel,
             if (strcmp (names[0], device_name) == 0)
             {
                 /* open the device */
-                gdk_x11_display_error_trap_push (gdk_display_get_default ());
+                xfsettings_xstats_trap_push (&xstats, XFSD_HELPER_POINTERS, "open-device");
                 device = XOpenDevice (xdisplay, device_info->id);
-                if (gdk_x11_display_error_trap_pop (gdk_display_get_default ()) != 0 || device == NULL)
+                if (xfsettings_xstats_trap_pop (&xstats) != 0 || device == NULL)
                 {
                     g_critical ("Unable to open device %s", device_info->name);
                     continue;
@@ -1132,6 +1212,8 @@ xfce_pointers_helper_channel_property_changed (XfconfChannel      *channel,
 
                 XCloseDevice (xdisplay, device);
 
+                xfsettings_metrics_applied (XFSD_HELPER_POINTERS);
+
                 /* stop searching */
                 n = ndevices;
             }
@@ -1140,6 +1222,9 @@ xfce_pointers_helper_channel_property_changed (XfconfChannel      *channel,
         }
 
         XFreeDeviceList (device_list);
+
+        /* no device matched the property */
+        xfsettings_metrics_discard (XFSD_HELPER_POINTERS);
     }
 
     g_strfreev (names);
@@ -1159,6 +1244,8 @@ xfce_pointers_helper_event_filter (GdkXEvent *xevent,
 
     if (event->type == helper->device_presence_event_type)
     {
+        xfsettings_trace (XFSD_HELPER_POINTERS, XFSD_TRACE_X_EVENT, event->type);
+
         /* restore device settings */
         if (dpn_event->devchange == DeviceAdded)
             xfce_pointers_helper_restore_devices (helper, &dpn_event->deviceid);
@@ -0,0 +1,345 @@
+/*
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Main loop stall detector. All helpers share the main loop, so one slow
+ * helper blocks the others. The poll function of the default context is
+ * wrapped: the time between returning from poll and entering it again is
+ * the time spent dispatching, and dispatches that take longer than the
+ * threshold are recorded with the helper that was active (the last one
+ * that added a trace event) and the name of its main loop source.
+ *
+ * A dispatch that never returns is not recorded that way, so a watchdog
+ * thread warns when the loop is blocked for longer than the threshold.
+ * It sleeps while the main loop is idle.
+ *
+ * The threshold is set in milliseconds with XFSETTINGSD_STALL_THRESHOLD,
+ * 0 disables the detector. The stalls are written to stderr on SIGUSR1
+ * and are available with the GetStalls method of the metrics interface.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "stall.h"
+#include "metrics.h"
+#include "debug.h"
+
+/* default threshold in milliseconds */
+#define STALL_DEFAULT_THRESHOLD 100
+
+/* number of stalls kept, must be a power of two */
+#define STALL_SIZE 64
+
+/* no helper added a trace event in the dispatch */
+#define STALL_NO_HELPER XFSD_N_HELPERS
+
+
+
+typedef struct _XfsdStall XfsdStall;
+
+
+
+struct _XfsdStall
+{
+    gint64 start;
+    gint64 duration;
+    guint  helper;
+    gchar  source[48];
+};
+
+/* threshold in usec, 0 if disabled */
+static gint64     stall_threshold = 0;
+static GPollFunc  stall_poll_func = NULL;
+static GThread   *stall_thread = NULL;
+
+/* shared with the watchdog */
+static GMutex     stall_lock;
+static GCond      stall_cond;
+static gint64     stall_dispatch_start = 0;
+static guint      stall_dispatch_helper = STALL_NO_HELPER;
+static gboolean   stall_watchdog_idle = FALSE;
+static gboolean   stall_quit = FALSE;
+
+/* main thread only */
+static gchar      stall_source[48];
+static XfsdStall  stall_ring[STALL_SIZE];
+static guint64    stall_count = 0;
+static guint64    stall_helper_count[XFSD_N_HELPERS + 1];
+static gint64     stall_helper_max[XFSD_N_HELPERS + 1];
+
+G_STATIC_ASSERT ((STALL_SIZE & (STALL_SIZE - 1)) == 0);
+
+
+
+static const gchar *
+xfsettings_stall_helper_name (guint helper)
+{
+    if (helper == STALL_NO_HELPER)
+        return "unknown";
+
+    return xfsettings_metrics_helper_name (helper);
+}
+
+
+
+static void
+xfsettings_stall_record (gint64 start,
+                         gint64 duration,
+                         guint  helper)
+{
+    XfsdStall *stall;
+
+    stall = &stall_ring[stall_count++ & (STALL_SIZE - 1)];
+    stall->start = start;
+    stall->duration = duration;
+    stall->helper = helper;
+    g_strlcpy (stall->source, stall_source, sizeof (stall->source));
+
+    stall_helper_count[helper]++;
+    stall_helper_max[helper] = MAX (stall_helper_max[helper], duration);
+
+    xfsettings_dbg (XFSD_DEBUG_STALL, "main loop stalled %.3f ms in %s (%s)",
+                    duration / 1000.0, xfsettings_stall_helper_name (helper),
+                    stall->source);
+}
+
+
+
+static gint
+xfsettings_stall_poll (GPollFD *ufds,
+                       guint    nfds,
+                       gint     timeout)
+{
+    gint64 now, start;
+    guint  helper;
+    gint   result;
+
+    now = g_get_monotonic_time ();
+
+    g_mutex_lock (&stall_lock);
+    start = stall_dispatch_start;
+    helper = stall_dispatch_helper;
+    stall_dispatch_start = 0;
+    g_mutex_unlock (&stall_lock);
+
+    if (start > 0 && now - start >= stall_threshold)
+        xfsettings_stall_record (start, now - start, helper);
+
+    result = stall_poll_func (ufds, nfds, timeout);
+
+    stall_source[0] = '\0';
+
+    g_mutex_lock (&stall_lock);
+    stall_dispatch_start = g_get_monotonic_time ();
+    stall_dispatch_helper = STALL_NO_HELPER;
+    if (stall_watchdog_idle)
+        g_cond_signal (&stall_cond);
+    g_mutex_unlock (&stall_lock);
+
+    return result;
+}
+
+
+
+static gpointer
+xfsettings_stall_watchdog (gpointer data)
+{
+    gint64 start;
+    guint  helper;
+
+    g_mutex_lock (&stall_lock);
+
+    while (!stall_quit)
+    {
+        start = stall_dispatch_start;
+
+        if (start > 0 && g_get_monotonic_time () < start + stall_threshold)
+        {
+            /* check again when the dispatch passes the threshold */
+            g_cond_wait_until (&stall_cond, &stall_lock, start + stall_threshold);
+            continue;
+        }
+
+        if (start > 0)
+        {
+            helper = stall_dispatch_helper;
+
+            g_mutex_unlock (&stall_lock);
+            g_warning ("Main loop blocked for more than %" G_GINT64_FORMAT " ms in %s",
+                       stall_threshold / 1000, xfsettings_stall_helper_name (helper));
+            g_mutex_lock (&stall_lock);
+        }
+
+        /* sleep until the next dispatch */
+        stall_watchdog_idle = TRUE;
+        while (!stall_quit && stall_dispatch_start == start)
+            g_cond_wait (&stall_cond, &stall_lock);
+        stall_watchdog_idle = FALSE;
+    }
+
+    g_mutex_unlock (&stall_lock);
+
+    return NULL;
+}
+
+
+
+void
+xfsettings_stall_init (void)
+{
+    const gchar *value;
+    gint64       threshold = STALL_DEFAULT_THRESHOLD;
+
+    g_return_if_fail (stall_thread == NULL);
+
+    value = g_getenv ("XFSETTINGSD_STALL_THRESHOLD");
+    if (value != NULL && *value != '\0')
+        threshold = g_ascii_strtoll (value, NULL, 10);
+
+    if (threshold <= 0)
+    {
+        xfsettings_dbg (XFSD_DEBUG_STALL, "stall detection disabled");
+        return;
+    }
+
+    stall_threshold = threshold * 1000;
+
+    stall_poll_func = g_main_context_get_poll_func (NULL);
+    g_main_context_set_poll_func (NULL, xfsettings_stall_poll);
+
+    stall_thread = g_thread_new ("stall-watchdog", xfsettings_stall_watchdog, NULL);
+
+    xfsettings_dbg (XFSD_DEBUG_STALL, "stall threshold %" G_GINT64_FORMAT " ms",
+                    threshold);
+}
+
+
+
+void
+xfsettings_stall_helper (XfsdHelper helper)
+{
+    GSource     *source;
+    const gchar *name;
+
+    /* only the first event of a helper in a dispatch does work */
+    if (stall_threshold == 0 || stall_dispatch_helper == helper)
+        return;
+
+    g_mutex_lock (&stall_lock);
+    stall_dispatch_helper = helper;
+    g_mutex_unlock (&stall_lock);
+
+    source = g_main_current_source ();
+    name = source != NULL ? g_source_get_name (source) : NULL;
+    g_strlcpy (stall_source, name != NULL ? name : "unnamed source",
+               sizeof (stall_source));
+}
+
+
+
+GVariant *
+xfsettings_stall_collect (void)
+{
+    GVariantBuilder  helpers, stalls;
+    const XfsdStall *stall;
+    guint64          n;
+    guint            i;
+
+    g_variant_builder_init (&helpers, G_VARIANT_TYPE ("a(stx)"));
+    for (i = 0; i <= XFSD_N_HELPERS; i++)
+    {
+        if (stall_helper_count[i] == 0)
+            continue;
+
+        g_variant_builder_add (&helpers, "(stx)", xfsettings_stall_helper_name (i),
+                               stall_helper_count[i], stall_helper_max[i]);
+    }
+
+    g_variant_builder_init (&stalls, G_VARIANT_TYPE ("a(xxss)"));
+    n = stall_count > STALL_SIZE ? stall_count - STALL_SIZE : 0;
+    for (; n < stall_count; n++)
+    {
+        stall = &stall_ring[n & (STALL_SIZE - 1)];
+        g_variant_builder_add (&stalls, "(xxss)", stall->start, stall->duration,
+                               xfsettings_stall_helper_name (stall->helper),
+                               stall->source);
+    }
+
+    return g_variant_new ("(@a(stx)@a(xxss))",
+                          g_variant_builder_end (&helpers),
+                          g_variant_builder_end (&stalls));
+}
+
+
+
+void
+xfsettings_stall_dump (void)
+{
+    const XfsdStall *stall;
+    guint64          n;
+    guint            i;
+
+    if (stall_threshold == 0)
+        return;
+
+    g_printerr (PACKAGE_NAME ": %" G_GUINT64_FORMAT " main loop stalls over %"
+                G_GINT64_FORMAT " ms\n", stall_count, stall_threshold / 1000);
+
+    for (i = 0; i <= XFSD_N_HELPERS; i++)
+    {
+        if (stall_helper_count[i] == 0)
+            continue;
+
+        g_printerr ("  %-18s %8" G_GUINT64_FORMAT " stalls (max %.3f ms)\n",
+                    xfsettings_stall_helper_name (i), stall_helper_count[i],
+                    stall_helper_max[i] / 1000.0);
+    }
+
+    n = stall_count > STALL_SIZE ? stall_count - STALL_SIZE : 0;
+    for (; n < stall_count; n++)
+    {
+        stall = &stall_ring[n & (STALL_SIZE - 1)];
+        g_printerr ("  %16" G_GINT64_FORMAT " %10.3f ms %-18s %s\n",
+                    stall->start, stall->duration / 1000.0,
+                    xfsettings_stall_helper_name (stall->helper), stall->source);
+    }
+}
+
+
+
+void
+xfsettings_stall_shutdown (void)
+{
+    if (stall_thread == NULL)
+        return;
+
+    g_mutex_lock (&stall_lock);
+    stall_quit = TRUE;
+    g_cond_signal (&stall_cond);
+    g_mutex_unlock (&stall_lock);
+
+    g_thread_join (stall_thread);
+    stall_thread = NULL;
+
+    g_main_context_set_poll_func (NULL, stall_poll_func);
+    stall_threshold = 0;
+}
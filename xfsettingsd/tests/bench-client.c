@@ -0,0 +1,849 @@
+/*
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * X and session bus client for bench-session.sh. Every command drives
+ * one path of a running xfsettingsd and prints what it measured:
+ *
+ *   startup-report   start offset and duration of each helper
+ *   xsettings N      N theme switches through xfconf, each timed until
+ *                    the new _XSETTINGS_SETTINGS property is on the server
+ *   clipboard MB...  hand a text clipboard of each size to the clipboard
+ *                    manager, the way an application does when it quits,
+ *                    and read it back from the manager; reports the time
+ *                    of both, how far the peak RSS of the daemon grew and
+ *                    how much of it the daemon keeps for the contents.
+ *                    Each size runs without and with compression, with
+ *                    the bytes the manager stores and how long that took
+ *   metrics          xfconf to X latency and main loop stalls per helper
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <stdio.h>
+#include <poll.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#define SETTINGS_DBUS_NAME  "org.xfce.SettingsDaemon"
+#define SETTINGS_DBUS_PATH  "/org/xfce/SettingsDaemon"
+#define METRICS_INTERFACE   "org.xfce.SettingsDaemon.Metrics"
+
+/* give up when the daemon does not answer within this time */
+#define EVENT_TIMEOUT       30000
+
+/* how long to wait for the clipboard manager to store a payload */
+#define STORE_TIMEOUT       10000
+
+/* size of the chunks of an incremental transfer */
+#define INCR_CHUNK_SIZE     (256 * 1024)
+
+
+
+typedef struct _BenchTransfer BenchTransfer;
+
+
+
+struct _BenchTransfer
+{
+    Window  requestor;
+    Atom    property;
+    gsize   offset;
+    guint   active : 1;
+};
+
+
+
+static Display         *display = NULL;
+static Window           window = None;
+static GDBusConnection *bus = NULL;
+
+static Atom             atom_clipboard;
+static Atom             atom_clipboard_manager;
+static Atom             atom_save_targets;
+static Atom             atom_targets;
+static Atom             atom_multiple;
+static Atom             atom_atom_pair;
+static Atom             atom_incr;
+static Atom             atom_utf8_string;
+static Atom             atom_bench_save;
+static Atom             atom_bench_data;
+
+static gchar           *payload = NULL;
+static gsize            payload_len = 0;
+
+
+
+static void
+bench_fail (const gchar *message)
+{
+    g_printerr ("bench-client: %s\n", message);
+    exit (EXIT_FAILURE);
+}
+
+
+
+static int
+bench_x_error (Display     *xdisplay,
+               XErrorEvent *error)
+{
+    /* a requestor window that is gone while transferring,
+     * the event loop times out if that matters */
+    return 0;
+}
+
+
+
+static gboolean
+bench_next_event (XEvent *xevent)
+{
+    struct pollfd pfd;
+
+    pfd.fd = ConnectionNumber (display);
+    pfd.events = POLLIN;
+
+    while (XPending (display) == 0)
+    {
+        if (poll (&pfd, 1, EVENT_TIMEOUT) <= 0)
+            return FALSE;
+    }
+
+    XNextEvent (display, xevent);
+
+    return TRUE;
+}
+
+
+
+static GVariant *
+bench_call (const gchar *method,
+            const gchar *reply_type)
+{
+    GVariant *reply;
+    GError   *error = NULL;
+
+    reply = g_dbus_connection_call_sync (bus, SETTINGS_DBUS_NAME, SETTINGS_DBUS_PATH,
+                                         METRICS_INTERFACE, method, NULL,
+                                         G_VARIANT_TYPE (reply_type),
+                                         G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+    if (reply == NULL)
+        bench_fail (error->message);
+
+    return reply;
+}
+
+
+
+static void
+bench_xfconf_call (const gchar *method,
+                   GVariant    *parameters)
+{
+    GVariant *reply;
+    GError   *error = NULL;
+
+    reply = g_dbus_connection_call_sync (bus, "org.xfce.Xfconf", "/org/xfce/Xfconf",
+                                         "org.xfce.Xfconf", method, parameters,
+                                         NULL, G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+    if (reply == NULL)
+        bench_fail (error->message);
+
+    g_variant_unref (reply);
+}
+
+
+
+static void
+bench_startup_report (void)
+{
+    GVariant     *reply;
+    GVariantIter *iter;
+    const gchar  *name;
+    gint64        offset, duration;
+
+    reply = bench_call ("GetStartupReport", "(a(sxx))");
+
+    g_variant_get (reply, "(a(sxx))", &iter);
+    while (g_variant_iter_next (iter, "(&sxx)", &name, &offset, &duration))
+        g_print ("  %-20s started at %8.3f ms in %8.3f ms\n",
+                 name, offset / 1000.0, duration / 1000.0);
+    g_variant_iter_free (iter);
+
+    g_variant_unref (reply);
+}
+
+
+
+static void
+bench_xsettings (guint n_switches)
+{
+    Window    owner;
+    Atom      atom_settings;
+    XEvent    xevent;
+    gchar    *theme;
+    gint64    start, elapsed;
+    gint64    total = 0, min = G_MAXINT64, max = 0;
+    guint     i;
+
+    owner = XGetSelectionOwner (display, XInternAtom (display, "_XSETTINGS_S0", False));
+    if (owner == None)
+        bench_fail ("no xsettings manager on screen 0");
+
+    atom_settings = XInternAtom (display, "_XSETTINGS_SETTINGS", False);
+    XSelectInput (display, owner, PropertyChangeMask);
+    XSync (display, False);
+
+    for (i = 0; i < n_switches; i++)
+    {
+        theme = g_strdup_printf ("Bench-%u", i % 2);
+        start = g_get_monotonic_time ();
+
+        bench_xfconf_call ("SetProperty",
+                           g_variant_new ("(ssv)", "xsettings", "/Net/ThemeName",
+                                          g_variant_new_string (theme)));
+        g_free (theme);
+
+        do
+        {
+            if (!bench_next_event (&xevent))
+                bench_fail ("timeout waiting for the xsettings property");
+        }
+        while (xevent.type != PropertyNotify
+               || xevent.xproperty.window != owner
+               || xevent.xproperty.atom != atom_settings);
+
+        elapsed = g_get_monotonic_time () - start;
+        total += elapsed;
+        min = MIN (min, elapsed);
+        max = MAX (max, elapsed);
+    }
+
+    if (n_switches > 0)
+        g_print ("  %u theme switches: min %.3f ms, avg %.3f ms, max %.3f ms\n",
+                 n_switches, min / 1000.0, total / 1000.0 / n_switches, max / 1000.0);
+}
+
+
+
+static void
+bench_clipboard_payload (gsize length)
+{
+    GString *text;
+    guint    line = 0;
+
+    /* something like a log file */
+    text = g_string_sized_new (length + 128);
+    while (text->len < length)
+    {
+        g_string_append_printf (text, "%08u xfsettingsd[%u]: clipboard benchmark line, "
+                                "the quick brown fox jumps over the lazy dog\n",
+                                line, line % 997);
+        line++;
+    }
+    g_string_truncate (text, length);
+
+    g_free (payload);
+    payload_len = text->len;
+    payload = g_string_free (text, FALSE);
+}
+
+
+
+static void
+bench_clipboard_start (BenchTransfer *transfer,
+                       Window         requestor,
+                       Atom           property)
+{
+    glong length = payload_len;
+
+    if (payload_len <= INCR_CHUNK_SIZE)
+    {
+        XChangeProperty (display, requestor, property, atom_utf8_string, 8,
+                         PropModeReplace, (guchar *) payload, payload_len);
+        return;
+    }
+
+    /* the requestor deleting the INCR property asks for the first chunk */
+    XSelectInput (display, requestor, PropertyChangeMask);
+    XChangeProperty (display, requestor, property, atom_incr, 32,
+                     PropModeReplace, (guchar *) &length, 1);
+
+    transfer->requestor = requestor;
+    transfer->property = property;
+    transfer->offset = 0;
+    transfer->active = TRUE;
+}
+
+
+
+static void
+bench_clipboard_next_chunk (BenchTransfer  *transfer,
+                            XPropertyEvent *xproperty)
+{
+    gsize length;
+
+    if (!transfer->active
+        || xproperty->state != PropertyDelete
+        || xproperty->window != transfer->requestor
+        || xproperty->atom != transfer->property)
+        return;
+
+    /* a zero length chunk ends the transfer */
+    length = MIN (INCR_CHUNK_SIZE, payload_len - transfer->offset);
+    XChangeProperty (display, transfer->requestor, transfer->property,
+                     atom_utf8_string, 8, PropModeReplace,
+                     (guchar *) payload + transfer->offset, length);
+    XFlush (display);
+
+    transfer->offset += length;
+    if (length == 0)
+        transfer->active = FALSE;
+}
+
+
+
+static void
+bench_clipboard_answer (BenchTransfer          *transfer,
+                        XSelectionRequestEvent *request)
+{
+    XSelectionEvent  notify;
+    Atom             targets[2];
+    Atom             type;
+    gint             format;
+    gulong           nitems, remaining, i;
+    Atom            *pairs = NULL;
+
+    notify.type = SelectionNotify;
+    notify.display = display;
+    notify.requestor = request->requestor;
+    notify.selection = request->selection;
+    notify.target = request->target;
+    notify.property = request->property;
+    notify.time = request->time;
+
+    if (request->selection != atom_clipboard)
+    {
+        notify.property = None;
+    }
+    else if (request->target == atom_targets)
+    {
+        targets[0] = atom_targets;
+        targets[1] = atom_utf8_string;
+        XChangeProperty (display, request->requestor, request->property,
+                         XA_ATOM, 32, PropModeReplace, (guchar *) targets, 2);
+    }
+    else if (request->target == atom_utf8_string)
+    {
+        bench_clipboard_start (transfer, request->requestor, request->property);
+    }
+    else if (request->target == atom_multiple)
+    {
+        /* the clipboard manager asks for all targets at once */
+        XGetWindowProperty (display, request->requestor, request->property,
+                            0, 0x1FFFFFFF, False, atom_atom_pair,
+                            &type, &format, &nitems, &remaining,
+                            (guchar **) &pairs);
+
+        for (i = 0; pairs != NULL && i + 1 < nitems; i += 2)
+        {
+            if (pairs[i] == atom_utf8_string)
+                bench_clipboard_start (transfer, request->requestor, pairs[i + 1]);
+            else
+                pairs[i + 1] = None;
+        }
+
+        if (pairs != NULL)
+        {
+            XChangeProperty (display, request->requestor, request->property,
+                             atom_atom_pair, 32, PropModeReplace,
+                             (guchar *) pairs, nitems);
+            XFree (pairs);
+        }
+    }
+    else
+    {
+        notify.property = None;
+    }
+
+    XSendEvent (display, request->requestor, False, NoEventMask, (XEvent *) &notify);
+    XFlush (display);
+}
+
+
+
+static void
+bench_clipboard_own (void)
+{
+    /* taking the clipboard makes the manager drop the previous contents */
+    XSetSelectionOwner (display, atom_clipboard, window, CurrentTime);
+    if (XGetSelectionOwner (display, atom_clipboard) != window)
+        bench_fail ("failed to own the clipboard");
+
+    /* a round trip to the daemon, so it handled the SelectionClear
+     * and the xfconf changes made before */
+    g_variant_unref (bench_call ("GetStartupReport", "(a(sxx))"));
+}
+
+
+
+static gint64
+bench_clipboard_save (void)
+{
+    BenchTransfer transfer = { None, None, 0, FALSE };
+    XEvent        xevent;
+    gint64        start;
+
+    XChangeProperty (display, window, atom_bench_save, XA_ATOM, 32,
+                     PropModeReplace, (guchar *) &atom_utf8_string, 1);
+
+    start = g_get_monotonic_time ();
+
+    XConvertSelection (display, atom_clipboard_manager, atom_save_targets,
+                       atom_bench_save, window, CurrentTime);
+    XFlush (display);
+
+    for (;;)
+    {
+        if (!bench_next_event (&xevent))
+            bench_fail ("timeout saving the clipboard");
+
+        if (xevent.type == SelectionRequest)
+        {
+            bench_clipboard_answer (&transfer, &xevent.xselectionrequest);
+        }
+        else if (xevent.type == PropertyNotify)
+        {
+            bench_clipboard_next_chunk (&transfer, &xevent.xproperty);
+        }
+        else if (xevent.type == SelectionNotify
+                 && xevent.xselection.selection == atom_clipboard_manager)
+        {
+            if (xevent.xselection.property == None)
+                bench_fail ("the clipboard manager did not save the clipboard");
+
+            return g_get_monotonic_time () - start;
+        }
+    }
+}
+
+
+
+static guint32
+bench_daemon_pid (void)
+{
+    static guint32  pid = 0;
+    GVariant       *reply;
+    GError         *error = NULL;
+
+    if (pid != 0)
+        return pid;
+
+    reply = g_dbus_connection_call_sync (bus, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+                                         "org.freedesktop.DBus", "GetConnectionUnixProcessID",
+                                         g_variant_new ("(s)", SETTINGS_DBUS_NAME),
+                                         G_VARIANT_TYPE ("(u)"), G_DBUS_CALL_FLAGS_NONE,
+                                         -1, NULL, &error);
+    if (reply == NULL)
+        bench_fail (error->message);
+
+    g_variant_get (reply, "(u)", &pid);
+    g_variant_unref (reply);
+
+    return pid;
+}
+
+
+
+/* start a new VmHWM for the daemon, fails on kernels before 4.0 */
+static gboolean
+bench_daemon_reset_peak (void)
+{
+    gchar    *path;
+    FILE     *fp;
+    gboolean  reset;
+
+    path = g_strdup_printf ("/proc/%u/clear_refs", bench_daemon_pid ());
+    fp = fopen (path, "w");
+    g_free (path);
+
+    if (fp == NULL)
+        return FALSE;
+
+    reset = fputs ("5\n", fp) >= 0;
+    reset = fclose (fp) == 0 && reset;
+
+    return reset;
+}
+
+
+
+/* a field of /proc/<pid>/status in kB */
+static guint64
+bench_daemon_status (const gchar *field)
+{
+    gchar   *path;
+    gchar   *contents = NULL;
+    gchar   *line;
+    guint64  kb = 0;
+
+    path = g_strdup_printf ("/proc/%u/status", bench_daemon_pid ());
+    if (g_file_get_contents (path, &contents, NULL, NULL))
+    {
+        line = strstr (contents, field);
+        if (line != NULL)
+            kb = g_ascii_strtoull (line + strlen (field), NULL, 10);
+    }
+    g_free (contents);
+    g_free (path);
+
+    return kb;
+}
+
+
+
+static gboolean
+bench_clipboard_compare (gsize   *offset,
+                         guchar  *data,
+                         gulong   length)
+{
+    gboolean equal;
+
+    equal = *offset + length <= payload_len
+            && memcmp (payload + *offset, data, length) == 0;
+    *offset += length;
+
+    return equal;
+}
+
+
+
+static gint64
+bench_clipboard_serve (void)
+{
+    XEvent    xevent;
+    Atom      type;
+    gint      format;
+    gulong    nitems, remaining;
+    guchar   *data;
+    gsize     offset = 0;
+    gboolean  equal;
+    gint64    start;
+
+    start = g_get_monotonic_time ();
+
+    XConvertSelection (display, atom_clipboard, atom_utf8_string,
+                       atom_bench_data, window, CurrentTime);
+    XFlush (display);
+
+    do
+    {
+        if (!bench_next_event (&xevent))
+            bench_fail ("timeout reading the clipboard");
+    }
+    while (xevent.type != SelectionNotify
+           || xevent.xselection.selection != atom_clipboard);
+
+    if (xevent.xselection.property == None)
+        bench_fail ("the clipboard manager did not serve the clipboard");
+
+    XGetWindowProperty (display, window, atom_bench_data, 0, 0x1FFFFFFF, True,
+                        AnyPropertyType, &type, &format, &nitems, &remaining, &data);
+
+    if (type != atom_incr)
+    {
+        equal = bench_clipboard_compare (&offset, data, nitems);
+        XFree (data);
+    }
+    else
+    {
+        XFree (data);
+
+        /* deleting the property above started the transfer */
+        for (equal = TRUE;;)
+        {
+            if (!bench_next_event (&xevent))
+                bench_fail ("timeout reading the clipboard");
+
+            if (xevent.type != PropertyNotify
+                || xevent.xproperty.state != PropertyNewValue
+                || xevent.xproperty.window != window
+                || xevent.xproperty.atom != atom_bench_data)
+                continue;
+
+            XGetWindowProperty (display, window, atom_bench_data, 0, 0x1FFFFFFF, True,
+                                AnyPropertyType, &type, &format, &nitems, &remaining, &data);
+            if (nitems == 0)
+            {
+                XFree (data);
+                break;
+            }
+
+            equal = bench_clipboard_compare (&offset, data, nitems) && equal;
+            XFree (data);
+        }
+    }
+
+    if (!equal || offset != payload_len)
+        bench_fail ("the clipboard manager served different contents");
+
+    return g_get_monotonic_time () - start;
+}
+
+
+
+/* bytes of the clipboard contents on the heap, compressed and spilled,
+ * returns FALSE while a worker still has to store the payload */
+static gboolean
+bench_clipboard_stored (guint64 *heap,
+                        guint64 *compressed,
+                        guint64 *spilled)
+{
+    GVariant     *reply;
+    GVariantIter *iter;
+    const gchar  *helper, *category;
+    guint64       n_objects, n_bytes;
+    gboolean      stored = FALSE;
+
+    *heap = *compressed = *spilled = 0;
+
+    reply = bench_call ("GetMemory", "(a(sstt))");
+
+    g_variant_get (reply, "(a(sstt))", &iter);
+    while (g_variant_iter_next (iter, "(&s&stt)", &helper, &category, &n_objects, &n_bytes))
+    {
+        if (strcmp (helper, "clipboard") != 0)
+            continue;
+
+        if (strcmp (category, "contents") == 0)
+        {
+            *heap = n_bytes;
+        }
+        else if (strcmp (category, "contents-compressed") == 0)
+        {
+            *compressed = n_bytes;
+            stored = stored || n_objects > 0;
+        }
+        else if (strcmp (category, "contents-spilled") == 0)
+        {
+            *spilled = n_bytes;
+            stored = stored || n_objects > 0;
+        }
+    }
+    g_variant_iter_free (iter);
+    g_variant_unref (reply);
+
+    return stored;
+}
+
+
+
+static void
+bench_clipboard_run (guint64  size,
+                     gboolean compress)
+{
+    gint64   save_time, store_time, serve_time, start;
+    guint64  rss, rss_saved, save_peak, serve_peak;
+    guint64  heap, compressed, spilled;
+    gboolean reset, stored;
+
+    /* 0 disables compression, the default enables it */
+    if (compress)
+        bench_xfconf_call ("ResetProperty",
+                           g_variant_new ("(ssb)", "xfsettingsd", "/Clipboard/CompressThreshold", FALSE));
+    else
+        bench_xfconf_call ("SetProperty",
+                           g_variant_new ("(ssv)", "xfsettingsd", "/Clipboard/CompressThreshold",
+                                          g_variant_new_int32 (0)));
+
+    bench_clipboard_own ();
+
+    reset = bench_daemon_reset_peak ();
+    rss = bench_daemon_status ("VmRSS:");
+    save_time = bench_clipboard_save ();
+
+    /* compressing and spilling happen in a worker after the save */
+    start = g_get_monotonic_time ();
+    while (!(stored = bench_clipboard_stored (&heap, &compressed, &spilled))
+           && g_get_monotonic_time () - start < STORE_TIMEOUT * 1000)
+        g_usleep (1000);
+    store_time = g_get_monotonic_time () - start;
+    save_peak = bench_daemon_status ("VmHWM:");
+
+    reset = bench_daemon_reset_peak () && reset;
+    rss_saved = bench_daemon_status ("VmRSS:");
+    serve_time = bench_clipboard_serve ();
+    serve_peak = bench_daemon_status ("VmHWM:");
+
+    g_print ("  %4" G_GUINT64_FORMAT " MB %-10s receive %9.3f ms, peak %+7.1f MB, "
+             "kept %+7.1f MB; serve %9.3f ms, peak %+7.1f MB%s\n",
+             size, compress ? "compressed" : "raw", save_time / 1000.0,
+             ((gint64) save_peak - (gint64) rss) / 1024.0,
+             ((gint64) rss_saved - (gint64) rss) / 1024.0,
+             serve_time / 1000.0,
+             ((gint64) serve_peak - (gint64) rss_saved) / 1024.0,
+             reset ? "" : " (peak since the daemon started)");
+
+    if (stored)
+        g_print ("                     stored %" G_GUINT64_FORMAT " of %" G_GSIZE_FORMAT " bytes "
+                 "(%.1f%%; %" G_GUINT64_FORMAT " compressed, %" G_GUINT64_FORMAT " spilled) "
+                 "%.3f ms after the save\n",
+                 compressed > 0 ? compressed : spilled, payload_len,
+                 100.0 * (compressed > 0 ? compressed : spilled) / payload_len,
+                 compressed, spilled, store_time / 1000.0);
+    else
+        g_print ("                     kept on the heap (%" G_GUINT64_FORMAT " bytes)\n", heap);
+}
+
+
+
+static void
+bench_clipboard (gchar **sizes)
+{
+    guint64 size;
+    guint   i;
+
+    for (i = 0; sizes[i] != NULL; i++)
+    {
+        size = g_ascii_strtoull (sizes[i], NULL, 10);
+        bench_clipboard_payload (size * 1024 * 1024);
+
+        bench_clipboard_run (size, FALSE);
+        bench_clipboard_run (size, TRUE);
+    }
+
+    /* leave the default behind */
+    bench_xfconf_call ("ResetProperty",
+                       g_variant_new ("(ssb)", "xfsettingsd", "/Clipboard/CompressThreshold", FALSE));
+}
+
+
+
+static void
+bench_metrics (void)
+{
+    GVariant     *reply;
+    GVariantIter *iter;
+    GVariant     *dict;
+    const gchar  *name;
+    guint64       changes, applied, discarded, samples, total, max;
+    guint64       n_stalls;
+    gint64        max_stall;
+
+    reply = bench_call ("GetHelperMetrics", "(a{sa{sv}})");
+
+    g_variant_get (reply, "(a{sa{sv}})", &iter);
+    while (g_variant_iter_next (iter, "{&s@a{sv}}", &name, &dict))
+    {
+        g_variant_lookup (dict, "changes", "t", &changes);
+        g_variant_lookup (dict, "applied", "t", &applied);
+        g_variant_lookup (dict, "discarded", "t", &discarded);
+        g_variant_lookup (dict, "samples", "t", &samples);
+        g_variant_lookup (dict, "latency-total-usec", "t", &total);
+        g_variant_lookup (dict, "latency-max-usec", "t", &max);
+        g_variant_unref (dict);
+
+        if (changes == 0)
+            continue;
+
+        g_print ("  %-20s %6" G_GUINT64_FORMAT " changes, %6" G_GUINT64_FORMAT " applied, "
+                 "%6" G_GUINT64_FORMAT " discarded, latency avg %8.3f ms, max %8.3f ms\n",
+                 name, changes, applied, discarded,
+                 samples > 0 ? total / 1000.0 / samples : 0.0, max / 1000.0);
+    }
+    g_variant_iter_free (iter);
+    g_variant_unref (reply);
+
+    reply = bench_call ("GetStalls", "(a(stx)a(xxss))");
+
+    g_variant_get (reply, "(a(stx)a(xxss))", &iter, NULL);
+    while (g_variant_iter_next (iter, "(&stx)", &name, &n_stalls, &max_stall))
+        g_print ("  %-20s %6" G_GUINT64_FORMAT " stalls, max %8.3f ms\n",
+                 name, n_stalls, max_stall / 1000.0);
+    g_variant_iter_free (iter);
+    g_variant_unref (reply);
+}
+
+
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+    GError *error = NULL;
+
+    if (argc < 2)
+    {
+        g_printerr ("usage: %s startup-report | xsettings N | clipboard MB... | metrics\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bus = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, &error);
+    if (bus == NULL)
+        bench_fail (error->message);
+
+    display = XOpenDisplay (NULL);
+    if (display == NULL)
+        bench_fail ("failed to open the display");
+
+    XSetErrorHandler (bench_x_error);
+
+    window = XCreateSimpleWindow (display, DefaultRootWindow (display),
+                                  0, 0, 1, 1, 0, 0, 0);
+    XSelectInput (display, window, PropertyChangeMask);
+
+    atom_clipboard = XInternAtom (display, "CLIPBOARD", False);
+    atom_clipboard_manager = XInternAtom (display, "CLIPBOARD_MANAGER", False);
+    atom_save_targets = XInternAtom (display, "SAVE_TARGETS", False);
+    atom_targets = XInternAtom (display, "TARGETS", False);
+    atom_multiple = XInternAtom (display, "MULTIPLE", False);
+    atom_atom_pair = XInternAtom (display, "ATOM_PAIR", False);
+    atom_incr = XInternAtom (display, "INCR", False);
+    atom_utf8_string = XInternAtom (display, "UTF8_STRING", False);
+    atom_bench_save = XInternAtom (display, "_XFSD_BENCH_SAVE", False);
+    atom_bench_data = XInternAtom (display, "_XFSD_BENCH_DATA", False);
+
+    if (strcmp (argv[1], "startup-report") == 0)
+        bench_startup_report ();
+    else if (strcmp (argv[1], "xsettings") == 0 && argc == 3)
+        bench_xsettings (strtoul (argv[2], NULL, 10));
+    else if (strcmp (argv[1], "clipboard") == 0)
+        bench_clipboard (argv + 2);
+    else if (strcmp (argv[1], "metrics") == 0)
+        bench_metrics ();
+    else
+        bench_fail ("unknown command");
+
+    g_free (payload);
+    XDestroyWindow (display, window);
+    XCloseDisplay (display);
+    g_object_unref (bus);
+
+    return EXIT_SUCCESS;
+}
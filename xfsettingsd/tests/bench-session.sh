@@ -0,0 +1,196 @@
+#!/bin/sh
+#
+# Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License along
+# with this program; if not, write to the Free Software Foundation, Inc.,
+# 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+#
+# Runs xfsettingsd under Xvfb with a private session bus and xfconfd, and
+# measures the startup, theme switches, an input device hotplug storm,
+# clipboard save and serve, and the xfconf to X propagation latency of
+# every helper. The settings live in a temporary directory, the
+# configuration of the user running it is not touched.
+#
+# Environment:
+#   XFSETTINGSD            daemon to run (default: ../xfsettingsd)
+#   BENCH_CLIENT           bench-client program (default: ./bench-client)
+#   XFCONFD                xfconfd, searched in the usual places if unset
+#   BENCH_RUNS             startup runs, theme switches and hotplugged
+#                          devices (default: 10)
+#   BENCH_CLIPBOARD_SIZES  clipboard sizes in MB (default: 1 50 200)
+#
+
+XFSETTINGSD=${XFSETTINGSD:-../xfsettingsd}
+BENCH_CLIENT=${BENCH_CLIENT:-./bench-client}
+BENCH_RUNS=${BENCH_RUNS:-10}
+BENCH_CLIPBOARD_SIZES=${BENCH_CLIPBOARD_SIZES:-1 50 200}
+
+skip ()
+{
+  echo "bench-session: $1, skipped"
+  exit 0
+}
+
+fail ()
+{
+  echo "bench-session: $1" >&2
+  exit 1
+}
+
+# wait until a name is owned on the session bus
+wait_name ()
+{
+  n=0
+  until gdbus call --session --dest org.freedesktop.DBus \
+          --object-path /org/freedesktop/DBus \
+          --method org.freedesktop.DBus.NameHasOwner "$1" 2>/dev/null \
+        | grep -q true; do
+    n=$((n + 1))
+    test $n -lt 100 || return 1
+    sleep 0.1
+  done
+}
+
+now_ms ()
+{
+  echo $(($(date +%s%N) / 1000000))
+}
+
+if test -z "$XFSD_BENCH_SESSION"; then
+  if test -z "$XFCONFD"; then
+    for path in /usr/lib/xfce4/xfconf/xfconfd \
+                /usr/lib/*/xfce4/xfconf/xfconfd \
+                /usr/libexec/xfce4/xfconf/xfconfd \
+                /usr/local/lib/xfce4/xfconf/xfconfd \
+                /usr/local/libexec/xfce4/xfconf/xfconfd; do
+      if test -x "$path"; then
+        XFCONFD=$path
+        break
+      fi
+    done
+  fi
+
+  type Xvfb >/dev/null 2>&1 || skip "Xvfb not found"
+  type dbus-run-session >/dev/null 2>&1 || skip "dbus-run-session not found"
+  type gdbus >/dev/null 2>&1 || skip "gdbus not found"
+  test -x "$XFCONFD" || skip "xfconfd not found, set XFCONFD"
+  test -x "$XFSETTINGSD" || fail "$XFSETTINGSD is not built"
+  test -x "$BENCH_CLIENT" || fail "$BENCH_CLIENT is not built"
+
+  # run again on a private session bus
+  XFSD_BENCH_SESSION=1
+  export XFSD_BENCH_SESSION XFCONFD XFSETTINGSD BENCH_CLIENT
+  exec dbus-run-session -- "$0" "$@"
+fi
+
+tmpdir=$(mktemp -d) || fail "failed to create a temporary directory"
+xvfb_pid=
+xfconfd_pid=
+xfsettingsd_pid=
+
+cleanup ()
+{
+  for pid in $xfsettingsd_pid $xfconfd_pid $xvfb_pid; do
+    kill $pid 2>/dev/null
+  done
+  wait 2>/dev/null
+  rm -rf "$tmpdir"
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+XDG_CONFIG_HOME=$tmpdir/config
+XDG_CACHE_HOME=$tmpdir/cache
+XDG_DATA_HOME=$tmpdir/data
+export XDG_CONFIG_HOME XDG_CACHE_HOME XDG_DATA_HOME
+mkdir -p "$XDG_CONFIG_HOME" "$XDG_CACHE_HOME" "$XDG_DATA_HOME"
+
+# let the server pick a free display
+Xvfb -displayfd 3 -screen 0 1280x1024x24 -nolisten tcp \
+  3>"$tmpdir/display" 2>"$tmpdir/xvfb.log" &
+xvfb_pid=$!
+n=0
+until test -s "$tmpdir/display"; do
+  n=$((n + 1))
+  test $n -lt 100 || fail "Xvfb did not start"
+  sleep 0.1
+done
+DISPLAY=:$(cat "$tmpdir/display")
+export DISPLAY
+
+"$XFCONFD" 2>"$tmpdir/xfconfd.log" &
+xfconfd_pid=$!
+wait_name org.xfce.Xfconf || fail "xfconfd did not start"
+
+echo "startup ($BENCH_RUNS runs, --quit-after-startup):"
+i=0
+while test $i -lt "$BENCH_RUNS"; do
+  "$XFSETTINGSD" --no-daemon --replace --quit-after-startup 2>&1 \
+    | sed -n 's/.*startup done in \([0-9.]*\) ms.*/\1/p'
+  i=$((i + 1))
+done | awk '
+  NR == 1 { first = $1; next }
+  { total += $1; if (min == "" || $1 < min) min = $1; if ($1 > max) max = $1 }
+  END {
+    if (NR == 0) { print "  no startup time reported"; exit 1 }
+    printf "  first run %.1f ms (no xfconf cache)\n", first
+    if (NR > 1)
+      printf "  cached runs min %.1f ms, avg %.1f ms, max %.1f ms\n", min, total / (NR - 1), max
+  }' || fail "xfsettingsd did not start"
+
+"$XFSETTINGSD" --no-daemon --replace 2>"$tmpdir/xfsettingsd.log" &
+xfsettingsd_pid=$!
+wait_name org.xfce.SettingsDaemon || fail "xfsettingsd did not start"
+
+# the helpers start one at a time from the main loop,
+# the clipboard manager is the last one
+n=0
+until "$BENCH_CLIENT" startup-report 2>/dev/null | grep -q clipboard; do
+  n=$((n + 1))
+  test $n -lt 100 || fail "xfsettingsd did not start all helpers"
+  sleep 0.1
+done
+
+echo "helper startup:"
+"$BENCH_CLIENT" startup-report || fail "startup report failed"
+
+echo "theme switch:"
+"$BENCH_CLIENT" xsettings "$BENCH_RUNS" || fail "theme switch failed"
+
+if type xinput >/dev/null 2>&1; then
+  echo "device hotplug storm:"
+  start=$(now_ms)
+  i=0
+  while test $i -lt "$BENCH_RUNS"; do
+    xinput create-master "xfsd-bench-$i" || fail "failed to add an input device"
+    xinput remove-master "xfsd-bench-$i pointer" || fail "failed to remove an input device"
+    i=$((i + 1))
+  done
+  echo "  $BENCH_RUNS devices added and removed in $(($(now_ms) - start)) ms"
+else
+  echo "device hotplug storm: xinput not found, skipped"
+fi
+
+echo "clipboard (incremental transfers, daemon RSS, raw and compressed):"
+"$BENCH_CLIENT" clipboard $BENCH_CLIPBOARD_SIZES || fail "clipboard transfer failed"
+
+if ! kill -0 $xfsettingsd_pid 2>/dev/null; then
+  tail "$tmpdir/xfsettingsd.log" >&2
+  fail "xfsettingsd died"
+fi
+
+echo "propagation latency and stalls:"
+"$BENCH_CLIENT" metrics || fail "metrics failed"
+
+exit 0
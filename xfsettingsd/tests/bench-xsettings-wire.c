@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Encode cost of the _XSETTINGS_SETTINGS property for 10, 100 and 1000
+ * settings. Measures encoding every record, the way the helper builds
+ * the property the first time, reusing the cached records and patching
+ * one integer, the way it publishes a change, and decoding. Runs without
+ * X; the iteration count can be passed as the first argument.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <glib.h>
+
+#include <xfsettingsd/xsettings-wire.h>
+
+
+
+typedef struct _BenchSetting BenchSetting;
+
+
+
+struct _BenchSetting
+{
+    gchar              *name;
+    gsize               name_len;
+    XSettingsWireValue  value;
+
+    /* cached record */
+    guchar             *record;
+    gsize               record_len;
+    gsize               value_offset;
+};
+
+
+
+static BenchSetting *
+bench_settings_new (guint n_settings)
+{
+    BenchSetting *settings;
+    guint         i;
+
+    settings = g_new0 (BenchSetting, n_settings);
+
+    /* the mix of types in a default session */
+    for (i = 0; i < n_settings; i++)
+    {
+        settings[i].name = g_strdup_printf ("Bench/Setting%u", i);
+        settings[i].name_len = strlen (settings[i].name);
+
+        switch (i % 4)
+        {
+            case 0:
+            case 1:
+                settings[i].value.type = XSETTINGS_WIRE_TYPE_INTEGER;
+                settings[i].value.data.v_int = i;
+                break;
+
+            case 2:
+                settings[i].value.type = XSETTINGS_WIRE_TYPE_STRING;
+                settings[i].value.data.v_string.str = "Adwaita-dark";
+                settings[i].value.data.v_string.len = 12;
+                break;
+
+            default:
+                settings[i].value.type = XSETTINGS_WIRE_TYPE_COLOR;
+                settings[i].value.data.v_color.red = i;
+                settings[i].value.data.v_color.alpha = 0xffff;
+                break;
+        }
+
+        settings[i].record_len = xsettings_wire_record_size (settings[i].name_len,
+                                                             &settings[i].value);
+        settings[i].record = g_malloc (settings[i].record_len);
+        xsettings_wire_encode_record (settings[i].record, settings[i].name,
+                                      settings[i].name_len, 0, &settings[i].value,
+                                      &settings[i].value_offset);
+    }
+
+    return settings;
+}
+
+
+
+static void
+bench_settings_free (BenchSetting *settings,
+                     guint         n_settings)
+{
+    guint i;
+
+    for (i = 0; i < n_settings; i++)
+    {
+        g_free (settings[i].name);
+        g_free (settings[i].record);
+    }
+
+    g_free (settings);
+}
+
+
+
+static gsize
+bench_encode (BenchSetting *settings,
+              guint         n_settings,
+              guchar       *buf,
+              guint32       serial)
+{
+    gsize offset = XSETTINGS_WIRE_HEADER_SIZE;
+    guint i;
+
+    xsettings_wire_encode_header (buf, serial, n_settings);
+
+    for (i = 0; i < n_settings; i++)
+        offset += xsettings_wire_encode_record (buf + offset, settings[i].name,
+                                                settings[i].name_len, serial,
+                                                &settings[i].value, NULL);
+
+    return offset;
+}
+
+
+
+static gsize
+bench_cached (BenchSetting *settings,
+              guint         n_settings,
+              guchar       *buf,
+              guint32       serial)
+{
+    gsize offset = XSETTINGS_WIRE_HEADER_SIZE;
+    guint i;
+
+    /* one setting changed, the other records are copied */
+    xsettings_wire_patch_int (settings[0].record, settings[0].value_offset, serial);
+
+    xsettings_wire_encode_header (buf, serial, n_settings);
+
+    for (i = 0; i < n_settings; i++)
+    {
+        memcpy (buf + offset, settings[i].record, settings[i].record_len);
+        offset += settings[i].record_len;
+    }
+
+    return offset;
+}
+
+
+
+static void
+bench_decode_func (const gchar              *name,
+                   gsize                     name_len,
+                   guint32                   last_change_serial,
+                   const XSettingsWireValue *value,
+                   gpointer                  user_data)
+{
+    guint *n_decoded = user_data;
+
+    (*n_decoded)++;
+}
+
+
+
+static void
+bench_run (guint n_settings,
+           guint n_iterations)
+{
+    BenchSetting *settings;
+    guchar       *buf;
+    gsize         size = XSETTINGS_WIRE_HEADER_SIZE;
+    gsize         len = 0;
+    gint64        start, encode, cached, decode;
+    guint         n_decoded = 0;
+    guint         i;
+
+    settings = bench_settings_new (n_settings);
+    for (i = 0; i < n_settings; i++)
+        size += settings[i].record_len;
+    buf = g_malloc (size);
+
+    start = g_get_monotonic_time ();
+    for (i = 0; i < n_iterations; i++)
+        len += bench_encode (settings, n_settings, buf, i);
+    encode = g_get_monotonic_time () - start;
+    g_assert (len == size * n_iterations);
+
+    start = g_get_monotonic_time ();
+    for (i = 0; i < n_iterations; i++)
+        len -= bench_cached (settings, n_settings, buf, i);
+    cached = g_get_monotonic_time () - start;
+    g_assert (len == 0);
+
+    start = g_get_monotonic_time ();
+    for (i = 0; i < n_iterations; i++)
+        xsettings_wire_decode (buf, size, NULL, bench_decode_func, &n_decoded);
+    decode = g_get_monotonic_time () - start;
+    g_assert (n_decoded == n_settings * n_iterations);
+
+    g_print ("%5u settings %7" G_GSIZE_FORMAT " bytes  "
+             "encode %9.3f us  cached %9.3f us  decode %9.3f us\n",
+             n_settings, size,
+             (gdouble) encode / n_iterations,
+             (gdouble) cached / n_iterations,
+             (gdouble) decode / n_iterations);
+
+    g_free (buf);
+    bench_settings_free (settings, n_settings);
+}
+
+
+
+int
+main (int    argc,
+      char **argv)
+{
+    guint n_iterations = 10000;
+
+    if (argc > 1)
+        n_iterations = MAX (atoi (argv[1]), 1);
+
+    bench_run (10, n_iterations);
+    bench_run (100, n_iterations);
+    bench_run (1000, n_iterations / 10 + 1);
+
+    return EXIT_SUCCESS;
+}
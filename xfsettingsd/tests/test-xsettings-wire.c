@@ -0,0 +1,379 @@
+/*
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Round-trip test of the _XSETTINGS_SETTINGS encoding: every setting
+ * type is encoded and decoded again, including the padding of names
+ * and strings, the serials, patched integers and properties written
+ * in the other byte order. Runs without X.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <glib.h>
+
+#include <xfsettingsd/xsettings-wire.h>
+
+
+
+typedef struct _TestSetting TestSetting;
+
+
+
+struct _TestSetting
+{
+    const gchar        *name;
+    guint32             serial;
+    XSettingsWireValue  value;
+};
+
+typedef struct
+{
+    const TestSetting *settings;
+    guint              n_settings;
+    guint              n_decoded;
+}
+TestDecode;
+
+
+
+static const TestSetting test_settings[] =
+{
+    /* names of every length modulo 4 */
+    { "Net/DoubleClickTime", 1, { XSETTINGS_WIRE_TYPE_INTEGER, { .v_int = 400 } } },
+    { "Xft/DPI", 2, { XSETTINGS_WIRE_TYPE_INTEGER, { .v_int = -1 } } },
+    { "Gtk/KeyThemeName", 3, { XSETTINGS_WIRE_TYPE_STRING, { .v_string = { "Emacs", 5 } } } },
+    { "Net/ThemeName", 4, { XSETTINGS_WIRE_TYPE_STRING, { .v_string = { "Adwaita", 7 } } } },
+    { "Xft/RGBA", 0xfffffffe, { XSETTINGS_WIRE_TYPE_STRING, { .v_string = { "rgb", 3 } } } },
+    { "Gtk/IMModule", 6, { XSETTINGS_WIRE_TYPE_STRING, { .v_string = { "", 0 } } } },
+    { "Gtk/FontName", 7, { XSETTINGS_WIRE_TYPE_STRING, { .v_string = { NULL, 0 } } } },
+    { "Gtk/ColorPalette", 8, { XSETTINGS_WIRE_TYPE_STRING, { .v_string = { "black:white", 11 } } } },
+    { "Test/Color", 9, { XSETTINGS_WIRE_TYPE_COLOR, { .v_color = { 0x1234, 0x5678, 0x9abc, 0xffff } } } },
+    { "X", 10, { XSETTINGS_WIRE_TYPE_COLOR, { .v_color = { 0, 0xffff, 1, 0 } } } }
+};
+
+
+
+static guchar *
+test_encode (const TestSetting *settings,
+             guint              n_settings,
+             guint32            serial,
+             gsize             *len,
+             gsize             *value_offsets)
+{
+    guchar *buf;
+    gsize   size = XSETTINGS_WIRE_HEADER_SIZE;
+    gsize   offset, record_len;
+    guint   i;
+
+    for (i = 0; i < n_settings; i++)
+        size += xsettings_wire_record_size (strlen (settings[i].name), &settings[i].value);
+
+    /* poison the buffer to find unwritten padding */
+    buf = g_malloc (size);
+    memset (buf, 0xaa, size);
+
+    xsettings_wire_encode_header (buf, serial, n_settings);
+
+    offset = XSETTINGS_WIRE_HEADER_SIZE;
+    for (i = 0; i < n_settings; i++)
+    {
+        record_len = xsettings_wire_encode_record (buf + offset, settings[i].name,
+                                                   strlen (settings[i].name),
+                                                   settings[i].serial,
+                                                   &settings[i].value,
+                                                   value_offsets != NULL ? &value_offsets[i] : NULL);
+        g_assert_cmpuint (record_len, ==,
+                          xsettings_wire_record_size (strlen (settings[i].name),
+                                                      &settings[i].value));
+        g_assert_cmpuint (record_len % 4, ==, 0);
+
+        if (value_offsets != NULL)
+            value_offsets[i] += offset;
+
+        offset += record_len;
+    }
+
+    g_assert_cmpuint (offset, ==, size);
+    *len = size;
+
+    return buf;
+}
+
+
+
+static void
+test_decode_func (const gchar              *name,
+                  gsize                     name_len,
+                  guint32                   last_change_serial,
+                  const XSettingsWireValue *value,
+                  gpointer                  user_data)
+{
+    TestDecode        *decode = user_data;
+    const TestSetting *setting;
+    gsize              expected_len;
+
+    g_assert_cmpuint (decode->n_decoded, <, decode->n_settings);
+    setting = &decode->settings[decode->n_decoded++];
+
+    g_assert_cmpuint (name_len, ==, strlen (setting->name));
+    g_assert (memcmp (name, setting->name, name_len) == 0);
+    g_assert_cmpuint (last_change_serial, ==, setting->serial);
+    g_assert_cmpint (value->type, ==, setting->value.type);
+
+    switch (value->type)
+    {
+        case XSETTINGS_WIRE_TYPE_INTEGER:
+            g_assert_cmpint (value->data.v_int, ==, setting->value.data.v_int);
+            break;
+
+        case XSETTINGS_WIRE_TYPE_STRING:
+            /* a NULL string is sent as an empty one */
+            expected_len = setting->value.data.v_string.str != NULL
+                           ? setting->value.data.v_string.len : 0;
+            g_assert_cmpuint (value->data.v_string.len, ==, expected_len);
+            g_assert (expected_len == 0
+                      || memcmp (value->data.v_string.str,
+                                 setting->value.data.v_string.str, expected_len) == 0);
+            break;
+
+        case XSETTINGS_WIRE_TYPE_COLOR:
+            g_assert_cmpuint (value->data.v_color.red, ==, setting->value.data.v_color.red);
+            g_assert_cmpuint (value->data.v_color.green, ==, setting->value.data.v_color.green);
+            g_assert_cmpuint (value->data.v_color.blue, ==, setting->value.data.v_color.blue);
+            g_assert_cmpuint (value->data.v_color.alpha, ==, setting->value.data.v_color.alpha);
+            break;
+
+        default:
+            g_assert_not_reached ();
+    }
+}
+
+
+
+static void
+test_round_trip (void)
+{
+    TestDecode  decode = { test_settings, G_N_ELEMENTS (test_settings), 0 };
+    guchar     *buf;
+    gsize       len;
+    guint32     serial = 0;
+
+    buf = test_encode (test_settings, G_N_ELEMENTS (test_settings), 42, &len, NULL);
+
+    g_assert (xsettings_wire_decode (buf, len, &serial, test_decode_func, &decode));
+    g_assert_cmpuint (serial, ==, 42);
+    g_assert_cmpuint (decode.n_decoded, ==, G_N_ELEMENTS (test_settings));
+
+    g_free (buf);
+}
+
+
+
+static void
+test_padding (void)
+{
+    const TestSetting *setting;
+    guchar            *buf, *record;
+    gsize              len, name_len, str_len, i;
+    guint              n;
+
+    buf = test_encode (test_settings, G_N_ELEMENTS (test_settings), 1, &len, NULL);
+
+    /* header: byte order and 3 unused bytes */
+    g_assert (buf[0] == 0 || buf[0] == 1);
+    g_assert_cmpuint (buf[1] | buf[2] | buf[3], ==, 0);
+
+    record = buf + XSETTINGS_WIRE_HEADER_SIZE;
+    for (n = 0; n < G_N_ELEMENTS (test_settings); n++)
+    {
+        setting = &test_settings[n];
+        name_len = strlen (setting->name);
+
+        /* unused byte after the type and the name padding */
+        g_assert_cmpuint (record[1], ==, 0);
+        for (i = name_len; i % 4 != 0; i++)
+            g_assert_cmpuint (record[4 + i], ==, 0);
+
+        if (setting->value.type == XSETTINGS_WIRE_TYPE_STRING
+            && setting->value.data.v_string.str != NULL)
+        {
+            str_len = setting->value.data.v_string.len;
+            for (i = str_len; i % 4 != 0; i++)
+                g_assert_cmpuint (record[4 + ((name_len + 3) & ~3) + 4 + 4 + i], ==, 0);
+        }
+
+        record += xsettings_wire_record_size (name_len, &setting->value);
+    }
+
+    g_assert (record == buf + len);
+
+    g_free (buf);
+}
+
+
+
+static void
+test_patch_int (void)
+{
+    TestSetting  patched[G_N_ELEMENTS (test_settings)];
+    TestDecode   decode = { patched, G_N_ELEMENTS (patched), 0 };
+    gsize        value_offsets[G_N_ELEMENTS (test_settings)];
+    guchar      *buf;
+    gsize        len;
+
+    memcpy (patched, test_settings, sizeof (patched));
+    buf = test_encode (patched, G_N_ELEMENTS (patched), 1, &len, value_offsets);
+
+    /* Xft/DPI, the way the helper updates the dpi in place */
+    g_assert_cmpint (patched[1].value.type, ==, XSETTINGS_WIRE_TYPE_INTEGER);
+    patched[1].value.data.v_int = 96 * 1024;
+    xsettings_wire_patch_int (buf, value_offsets[1], patched[1].value.data.v_int);
+
+    g_assert (xsettings_wire_decode (buf, len, NULL, test_decode_func, &decode));
+    g_assert_cmpuint (decode.n_decoded, ==, G_N_ELEMENTS (patched));
+
+    g_free (buf);
+}
+
+
+
+static void
+test_swap16 (guchar *buf)
+{
+    guint16 value;
+
+    memcpy (&value, buf, 2);
+    value = GUINT16_SWAP_LE_BE (value);
+    memcpy (buf, &value, 2);
+}
+
+
+
+static void
+test_swap32 (guchar *buf)
+{
+    guint32 value;
+
+    memcpy (&value, buf, 4);
+    value = GUINT32_SWAP_LE_BE (value);
+    memcpy (buf, &value, 4);
+}
+
+
+
+static void
+test_byte_order (void)
+{
+    TestDecode  decode = { test_settings, G_N_ELEMENTS (test_settings), 0 };
+    guchar     *buf, *record;
+    gsize       len, name_len, str_len;
+    guint32     serial = 0;
+    guint       n, i;
+
+    buf = test_encode (test_settings, G_N_ELEMENTS (test_settings), 0x01020304, &len, NULL);
+
+    /* rewrite the property as a host of the other byte order would */
+    buf[0] = !buf[0];
+    test_swap32 (buf + 4);
+    test_swap32 (buf + 8);
+
+    record = buf + XSETTINGS_WIRE_HEADER_SIZE;
+    for (n = 0; n < G_N_ELEMENTS (test_settings); n++)
+    {
+        name_len = strlen (test_settings[n].name);
+        test_swap16 (record + 2);
+        record += 4 + ((name_len + 3) & ~3);
+
+        test_swap32 (record);
+        record += 4;
+
+        switch (test_settings[n].value.type)
+        {
+            case XSETTINGS_WIRE_TYPE_INTEGER:
+                test_swap32 (record);
+                record += 4;
+                break;
+
+            case XSETTINGS_WIRE_TYPE_STRING:
+                str_len = test_settings[n].value.data.v_string.str != NULL
+                          ? test_settings[n].value.data.v_string.len : 0;
+                test_swap32 (record);
+                record += 4 + ((str_len + 3) & ~3);
+                break;
+
+            case XSETTINGS_WIRE_TYPE_COLOR:
+                for (i = 0; i < 4; i++)
+                    test_swap16 (record + i * 2);
+                record += 8;
+                break;
+        }
+    }
+
+    g_assert (xsettings_wire_decode (buf, len, &serial, test_decode_func, &decode));
+    g_assert_cmphex (serial, ==, 0x01020304);
+    g_assert_cmpuint (decode.n_decoded, ==, G_N_ELEMENTS (test_settings));
+
+    /* not a byte order */
+    buf[0] = 2;
+    g_assert (!xsettings_wire_decode (buf, len, NULL, NULL, NULL));
+
+    g_free (buf);
+}
+
+
+
+static void
+test_truncated (void)
+{
+    guchar *buf;
+    gsize   len, i;
+
+    buf = test_encode (test_settings, G_N_ELEMENTS (test_settings), 1, &len, NULL);
+
+    /* every prefix misses the end of a record */
+    for (i = 0; i < len; i++)
+        g_assert (!xsettings_wire_decode (buf, i, NULL, NULL, NULL));
+
+    g_assert (xsettings_wire_decode (buf, len, NULL, NULL, NULL));
+
+    g_free (buf);
+}
+
+
+
+int
+main (int    argc,
+      char **argv)
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/xsettings-wire/round-trip", test_round_trip);
+    g_test_add_func ("/xsettings-wire/padding", test_padding);
+    g_test_add_func ("/xsettings-wire/patch-int", test_patch_int);
+    g_test_add_func ("/xsettings-wire/byte-order", test_byte_order);
+    g_test_add_func ("/xsettings-wire/truncated", test_truncated);
+
+    return g_test_run ();
+}
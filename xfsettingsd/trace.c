@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Always-on event trace. Events are stored as fixed size binary records
+ * in a ring buffer, so recording is a clock read and a few stores and
+ * nothing is formatted until the buffer is dumped. The buffer is written
+ * to stderr on SIGUSR1 and can be fetched with the DumpTrace method of
+ * the metrics interface. Only the main thread records events.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "trace.h"
+#include "stall.h"
+
+/* number of records in the ring, must be a power of two */
+#define TRACE_SIZE 4096
+
+
+
+typedef struct _XfsdTraceRecord XfsdTraceRecord;
+
+
+
+struct _XfsdTraceRecord
+{
+    gint64  time;
+    guint32 arg;
+    guint8  helper;
+    guint8  event;
+};
+
+static const gchar *event_names[] =
+{
+    "x-event",
+    "xfconf-change",
+    "apply-start",
+    "apply-end"
+};
+
+G_STATIC_ASSERT (G_N_ELEMENTS (event_names) == XFSD_N_TRACE_EVENTS);
+G_STATIC_ASSERT ((TRACE_SIZE & (TRACE_SIZE - 1)) == 0);
+
+static XfsdTraceRecord trace_ring[TRACE_SIZE];
+
+/* total number of records written */
+static guint64         trace_count = 0;
+
+
+
+void
+xfsettings_trace (XfsdHelper     helper,
+                  XfsdTraceEvent event,
+                  guint32        arg)
+{
+    XfsdTraceRecord *record;
+
+    record = &trace_ring[trace_count++ & (TRACE_SIZE - 1)];
+    record->time = g_get_monotonic_time ();
+    record->arg = arg;
+    record->helper = helper;
+    record->event = event;
+
+    /* attribute a main loop stall to this helper */
+    xfsettings_stall_helper (helper);
+}
+
+
+
+void
+xfsettings_trace_property (XfsdHelper   helper,
+                           const gchar *property)
+{
+    /* the set of properties is small, so interning is fine */
+    xfsettings_trace (helper, XFSD_TRACE_XFCONF_CHANGE,
+                      property != NULL ? g_quark_from_string (property) : 0);
+}
+
+
+
+static gchar *
+xfsettings_trace_detail (const XfsdTraceRecord *record)
+{
+    const gchar *str;
+
+    switch (record->event)
+    {
+        case XFSD_TRACE_X_EVENT:
+            return g_strdup_printf ("type=%u", record->arg);
+
+        case XFSD_TRACE_XFCONF_CHANGE:
+            str = g_quark_to_string (record->arg);
+            return g_strdup (str != NULL ? str : "");
+
+        case XFSD_TRACE_APPLY_END:
+            return g_strdup_printf ("latency=%uus", record->arg);
+
+        default:
+            return g_strdup ("");
+    }
+}
+
+
+
+GVariant *
+xfsettings_trace_collect (void)
+{
+    GVariantBuilder        builder;
+    const XfsdTraceRecord *record;
+    guint64                n;
+    gchar                 *detail;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(xsss)"));
+
+    n = trace_count > TRACE_SIZE ? trace_count - TRACE_SIZE : 0;
+    for (; n < trace_count; n++)
+    {
+        record = &trace_ring[n & (TRACE_SIZE - 1)];
+        detail = xfsettings_trace_detail (record);
+
+        g_variant_builder_add (&builder, "(xsss)", record->time,
+                               xfsettings_metrics_helper_name (record->helper),
+                               event_names[record->event], detail);
+
+        g_free (detail);
+    }
+
+    return g_variant_builder_end (&builder);
+}
+
+
+
+void
+xfsettings_trace_dump (void)
+{
+    const XfsdTraceRecord *record;
+    guint64                n;
+    gint64                 now;
+    gchar                 *detail;
+
+    now = g_get_monotonic_time ();
+
+    n = trace_count > TRACE_SIZE ? trace_count - TRACE_SIZE : 0;
+
+    g_printerr (PACKAGE_NAME ": trace dump, %"G_GUINT64_FORMAT" of "
+                "%"G_GUINT64_FORMAT" events\n", trace_count - n, trace_count);
+
+    for (; n < trace_count; n++)
+    {
+        record = &trace_ring[n & (TRACE_SIZE - 1)];
+        detail = xfsettings_trace_detail (record);
+
+        g_printerr ("  %12.6f %-18s %-14s %s\n",
+                    (record->time - now) / (gdouble) G_USEC_PER_SEC,
+                    xfsettings_metrics_helper_name (record->helper),
+                    event_names[record->event], detail);
+
+        g_free (detail);
+    }
+}
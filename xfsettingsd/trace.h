@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <glib.h>
+
+#include "metrics.h"
+
+typedef enum
+{
+    XFSD_TRACE_X_EVENT,       /* arg: X event type */
+    XFSD_TRACE_XFCONF_CHANGE, /* arg: quark of the property name */
+    XFSD_TRACE_APPLY_START,   /* arg: unused */
+    XFSD_TRACE_APPLY_END,     /* arg: latency in usec since the change */
+
+    XFSD_N_TRACE_EVENTS
+}
+XfsdTraceEvent;
+
+void      xfsettings_trace          (XfsdHelper      helper,
+                                     XfsdTraceEvent  event,
+                                     guint32         arg);
+
+void      xfsettings_trace_property (XfsdHelper      helper,
+                                     const gchar    *property);
+
+GVariant *xfsettings_trace_collect  (void);
+
+void      xfsettings_trace_dump     (void);
+
+#endif /* !__TRACE_H__ */
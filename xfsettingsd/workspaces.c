@@ -34,6 +34,11 @@
 #endif
 
 #include "debug.h"
+#include "atoms.h"
+#include "metrics.h"
+#include "trace.h"
+#include "xstats.h"
+#include "dispatcher.h"
 #include "workspaces.h"
 
 #define WORKSPACES_CHANNEL    "xfwm4"
@@ -109,8 +114,8 @@ xfce_workspaces_helper_class_init(XfceWorkspacesHelperClass *klass)
     gobject_class->finalize = xfce_workspaces_helper_finalize;
 
 #ifdef GDK_WINDOWING_X11
-    atom_net_number_of_desktops = gdk_x11_get_xatom_by_name ("_NET_NUMBER_OF_DESKTOPS");
-    atom_net_desktop_names = gdk_x11_get_xatom_by_name ("_NET_DESKTOP_NAMES");
+    atom_net_number_of_desktops = xfsettings_atom (XFSD_ATOM_NET_NUMBER_OF_DESKTOPS);
+    atom_net_desktop_names = xfsettings_atom (XFSD_ATOM_NET_DESKTOP_NAMES);
 #endif
 }
 
@@ -127,7 +132,10 @@ xfce_workspaces_helper_init (XfceWorkspacesHelper *helper)
     root_window = gdk_get_default_root_window ();
     events = gdk_window_get_events (root_window);
     gdk_window_set_events (root_window, events | GDK_PROPERTY_CHANGE_MASK);
-    gdk_window_add_filter (root_window, xfce_workspaces_helper_filter_func, helper);
+    xfsettings_dispatcher_add_root_property (atom_net_number_of_desktops,
+                                             xfce_workspaces_helper_filter_func, helper);
+    xfsettings_dispatcher_add_root_property (atom_net_desktop_names,
+                                             xfce_workspaces_helper_filter_func, helper);
 
     xfce_workspaces_helper_set_names (helper, FALSE);
 
@@ -143,6 +151,8 @@ xfce_workspaces_helper_finalize (GObject *object)
 {
     XfceWorkspacesHelper *helper = XFCE_WORKSPACES_HELPER (object);
 
+    xfsettings_dispatcher_remove (xfce_workspaces_helper_filter_func, helper);
+
     g_signal_handlers_disconnect_by_func(G_OBJECT (helper->channel),
                                          G_CALLBACK (xfce_workspaces_helper_prop_changed),
                                          helper);
@@ -164,6 +174,10 @@ xfce_workspaces_helper_filter_func (GdkXEvent  *gdkxevent,
 
     if (xevent->type == PropertyNotify)
     {
+        if (xevent->xproperty.atom == atom_net_number_of_desktops
+            || xevent->xproperty.atom == atom_net_desktop_names)
+            xfsettings_trace (XFSD_HELPER_WORKSPACES, XFSD_TRACE_X_EVENT, xevent->type);
+
         if (xevent->xproperty.atom == atom_net_number_of_desktops)
         {
             /* new workspace was added or removed */
@@ -198,15 +212,16 @@ xfce_workspaces_helper_filter_func (GdkXEvent  *gdkxevent,
 static GPtrArray *
 xfce_workspaces_helper_get_names (void)
 {
-    gboolean     succeed;
-    GdkAtom      utf8_atom, type_returned;
-    gint         i, length, num;
-    GPtrArray   *names = NULL;
-    gchar       *data = NULL;
-    GValue      *val;
-    const gchar *p;
+    gboolean         succeed;
+    GdkAtom          utf8_atom, type_returned;
+    gint             i, length, num;
+    GPtrArray       *names = NULL;
+    gchar           *data = NULL;
+    GValue          *val;
+    const gchar     *p;
+    XfsdXStatsScope  xstats;
 
-    gdk_x11_display_error_trap_push (gdk_display_get_default ());
+    xfsettings_xstats_trap_push (&xstats, XFSD_HELPER_WORKSPACES, "get-names");
 
     utf8_atom = gdk_atom_intern_static_string ("UTF8_STRING");
     succeed = gdk_property_get (gdk_get_default_root_window (),
@@ -216,7 +231,7 @@ xfce_workspaces_helper_get_names (void)
                                 FALSE, &type_returned, NULL, &length,
                                 (guchar **) &data);
 
-    if (gdk_x11_display_error_trap_pop (gdk_display_get_default ()) == 0
+    if (xfsettings_xstats_trap_pop (&xstats) == 0
         && succeed
         && type_returned == utf8_atom
         && data != NULL
@@ -257,13 +272,14 @@ xfce_workspaces_helper_get_names (void)
 static guint
 xfce_workspaces_helper_get_count (void)
 {
-    guint     result = 0;
-    guchar   *data = NULL;
-    gboolean  succeed;
-    GdkAtom   cardinal_atom, type_returned;
-    gint      format_returned;
+    guint            result = 0;
+    guchar          *data = NULL;
+    gboolean         succeed;
+    GdkAtom          cardinal_atom, type_returned;
+    gint             format_returned;
+    XfsdXStatsScope  xstats;
 
-    gdk_x11_display_error_trap_push (gdk_display_get_default ());
+    xfsettings_xstats_trap_push (&xstats, XFSD_HELPER_WORKSPACES, "get-count");
 
     cardinal_atom = gdk_atom_intern_static_string ("CARDINAL");
     succeed = gdk_property_get (gdk_get_default_root_window (),
@@ -273,7 +289,7 @@ xfce_workspaces_helper_get_count (void)
                                 FALSE, &type_returned, &format_returned, NULL,
                                 &data);
 
-    if (gdk_x11_display_error_trap_pop (gdk_display_get_default ()) == 0
+    if (xfsettings_xstats_trap_pop (&xstats) == 0
         && succeed
         && data != NULL
         && type_returned == cardinal_atom
@@ -296,13 +312,14 @@ xfce_workspaces_helper_get_count (void)
 static void
 xfce_workspaces_helper_set_names_real (XfceWorkspacesHelper *helper)
 {
-    GString       *names_str;
-    guint          i;
-    guint          n_workspaces;
-    GPtrArray     *names, *existing_names;
-    GValue        *val;
-    gchar         *new_name;
-    const gchar   *name;
+    GString         *names_str;
+    guint            i;
+    guint            n_workspaces;
+    GPtrArray       *names, *existing_names;
+    GValue          *val;
+    gchar           *new_name;
+    const gchar     *name;
+    XfsdXStatsScope  xstats;
 
     g_return_if_fail (XFCE_IS_WORKSPACES_HELPER (helper));
 
@@ -346,7 +363,9 @@ xfce_workspaces_helper_set_names_real (XfceWorkspacesHelper *helper)
         g_get_current_time (&helper->timestamp);
         g_time_val_add (&helper->timestamp, G_USEC_PER_SEC);
 
-        gdk_x11_display_error_trap_push (gdk_display_get_default ());
+        xfsettings_trace (XFSD_HELPER_WORKSPACES, XFSD_TRACE_APPLY_START, 0);
+
+        xfsettings_xstats_trap_push (&xstats, XFSD_HELPER_WORKSPACES, "set-names");
 
         gdk_property_change (gdk_get_default_root_window (),
                              gdk_atom_intern_static_string ("_NET_DESKTOP_NAMES"),
@@ -355,9 +374,11 @@ xfce_workspaces_helper_set_names_real (XfceWorkspacesHelper *helper)
                              (guchar *) names_str->str,
                              names_str->len + 1);
 
-        if (gdk_x11_display_error_trap_pop (gdk_display_get_default ()) != 0)
+        if (xfsettings_xstats_trap_pop (&xstats) != 0)
             g_warning ("Failed to change _NET_DESKTOP_NAMES.");
 
+        xfsettings_metrics_applied (XFSD_HELPER_WORKSPACES);
+
         xfsettings_dbg (XFSD_DEBUG_WORKSPACES, "%d desktop names set from xfconf", i);
 
         g_string_free (names_str, TRUE);
@@ -586,9 +607,14 @@ xfce_workspaces_helper_prop_changed (XfconfChannel        *channel,
 {
     g_return_if_fail (XFCE_IS_WORKSPACES_HELPER (helper));
 
+    xfsettings_metrics_changed (XFSD_HELPER_WORKSPACES, property);
+
     if (helper->wait_for_wm_timeout_id == 0)
     {
         /* only set the names if the initial start is not running anymore */
         xfce_workspaces_helper_set_names (helper, TRUE);
     }
+
+    /* the names were not set, e.g. when new names were saved first */
+    xfsettings_metrics_discard (XFSD_HELPER_WORKSPACES);
 }
@@ -0,0 +1,451 @@
+/*
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * On-disk cache of xfconf channels, so the snapshot of a channel can be
+ * loaded at login without a GetAllProperties call to xfconfd.
+ *
+ * Each channel is stored in $XDG_CACHE_HOME/xfce4/xfsettingsd/ as
+ * <channel>.snapshot, a serialized GVariant of type (ua(sxtt)a{sv}):
+ *
+ *  - the format version;
+ *  - the stamp: path, mtime, size and inode of the channel xml file in
+ *    the user and system xfconf directories, -1 for a missing file;
+ *  - the properties, arrays are stored as av.
+ *
+ * The file is mapped and only used when the stamp matches the files on
+ * disk. xfconfd replaces the xml file on each save, so the inode changes
+ * even if the mtime and size do not. Changes xfconfd did not save yet are
+ * not covered by the stamp, the snapshot compares the cache with xfconfd
+ * after the startup. The format is plain GVariant so the dialogs can read
+ * the same files.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <glib-object.h>
+
+#include "xfconf-cache.h"
+#include "debug.h"
+
+#define CACHE_VERSION 1
+#define CACHE_TYPE    "(ua(sxtt)a{sv})"
+
+
+
+static gchar *
+xfsettings_cache_filename (const gchar *channel_name)
+{
+    gchar *basename;
+    gchar *filename;
+
+    basename = g_strconcat (channel_name, ".snapshot", NULL);
+    filename = g_build_filename (g_get_user_cache_dir (), "xfce4", "xfsettingsd",
+                                 basename, NULL);
+    g_free (basename);
+
+    return filename;
+}
+
+
+
+static void
+xfsettings_cache_stamp_file (GVariantBuilder *builder,
+                             const gchar     *config_dir,
+                             const gchar     *basename)
+{
+    gchar    *path;
+    GStatBuf  st;
+
+    path = g_build_filename (config_dir, "xfce4", "xfconf", "xfce-perchannel-xml",
+                             basename, NULL);
+
+    if (g_stat (path, &st) == 0)
+    {
+        g_variant_builder_add (builder, "(sxtt)", path, (gint64) st.st_mtime,
+                               (guint64) st.st_size, (guint64) st.st_ino);
+    }
+    else
+    {
+        g_variant_builder_add (builder, "(sxtt)", path, G_GINT64_CONSTANT (-1),
+                               G_GUINT64_CONSTANT (0), G_GUINT64_CONSTANT (0));
+    }
+
+    g_free (path);
+}
+
+
+
+static GVariant *
+xfsettings_cache_stamp (const gchar *channel_name)
+{
+    GVariantBuilder      builder;
+    const gchar * const *dirs;
+    gchar               *basename;
+    guint                i;
+
+    basename = g_strconcat (channel_name, ".xml", NULL);
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sxtt)"));
+
+    /* the user directory first, then the system directories, like xfconfd */
+    xfsettings_cache_stamp_file (&builder, g_get_user_config_dir (), basename);
+    dirs = g_get_system_config_dirs ();
+    for (i = 0; dirs[i] != NULL; i++)
+        xfsettings_cache_stamp_file (&builder, dirs[i], basename);
+
+    g_free (basename);
+
+    return g_variant_builder_end (&builder);
+}
+
+
+
+static GVariant *
+xfsettings_cache_value_to_variant (const GValue *value)
+{
+    GVariantBuilder  builder;
+    GPtrArray       *array;
+    GVariant        *variant;
+    guint            i;
+
+    switch (G_VALUE_TYPE (value))
+    {
+    case G_TYPE_BOOLEAN:
+        return g_variant_new_boolean (g_value_get_boolean (value));
+
+    case G_TYPE_INT:
+        return g_variant_new_int32 (g_value_get_int (value));
+
+    case G_TYPE_UINT:
+        return g_variant_new_uint32 (g_value_get_uint (value));
+
+    case G_TYPE_INT64:
+        return g_variant_new_int64 (g_value_get_int64 (value));
+
+    case G_TYPE_UINT64:
+        return g_variant_new_uint64 (g_value_get_uint64 (value));
+
+    case G_TYPE_UCHAR:
+        return g_variant_new_byte (g_value_get_uchar (value));
+
+    case G_TYPE_DOUBLE:
+        return g_variant_new_double (g_value_get_double (value));
+
+    case G_TYPE_STRING:
+        if (g_value_get_string (value) == NULL)
+            return NULL;
+        return g_variant_new_string (g_value_get_string (value));
+
+    default:
+        if (G_VALUE_TYPE (value) != G_TYPE_PTR_ARRAY)
+            return NULL;
+
+        array = g_value_get_boxed (value);
+        g_variant_builder_init (&builder, G_VARIANT_TYPE ("av"));
+        for (i = 0; array != NULL && i < array->len; i++)
+        {
+            variant = xfsettings_cache_value_to_variant (g_ptr_array_index (array, i));
+            if (variant == NULL)
+            {
+                g_variant_builder_clear (&builder);
+                return NULL;
+            }
+
+            g_variant_builder_add (&builder, "v", variant);
+        }
+
+        return g_variant_builder_end (&builder);
+    }
+}
+
+
+
+static void
+xfsettings_cache_value_free (gpointer data)
+{
+    GValue *value = data;
+
+    g_value_unset (value);
+    g_free (value);
+}
+
+
+
+static GValue *
+xfsettings_cache_value_from_variant (GVariant *variant)
+{
+    GValue       *value;
+    GPtrArray    *array;
+    GVariantIter  iter;
+    GVariant     *child;
+    GVariant     *boxed;
+    GValue       *item;
+
+    value = g_new0 (GValue, 1);
+
+    switch (g_variant_classify (variant))
+    {
+    case G_VARIANT_CLASS_BOOLEAN:
+        g_value_init (value, G_TYPE_BOOLEAN);
+        g_value_set_boolean (value, g_variant_get_boolean (variant));
+        break;
+
+    case G_VARIANT_CLASS_INT32:
+        g_value_init (value, G_TYPE_INT);
+        g_value_set_int (value, g_variant_get_int32 (variant));
+        break;
+
+    case G_VARIANT_CLASS_UINT32:
+        g_value_init (value, G_TYPE_UINT);
+        g_value_set_uint (value, g_variant_get_uint32 (variant));
+        break;
+
+    case G_VARIANT_CLASS_INT64:
+        g_value_init (value, G_TYPE_INT64);
+        g_value_set_int64 (value, g_variant_get_int64 (variant));
+        break;
+
+    case G_VARIANT_CLASS_UINT64:
+        g_value_init (value, G_TYPE_UINT64);
+        g_value_set_uint64 (value, g_variant_get_uint64 (variant));
+        break;
+
+    case G_VARIANT_CLASS_BYTE:
+        g_value_init (value, G_TYPE_UCHAR);
+        g_value_set_uchar (value, g_variant_get_byte (variant));
+        break;
+
+    case G_VARIANT_CLASS_DOUBLE:
+        g_value_init (value, G_TYPE_DOUBLE);
+        g_value_set_double (value, g_variant_get_double (variant));
+        break;
+
+    case G_VARIANT_CLASS_STRING:
+        g_value_init (value, G_TYPE_STRING);
+        g_value_set_string (value, g_variant_get_string (variant, NULL));
+        break;
+
+    case G_VARIANT_CLASS_ARRAY:
+        if (!g_variant_is_of_type (variant, G_VARIANT_TYPE ("av")))
+            goto unsupported;
+
+        /* same layout as the arrays of xfconf */
+        array = g_ptr_array_new_with_free_func (xfsettings_cache_value_free);
+        g_variant_iter_init (&iter, variant);
+        while ((boxed = g_variant_iter_next_value (&iter)) != NULL)
+        {
+            child = g_variant_get_variant (boxed);
+            item = xfsettings_cache_value_from_variant (child);
+            g_variant_unref (child);
+            g_variant_unref (boxed);
+
+            if (item == NULL)
+            {
+                g_ptr_array_unref (array);
+                goto unsupported;
+            }
+
+            g_ptr_array_add (array, item);
+        }
+
+        g_value_init (value, G_TYPE_PTR_ARRAY);
+        g_value_take_boxed (value, array);
+        break;
+
+    default:
+        goto unsupported;
+    }
+
+    return value;
+
+unsupported:
+    g_free (value);
+
+    return NULL;
+}
+
+
+
+GHashTable *
+xfsettings_cache_load (const gchar *channel_name)
+{
+    gchar        *filename;
+    GMappedFile  *mapped;
+    GBytes       *bytes;
+    GVariant     *cache;
+    GVariant     *stamp, *current;
+    GVariant     *props;
+    GVariantIter  iter;
+    const gchar  *name;
+    GVariant     *variant;
+    GValue       *value;
+    GHashTable   *values = NULL;
+    guint32       version;
+
+    g_return_val_if_fail (channel_name != NULL, NULL);
+
+    filename = xfsettings_cache_filename (channel_name);
+    mapped = g_mapped_file_new (filename, FALSE, NULL);
+    g_free (filename);
+
+    if (mapped == NULL)
+        return NULL;
+
+    bytes = g_mapped_file_get_bytes (mapped);
+    g_mapped_file_unref (mapped);
+
+    /* not trusted, a corrupt file results in default values */
+    cache = g_variant_new_from_bytes (G_VARIANT_TYPE (CACHE_TYPE), bytes, FALSE);
+    g_variant_ref_sink (cache);
+    g_bytes_unref (bytes);
+
+    g_variant_get (cache, "(u@a(sxtt)@a{sv})", &version, &stamp, &props);
+
+    current = xfsettings_cache_stamp (channel_name);
+    g_variant_ref_sink (current);
+
+    if (version == CACHE_VERSION && g_variant_equal (stamp, current))
+    {
+        values = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                        g_free, xfsettings_cache_value_free);
+
+        g_variant_iter_init (&iter, props);
+        while (g_variant_iter_next (&iter, "{&sv}", &name, &variant))
+        {
+            value = xfsettings_cache_value_from_variant (variant);
+            g_variant_unref (variant);
+
+            if (G_UNLIKELY (value == NULL))
+            {
+                /* we never write those */
+                g_hash_table_destroy (values);
+                values = NULL;
+                break;
+            }
+
+            g_hash_table_insert (values, g_strdup (name), value);
+        }
+    }
+    else
+    {
+        xfsettings_dbg (XFSD_DEBUG_XFCONF, "cache of channel \"%s\" is outdated",
+                        channel_name);
+    }
+
+    g_variant_unref (current);
+    g_variant_unref (stamp);
+    g_variant_unref (props);
+    g_variant_unref (cache);
+
+    return values;
+}
+
+
+
+void
+xfsettings_cache_save (const gchar *channel_name,
+                       GHashTable  *values)
+{
+    GVariantBuilder  builder;
+    GHashTableIter   iter;
+    gpointer         key, value;
+    GVariant        *variant;
+    GVariant        *cache;
+    gchar           *filename;
+    gchar           *dirname;
+    GError          *error = NULL;
+
+    g_return_if_fail (channel_name != NULL);
+    g_return_if_fail (values != NULL);
+
+    filename = xfsettings_cache_filename (channel_name);
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+    g_hash_table_iter_init (&iter, values);
+    while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+        variant = xfsettings_cache_value_to_variant (value);
+        if (variant == NULL)
+        {
+            /* a type we cannot store, do not leave an old cache around */
+            g_variant_builder_clear (&builder);
+            g_unlink (filename);
+            g_free (filename);
+
+            return;
+        }
+
+        g_variant_builder_add (&builder, "{sv}", key, variant);
+    }
+
+    cache = g_variant_new ("(u@a(sxtt)@a{sv})", CACHE_VERSION,
+                           xfsettings_cache_stamp (channel_name),
+                           g_variant_builder_end (&builder));
+    g_variant_ref_sink (cache);
+
+    dirname = g_path_get_dirname (filename);
+    if (g_mkdir_with_parents (dirname, 0700) == -1)
+    {
+        xfsettings_dbg (XFSD_DEBUG_XFCONF, "failed to create cache directory %s",
+                        dirname);
+    }
+    else if (!g_file_set_contents (filename, g_variant_get_data (cache),
+                                   g_variant_get_size (cache), &error))
+    {
+        xfsettings_dbg (XFSD_DEBUG_XFCONF, "failed to write cache of channel \"%s\": %s",
+                        channel_name, error->message);
+        g_error_free (error);
+    }
+
+    g_free (dirname);
+    g_free (filename);
+    g_variant_unref (cache);
+}
+
+
+
+gboolean
+xfsettings_cache_value_equal (const GValue *a,
+                              const GValue *b)
+{
+    GVariant *va, *vb;
+    gboolean  equal;
+
+    if (G_VALUE_TYPE (a) != G_VALUE_TYPE (b))
+        return FALSE;
+
+    va = xfsettings_cache_value_to_variant (a);
+    vb = xfsettings_cache_value_to_variant (b);
+
+    if (va != NULL && vb != NULL)
+        equal = g_variant_equal (va, vb);
+    else
+        equal = FALSE;
+
+    if (va != NULL)
+        g_variant_unref (g_variant_ref_sink (va));
+    if (vb != NULL)
+        g_variant_unref (g_variant_ref_sink (vb));
+
+    return equal;
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __XFCONF_CACHE_H__
+#define __XFCONF_CACHE_H__
+
+#include <glib.h>
+#include <glib-object.h>
+
+GHashTable *xfsettings_cache_load        (const gchar  *channel_name);
+
+void        xfsettings_cache_save        (const gchar  *channel_name,
+                                          GHashTable   *values);
+
+gboolean    xfsettings_cache_value_equal (const GValue *a,
+                                          const GValue *b);
+
+#endif /* !__XFCONF_CACHE_H__ */
@@ -0,0 +1,477 @@
+/*
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Local copy of the xfconf channels used by the helpers. A channel is
+ * loaded with a single GetAllProperties call the first time it is used
+ * and kept up to date from the property-changed signal, so reading a
+ * setting does not cost a round trip to xfconfd.
+ *
+ * Helpers should get their channel with xfsettings_snapshot_channel()
+ * before connecting to property-changed: the snapshot handler then runs
+ * first and the helper handlers read the new values.
+ *
+ * If the on-disk cache of a channel is valid, the channel is loaded from
+ * it instead. Once the main loop is idle the cache is compared with
+ * xfconfd, and property-changed is emitted for the properties that
+ * differ, so the helpers apply changes xfconfd did not save yet; the
+ * cache is then rewritten so the next startup does not apply them again.
+ *
+ * The cache only takes the GetAllProperties round trips out of the
+ * startup of the helpers. Channels are still opened after xfconf_init()
+ * and the daemon name is acquired, so nothing is applied before the
+ * session bus is up, and the comparison still fetches every cached
+ * channel from xfconfd, only later and at low priority.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <glib.h>
+#include <glib-object.h>
+#include <xfconf/xfconf.h>
+
+#include "xfconf-snapshot.h"
+#include "xfconf-cache.h"
+#include "debug.h"
+
+
+
+typedef struct _XfsdSnapshot XfsdSnapshot;
+
+
+
+struct _XfsdSnapshot
+{
+    XfconfChannel *channel;
+
+    /* property name -> GValue */
+    GHashTable    *values;
+
+    /* compare a channel loaded from the cache with xfconfd */
+    guint          verify_id;
+};
+
+/* XfconfChannel -> XfsdSnapshot */
+static GHashTable *snapshots = NULL;
+
+
+
+static void
+xfsettings_snapshot_value_free (gpointer data)
+{
+    GValue *value = data;
+
+    g_value_unset (value);
+    g_free (value);
+}
+
+
+
+static gboolean
+xfsettings_snapshot_value_steal (gpointer key,
+                                 gpointer value,
+                                 gpointer data)
+{
+    /* the table takes ownership of the name and value */
+    g_hash_table_insert (data, key, value);
+
+    return TRUE;
+}
+
+
+
+static void
+xfsettings_snapshot_property_changed (XfconfChannel *channel,
+                                      const gchar   *property,
+                                      const GValue  *value,
+                                      XfsdSnapshot  *snapshot)
+{
+    GValue *copy;
+
+    if (value == NULL || G_VALUE_TYPE (value) == G_TYPE_INVALID)
+    {
+        /* the property was reset */
+        g_hash_table_remove (snapshot->values, property);
+        return;
+    }
+
+    copy = g_new0 (GValue, 1);
+    g_value_init (copy, G_VALUE_TYPE (value));
+    g_value_copy (value, copy);
+
+    g_hash_table_replace (snapshot->values, g_strdup (property), copy);
+}
+
+
+
+static void
+xfsettings_snapshot_free (gpointer data)
+{
+    XfsdSnapshot *snapshot = data;
+
+    if (snapshot->verify_id != 0)
+        g_source_remove (snapshot->verify_id);
+
+    g_signal_handlers_disconnect_by_func (G_OBJECT (snapshot->channel),
+        G_CALLBACK (xfsettings_snapshot_property_changed), snapshot);
+
+    g_hash_table_destroy (snapshot->values);
+    g_slice_free (XfsdSnapshot, snapshot);
+}
+
+
+
+static void
+xfsettings_snapshot_emit (XfsdSnapshot *snapshot,
+                          const gchar  *property,
+                          const GValue *value)
+{
+    gchar *signal_name;
+
+    /* as if xfconfd reported the change, the snapshot handler
+     * updates the table and the helper handlers apply it */
+    signal_name = g_strconcat ("property-changed::", property, NULL);
+    g_signal_emit_by_name (G_OBJECT (snapshot->channel), signal_name, property, value);
+    g_free (signal_name);
+}
+
+
+
+static gboolean
+xfsettings_snapshot_verify (gpointer data)
+{
+    XfsdSnapshot   *snapshot = data;
+    GHashTable     *props;
+    GHashTableIter  iter;
+    gpointer        key, value;
+    const GValue   *cached;
+    GValue          reset = G_VALUE_INIT;
+    GPtrArray      *changed;
+    guint           i, n_changed;
+    gchar          *channel_name;
+
+    snapshot->verify_id = 0;
+
+    /* this also returns NULL if the call to xfconfd failed, so an
+     * empty channel cannot be told apart; keep the cached values */
+    props = xfconf_channel_get_properties (snapshot->channel, NULL);
+    if (G_UNLIKELY (props == NULL))
+    {
+        xfsettings_dbg (XFSD_DEBUG_XFCONF, "failed to verify the cache, no properties returned");
+        return FALSE;
+    }
+
+    /* properties that were reset since the cache was written */
+    changed = g_ptr_array_new_with_free_func (g_free);
+    g_hash_table_iter_init (&iter, snapshot->values);
+    while (g_hash_table_iter_next (&iter, &key, NULL))
+        if (!g_hash_table_contains (props, key))
+            g_ptr_array_add (changed, g_strdup (key));
+
+    for (i = 0; i < changed->len; i++)
+        xfsettings_snapshot_emit (snapshot, g_ptr_array_index (changed, i), &reset);
+    n_changed = changed->len;
+    g_ptr_array_unref (changed);
+
+    g_hash_table_iter_init (&iter, props);
+    while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+        cached = g_hash_table_lookup (snapshot->values, key);
+        if (cached == NULL || !xfsettings_cache_value_equal (cached, value))
+        {
+            xfsettings_snapshot_emit (snapshot, key, value);
+            n_changed++;
+        }
+    }
+
+    g_hash_table_destroy (props);
+
+    xfsettings_dbg (XFSD_DEBUG_XFCONF, "%u properties changed since the cache was written",
+                    n_changed);
+
+    /* the emitted changes updated the table, write it out
+     * so the cache of the next startup is current again */
+    if (n_changed > 0)
+    {
+        g_object_get (G_OBJECT (snapshot->channel), "channel-name", &channel_name, NULL);
+        xfsettings_cache_save (channel_name, snapshot->values);
+        g_free (channel_name);
+    }
+
+    return FALSE;
+}
+
+
+
+static XfsdSnapshot *
+xfsettings_snapshot_get (XfconfChannel *channel)
+{
+    XfsdSnapshot *snapshot;
+    GHashTable   *props;
+    gchar        *channel_name;
+
+    if (G_UNLIKELY (snapshots == NULL))
+    {
+        snapshots = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                           NULL, xfsettings_snapshot_free);
+    }
+
+    snapshot = g_hash_table_lookup (snapshots, channel);
+    if (G_LIKELY (snapshot != NULL))
+        return snapshot;
+
+    snapshot = g_slice_new0 (XfsdSnapshot);
+    snapshot->channel = channel;
+
+    g_object_get (G_OBJECT (channel), "channel-name", &channel_name, NULL);
+
+    snapshot->values = xfsettings_cache_load (channel_name);
+    if (snapshot->values != NULL)
+    {
+        /* after the startup of the helpers */
+        snapshot->verify_id = g_idle_add_full (G_PRIORITY_LOW, xfsettings_snapshot_verify,
+                                               snapshot, NULL);
+    }
+    else
+    {
+        snapshot->values = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                  g_free, xfsettings_snapshot_value_free);
+
+        /* fetch the entire channel at once, only write the cache if
+         * xfconfd answered, a failed call also returns NULL */
+        props = xfconf_channel_get_properties (channel, NULL);
+        if (G_LIKELY (props != NULL))
+        {
+            g_hash_table_foreach_steal (props, xfsettings_snapshot_value_steal,
+                                        snapshot->values);
+            g_hash_table_destroy (props);
+
+            xfsettings_cache_save (channel_name, snapshot->values);
+        }
+    }
+
+    g_signal_connect (G_OBJECT (channel), "property-changed",
+        G_CALLBACK (xfsettings_snapshot_property_changed), snapshot);
+
+    g_hash_table_insert (snapshots, channel, snapshot);
+
+    xfsettings_dbg (XFSD_DEBUG_XFCONF, "loaded channel \"%s\" (%u properties%s)",
+                    channel_name, g_hash_table_size (snapshot->values),
+                    snapshot->verify_id != 0 ? ", cached" : "");
+    g_free (channel_name);
+
+    return snapshot;
+}
+
+
+
+static gboolean
+xfsettings_snapshot_lookup (XfconfChannel *channel,
+                            const gchar   *property,
+                            GValue        *dest)
+{
+    XfsdSnapshot *snapshot;
+    const GValue *value;
+
+    g_return_val_if_fail (XFCONF_IS_CHANNEL (channel), FALSE);
+    g_return_val_if_fail (property != NULL, FALSE);
+
+    snapshot = xfsettings_snapshot_get (channel);
+
+    value = g_hash_table_lookup (snapshot->values, property);
+    if (value == NULL)
+        return FALSE;
+
+    if (G_VALUE_TYPE (value) == G_VALUE_TYPE (dest))
+    {
+        g_value_copy (value, dest);
+        return TRUE;
+    }
+
+    /* stored types can differ from the requested
+     * one, e.g. an uint for an int setting */
+    return g_value_transform (value, dest);
+}
+
+
+
+XfconfChannel *
+xfsettings_snapshot_channel (const gchar *channel_name)
+{
+    XfconfChannel *channel;
+
+    g_return_val_if_fail (channel_name != NULL, NULL);
+
+    channel = xfconf_channel_get (channel_name);
+    xfsettings_snapshot_get (channel);
+
+    return channel;
+}
+
+
+
+gboolean
+xfsettings_snapshot_has_property (XfconfChannel *channel,
+                                  const gchar   *property)
+{
+    g_return_val_if_fail (XFCONF_IS_CHANNEL (channel), FALSE);
+    g_return_val_if_fail (property != NULL, FALSE);
+
+    return g_hash_table_contains (xfsettings_snapshot_get (channel)->values, property);
+}
+
+
+
+gboolean
+xfsettings_snapshot_get_bool (XfconfChannel *channel,
+                              const gchar   *property,
+                              gboolean       default_value)
+{
+    GValue   value = G_VALUE_INIT;
+    gboolean result = default_value;
+
+    g_value_init (&value, G_TYPE_BOOLEAN);
+    if (xfsettings_snapshot_lookup (channel, property, &value))
+        result = g_value_get_boolean (&value);
+    g_value_unset (&value);
+
+    return result;
+}
+
+
+
+gint32
+xfsettings_snapshot_get_int (XfconfChannel *channel,
+                             const gchar   *property,
+                             gint32         default_value)
+{
+    GValue value = G_VALUE_INIT;
+    gint32 result = default_value;
+
+    g_value_init (&value, G_TYPE_INT);
+    if (xfsettings_snapshot_lookup (channel, property, &value))
+        result = g_value_get_int (&value);
+    g_value_unset (&value);
+
+    return result;
+}
+
+
+
+gdouble
+xfsettings_snapshot_get_double (XfconfChannel *channel,
+                                const gchar   *property,
+                                gdouble        default_value)
+{
+    GValue  value = G_VALUE_INIT;
+    gdouble result = default_value;
+
+    g_value_init (&value, G_TYPE_DOUBLE);
+    if (xfsettings_snapshot_lookup (channel, property, &value))
+        result = g_value_get_double (&value);
+    g_value_unset (&value);
+
+    return result;
+}
+
+
+
+gchar *
+xfsettings_snapshot_get_string (XfconfChannel *channel,
+                                const gchar   *property,
+                                const gchar   *default_value)
+{
+    GValue  value = G_VALUE_INIT;
+    gchar  *result;
+
+    g_value_init (&value, G_TYPE_STRING);
+    if (xfsettings_snapshot_lookup (channel, property, &value))
+        result = g_value_dup_string (&value);
+    else
+        result = g_strdup (default_value);
+    g_value_unset (&value);
+
+    return result;
+}
+
+
+
+GHashTable *
+xfsettings_snapshot_get_properties (XfconfChannel *channel,
+                                    const gchar   *property_base)
+{
+    XfsdSnapshot   *snapshot;
+    GHashTable     *props = NULL;
+    GHashTableIter  iter;
+    gpointer        key, value;
+    GValue         *copy;
+    gsize           base_len = 0;
+    const gchar    *name;
+
+    g_return_val_if_fail (XFCONF_IS_CHANNEL (channel), NULL);
+
+    snapshot = xfsettings_snapshot_get (channel);
+
+    /* same as xfconf, NULL and "/" return the entire channel */
+    if (property_base != NULL && strcmp (property_base, "/") != 0)
+        base_len = strlen (property_base);
+
+    g_hash_table_iter_init (&iter, snapshot->values);
+    while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+        name = key;
+
+        if (base_len > 0
+            && (strncmp (name, property_base, base_len) != 0
+                || (name[base_len] != '\0' && name[base_len] != '/')))
+            continue;
+
+        if (props == NULL)
+        {
+            props = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                           g_free, xfsettings_snapshot_value_free);
+        }
+
+        copy = g_new0 (GValue, 1);
+        g_value_init (copy, G_VALUE_TYPE (value));
+        g_value_copy (value, copy);
+
+        g_hash_table_insert (props, g_strdup (name), copy);
+    }
+
+    /* NULL if nothing matched, like xfconf */
+    return props;
+}
+
+
+
+void
+xfsettings_snapshot_shutdown (void)
+{
+    if (snapshots != NULL)
+    {
+        g_hash_table_destroy (snapshots);
+        snapshots = NULL;
+    }
+}
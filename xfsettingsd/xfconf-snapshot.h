@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __XFCONF_SNAPSHOT_H__
+#define __XFCONF_SNAPSHOT_H__
+
+#include <glib.h>
+#include <xfconf/xfconf.h>
+
+XfconfChannel *xfsettings_snapshot_channel        (const gchar   *channel_name);
+
+gboolean       xfsettings_snapshot_has_property   (XfconfChannel *channel,
+                                                   const gchar   *property);
+
+gboolean       xfsettings_snapshot_get_bool       (XfconfChannel *channel,
+                                                   const gchar   *property,
+                                                   gboolean       default_value);
+
+gint32         xfsettings_snapshot_get_int        (XfconfChannel *channel,
+                                                   const gchar   *property,
+                                                   gint32         default_value);
+
+gdouble        xfsettings_snapshot_get_double     (XfconfChannel *channel,
+                                                   const gchar   *property,
+                                                   gdouble        default_value);
+
+gchar         *xfsettings_snapshot_get_string     (XfconfChannel *channel,
+                                                   const gchar   *property,
+                                                   const gchar   *default_value) G_GNUC_MALLOC;
+
+GHashTable    *xfsettings_snapshot_get_properties (XfconfChannel *channel,
+                                                   const gchar   *property_base);
+
+void           xfsettings_snapshot_shutdown       (void);
+
+#endif /* !__XFCONF_SNAPSHOT_H__ */
@@ -0,0 +1,416 @@
+/*
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Resident copy of the RESOURCE_MANAGER property on screen zero. The
+ * property is parsed into a list of lines with an index on the resource
+ * name, so updating a key does not require scanning the whole database.
+ * The property is only fetched again after another client changed it and
+ * only written back when the merged content differs.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+
+#include <glib.h>
+#include <gdk/gdk.h>
+#include <gdk/gdkx.h>
+
+#include "xresources.h"
+#include "dispatcher.h"
+#include "memory.h"
+#include "debug.h"
+
+
+
+struct _XfceXResources
+{
+    GdkDisplay *gdkdisplay;
+    GdkWindow  *root;
+    Display    *xdisplay;
+    Window      xroot;
+
+    /* lines of the database, without trailing newline */
+    GQueue      lines;
+
+    /* resource name -> GList link in lines */
+    GHashTable *index;
+
+    /* content of the property when last read or written */
+    gchar      *raw;
+    gsize       raw_len;
+
+    /* property changed on the server since the last read */
+    guint       stale : 1;
+
+    /* lines changed since the last commit */
+    guint       changed : 1;
+};
+
+
+
+static gchar *
+xfce_xresources_line_key (const gchar *line)
+{
+    const gchar *p;
+    const gchar *colon;
+
+    /* skip leading whitespace */
+    for (p = line; *p == ' ' || *p == '\t'; p++);
+
+    /* comments and includes have no key */
+    if (*p == '!' || *p == '#' || *p == '\0')
+        return NULL;
+
+    colon = strchr (p, ':');
+    if (colon == NULL)
+        return NULL;
+
+    return g_strstrip (g_strndup (p, colon - p));
+}
+
+
+
+static void
+xfce_xresources_clear (XfceXResources *resources)
+{
+    g_hash_table_remove_all (resources->index);
+    g_queue_foreach (&resources->lines, (GFunc) g_free, NULL);
+    g_queue_clear (&resources->lines);
+}
+
+
+
+static void
+xfce_xresources_parse (XfceXResources *resources)
+{
+    const gchar *p;
+    const gchar *end;
+    const gchar *eol;
+    gchar       *line;
+    gchar       *key;
+    GList       *link;
+
+    xfce_xresources_clear (resources);
+
+    if (resources->raw == NULL)
+        return;
+
+    p = resources->raw;
+    end = p + resources->raw_len;
+
+    while (p < end)
+    {
+        /* find the end of the logical line, lines ending with a
+         * backslash continue on the next line */
+        for (eol = p; eol < end; eol++)
+            if (*eol == '\n' && (eol == p || eol[-1] != '\\'))
+                break;
+
+        line = g_strndup (p, eol - p);
+        g_queue_push_tail (&resources->lines, line);
+
+        /* index the resource, later lines override earlier ones
+         * like the xrm database does */
+        key = xfce_xresources_line_key (line);
+        if (key != NULL)
+        {
+            link = g_queue_peek_tail_link (&resources->lines);
+            g_hash_table_replace (resources->index, key, link);
+        }
+
+        p = eol + 1;
+    }
+}
+
+
+
+static void
+xfce_xresources_sync (XfceXResources *resources)
+{
+    Atom    type;
+    gint    format;
+    gulong  n_items;
+    gulong  bytes_after;
+    guchar *data = NULL;
+    gint    result;
+
+    if (!resources->stale)
+        return;
+
+    resources->stale = FALSE;
+
+    /* XResourceManagerString only returns the value at the time the
+     * connection was opened, so read the property from the server */
+    gdk_x11_display_error_trap_push (resources->gdkdisplay);
+
+    result = XGetWindowProperty (resources->xdisplay, resources->xroot,
+                                 XA_RESOURCE_MANAGER, 0, G_MAXLONG, False,
+                                 XA_STRING, &type, &format, &n_items,
+                                 &bytes_after, &data);
+
+    if (gdk_x11_display_error_trap_pop (resources->gdkdisplay) != 0
+        || result != Success
+        || type != XA_STRING
+        || format != 8)
+    {
+        n_items = 0;
+    }
+
+    /* nothing to do if this is the content we wrote ourselves */
+    if (resources->raw != NULL
+        && resources->raw_len == n_items
+        && memcmp (resources->raw, data, n_items) == 0)
+    {
+        if (data != NULL)
+            XFree (data);
+        return;
+    }
+
+    g_free (resources->raw);
+    resources->raw = g_strndup ((const gchar *) data, n_items);
+    resources->raw_len = n_items;
+
+    if (data != NULL)
+        XFree (data);
+
+    xfce_xresources_parse (resources);
+
+    /* whatever we changed before is lost, the next commit
+     * has to write the keys again */
+    resources->changed = TRUE;
+
+    xfsettings_dbg (XFSD_DEBUG_XSETTINGS,
+                    "resource manager parsed (len=%"G_GSIZE_FORMAT", %u lines, %u keys)",
+                    resources->raw_len, resources->lines.length,
+                    g_hash_table_size (resources->index));
+}
+
+
+
+static GdkFilterReturn
+xfce_xresources_event_filter (GdkXEvent *gdkxevent,
+                              GdkEvent  *gdkevent,
+                              gpointer   data)
+{
+    XfceXResources *resources = data;
+    XEvent         *xevent = gdkxevent;
+
+    if (xevent->type == PropertyNotify
+        && xevent->xproperty.window == resources->xroot
+        && xevent->xproperty.atom == XA_RESOURCE_MANAGER)
+        resources->stale = TRUE;
+
+    return GDK_FILTER_CONTINUE;
+}
+
+
+
+XfceXResources *
+xfce_xresources_new (GdkDisplay *gdkdisplay)
+{
+    XfceXResources *resources;
+
+    g_return_val_if_fail (GDK_IS_DISPLAY (gdkdisplay), NULL);
+
+    resources = g_slice_new0 (XfceXResources);
+    resources->gdkdisplay = gdkdisplay;
+    resources->xdisplay = GDK_DISPLAY_XDISPLAY (gdkdisplay);
+    resources->root = gdk_screen_get_root_window (gdk_display_get_default_screen (gdkdisplay));
+    resources->xroot = GDK_WINDOW_XID (resources->root);
+    resources->index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    resources->stale = TRUE;
+    g_queue_init (&resources->lines);
+
+    /* watch for changes made by other clients */
+    gdk_window_set_events (resources->root,
+                           gdk_window_get_events (resources->root)
+                           | GDK_PROPERTY_CHANGE_MASK);
+    xfsettings_dispatcher_add_root_property (XA_RESOURCE_MANAGER,
+                                             xfce_xresources_event_filter, resources);
+
+    return resources;
+}
+
+
+
+void
+xfce_xresources_free (XfceXResources *resources)
+{
+    if (resources == NULL)
+        return;
+
+    xfsettings_dispatcher_remove (xfce_xresources_event_filter, resources);
+
+    xfce_xresources_clear (resources);
+    g_hash_table_destroy (resources->index);
+    g_free (resources->raw);
+
+    g_slice_free (XfceXResources, resources);
+}
+
+
+
+void
+xfce_xresources_set (XfceXResources *resources,
+                     const gchar    *key,
+                     const gchar    *value)
+{
+    GList *link;
+    gchar *line;
+
+    g_return_if_fail (resources != NULL);
+    g_return_if_fail (key != NULL && *key != '\0');
+
+    xfce_xresources_sync (resources);
+
+    link = g_hash_table_lookup (resources->index, key);
+
+    if (value == NULL)
+    {
+        /* remove the resource */
+        if (link != NULL)
+        {
+            g_free (link->data);
+            g_queue_delete_link (&resources->lines, link);
+            g_hash_table_remove (resources->index, key);
+            resources->changed = TRUE;
+        }
+
+        return;
+    }
+
+    line = g_strdup_printf ("%s:\t%s", key, value);
+
+    if (link != NULL)
+    {
+        if (strcmp (link->data, line) == 0)
+        {
+            g_free (line);
+            return;
+        }
+
+        g_free (link->data);
+        link->data = line;
+    }
+    else
+    {
+        g_queue_push_tail (&resources->lines, line);
+        link = g_queue_peek_tail_link (&resources->lines);
+        g_hash_table_insert (resources->index, g_strdup (key), link);
+    }
+
+    resources->changed = TRUE;
+}
+
+
+
+gboolean
+xfce_xresources_commit (XfceXResources *resources)
+{
+    GString *str;
+    GList   *li;
+
+    g_return_val_if_fail (resources != NULL, FALSE);
+
+    if (!resources->changed)
+        return FALSE;
+
+    resources->changed = FALSE;
+
+    str = g_string_sized_new (resources->raw_len + 128);
+    for (li = resources->lines.head; li != NULL; li = li->next)
+    {
+        g_string_append (str, li->data);
+        g_string_append_c (str, '\n');
+    }
+
+    /* nothing to write if the result matches the property */
+    if (resources->raw != NULL
+        && resources->raw_len == str->len
+        && memcmp (resources->raw, str->str, str->len) == 0)
+    {
+        g_string_free (str, TRUE);
+        return FALSE;
+    }
+
+    gdk_x11_display_error_trap_push (resources->gdkdisplay);
+
+    XChangeProperty (resources->xdisplay, resources->xroot,
+                     XA_RESOURCE_MANAGER, XA_STRING, 8,
+                     PropModeReplace,
+                     (guchar *) str->str, str->len);
+
+    if (gdk_x11_display_error_trap_pop (resources->gdkdisplay) != 0)
+    {
+        g_critical ("Failed to update the resource manager string");
+        g_string_free (str, TRUE);
+
+        /* read the property again before the next change */
+        resources->stale = TRUE;
+
+        return FALSE;
+    }
+
+    g_free (resources->raw);
+    resources->raw_len = str->len;
+    resources->raw = g_string_free (str, FALSE);
+
+    return TRUE;
+}
+
+
+
+void
+xfce_xresources_get_stats (XfceXResources *resources,
+                           guint          *n_lines,
+                           gsize          *size)
+{
+    GHashTableIter  iter;
+    gpointer        key;
+    GList          *li;
+    gsize           n_bytes;
+
+    g_return_if_fail (resources != NULL);
+
+    if (n_lines != NULL)
+        *n_lines = g_queue_get_length (&resources->lines);
+
+    if (size == NULL)
+        return;
+
+    n_bytes = sizeof (XfceXResources) + resources->raw_len;
+
+    for (li = resources->lines.head; li != NULL; li = li->next)
+        n_bytes += sizeof (GList) + strlen (li->data) + 1;
+
+    n_bytes += xfsettings_memory_hash_table_size (resources->index);
+    g_hash_table_iter_init (&iter, resources->index);
+    while (g_hash_table_iter_next (&iter, &key, NULL))
+        n_bytes += strlen (key) + 1;
+
+    *size = n_bytes;
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __XRESOURCES_H__
+#define __XRESOURCES_H__
+
+#include <gdk/gdk.h>
+
+typedef struct _XfceXResources XfceXResources;
+
+XfceXResources *xfce_xresources_new    (GdkDisplay     *gdkdisplay);
+
+void            xfce_xresources_free   (XfceXResources *resources);
+
+void            xfce_xresources_set    (XfceXResources *resources,
+                                        const gchar    *key,
+                                        const gchar    *value);
+
+gboolean        xfce_xresources_commit (XfceXResources *resources);
+
+void            xfce_xresources_get_stats (XfceXResources *resources,
+                                           guint          *n_lines,
+                                           gsize          *size);
+
+#endif /* !__XRESOURCES_H__ */
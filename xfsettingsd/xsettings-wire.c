@@ -0,0 +1,361 @@
+/*
+ * Copyright (c) 2008 Stephan Arts <stephan@xfce.org>
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Encoding and decoding of the _XSETTINGS_SETTINGS property, see
+ * http://standards.freedesktop.org/xsettings-spec/xsettings-spec-0.5.html
+ *
+ * This code does not depend on X or GObject, values are encoded in the
+ * byte order of the host, decoding handles both byte orders.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <glib.h>
+
+#include "xsettings-wire.h"
+
+#define XSETTINGS_PAD(n,m) ((n + m - 1) & (~(m-1)))
+
+/* same values as in X.h */
+#define XSETTINGS_LSB_FIRST 0
+#define XSETTINGS_MSB_FIRST 1
+
+
+
+static inline void
+xsettings_wire_put16 (guchar  *buf,
+                      guint16  value)
+{
+    memcpy (buf, &value, 2);
+}
+
+
+
+static inline void
+xsettings_wire_put32 (guchar  *buf,
+                      guint32  value)
+{
+    memcpy (buf, &value, 4);
+}
+
+
+
+static inline guint16
+xsettings_wire_get16 (const guchar *buf,
+                      gboolean      swap)
+{
+    guint16 value;
+
+    memcpy (&value, buf, 2);
+
+    return swap ? GUINT16_SWAP_LE_BE (value) : value;
+}
+
+
+
+static inline guint32
+xsettings_wire_get32 (const guchar *buf,
+                      gboolean      swap)
+{
+    guint32 value;
+
+    memcpy (&value, buf, 4);
+
+    return swap ? GUINT32_SWAP_LE_BE (value) : value;
+}
+
+
+
+gsize
+xsettings_wire_record_size (gsize                     name_len,
+                            const XSettingsWireValue *value)
+{
+    gsize len;
+
+    /* type, unused, name length, name and the serial */
+    len = 8 + XSETTINGS_PAD (name_len, 4);
+
+    switch (value->type)
+    {
+        case XSETTINGS_WIRE_TYPE_INTEGER:
+            return len + 4;
+
+        case XSETTINGS_WIRE_TYPE_STRING:
+            if (value->data.v_string.str == NULL)
+                return len + 4;
+            return len + 4 + XSETTINGS_PAD (value->data.v_string.len, 4);
+
+        case XSETTINGS_WIRE_TYPE_COLOR:
+            return len + 8;
+
+        default:
+            g_assert_not_reached ();
+            return 0;
+    }
+}
+
+
+
+gsize
+xsettings_wire_encode_record (guchar                   *buf,
+                              const gchar              *name,
+                              gsize                     name_len,
+                              guint32                   last_change_serial,
+                              const XSettingsWireValue *value,
+                              gsize                    *value_offset)
+{
+    guchar *needle = buf;
+    gsize   name_len_pad;
+    gsize   value_len, value_len_pad;
+
+    g_return_val_if_fail (name_len <= G_MAXUINT16, 0);
+
+    name_len_pad = XSETTINGS_PAD (name_len, 4);
+
+    /* setting record:
+     *
+     * 1  SETTING_TYPE  type
+     * 1                unused
+     * 2  n             name-len
+     * n  STRING8       name
+     * P                unused, p=pad(n)
+     * 4  CARD32        last-change-serial
+     */
+
+    /* setting type */
+    *needle++ = value->type;
+
+    /* unused */
+    *needle++ = 0;
+
+    /* name length */
+    xsettings_wire_put16 (needle, name_len);
+    needle += 2;
+
+    /* name */
+    memcpy (needle, name, name_len);
+    needle += name_len;
+
+    /* zero the padding */
+    for (; name_len_pad > name_len; name_len_pad--)
+        *needle++ = 0;
+
+    /* setting's last change serial */
+    xsettings_wire_put32 (needle, last_change_serial);
+    needle += 4;
+
+    if (value_offset != NULL)
+        *value_offset = needle - buf;
+
+    switch (value->type)
+    {
+        case XSETTINGS_WIRE_TYPE_STRING:
+            /* body for XSettingsTypeString:
+             *
+             * 4  n        value-len
+             * n  STRING8  value
+             * P           unused, p=pad(n)
+             */
+            value_len = value->data.v_string.str != NULL ? value->data.v_string.len : 0;
+            value_len_pad = XSETTINGS_PAD (value_len, 4);
+
+            /* value length */
+            xsettings_wire_put32 (needle, value_len);
+            needle += 4;
+
+            if (G_LIKELY (value_len > 0))
+            {
+                /* value */
+                memcpy (needle, value->data.v_string.str, value_len);
+                needle += value_len;
+
+                /* zero the padding */
+                for (; value_len_pad > value_len; value_len_pad--)
+                    *needle++ = 0;
+            }
+            break;
+
+        case XSETTINGS_WIRE_TYPE_INTEGER:
+            /* Body for XSettingsTypeInteger:
+             *
+             * 4  INT32  value
+             */
+            xsettings_wire_put32 (needle, value->data.v_int);
+            needle += 4;
+            break;
+
+        case XSETTINGS_WIRE_TYPE_COLOR:
+            /* body for XSettingsTypeColor:
+             *
+             * 2  CARD16  red
+             * 2  CARD16  blue
+             * 2  CARD16  green
+             * 2  CARD16  alpha
+             */
+            xsettings_wire_put16 (needle, value->data.v_color.red);
+            xsettings_wire_put16 (needle + 2, value->data.v_color.blue);
+            xsettings_wire_put16 (needle + 4, value->data.v_color.green);
+            xsettings_wire_put16 (needle + 6, value->data.v_color.alpha);
+            needle += 8;
+            break;
+
+        default:
+            g_assert_not_reached ();
+            break;
+    }
+
+    return needle - buf;
+}
+
+
+
+void
+xsettings_wire_encode_header (guchar  *buf,
+                              guint32  serial,
+                              guint32  n_settings)
+{
+    /* general notification form:
+     *
+     * 1  CARD8   byte-order
+     * 3          unused
+     * 4  CARD32  SERIAL
+     * 4  CARD32  N_SETTINGS
+     */
+    buf[0] = G_BYTE_ORDER == G_BIG_ENDIAN ? XSETTINGS_MSB_FIRST : XSETTINGS_LSB_FIRST;
+    buf[1] = buf[2] = buf[3] = 0;
+
+    xsettings_wire_put32 (buf + 4, serial);
+    xsettings_wire_put32 (buf + 8, n_settings);
+}
+
+
+
+void
+xsettings_wire_patch_int (guchar *buf,
+                          gsize   offset,
+                          gint32  value)
+{
+    xsettings_wire_put32 (buf + offset, value);
+}
+
+
+
+gboolean
+xsettings_wire_decode (const guchar      *buf,
+                       gsize              len,
+                       guint32           *serial,
+                       XSettingsWireFunc  func,
+                       gpointer           user_data)
+{
+    const guchar       *needle = buf;
+    const guchar       *end = buf + len;
+    gboolean            swap;
+    guint32             n_settings, n;
+    guint32             last_change_serial;
+    gsize               name_len, value_len;
+    const gchar        *name;
+    XSettingsWireValue  value;
+
+    if (len < XSETTINGS_WIRE_HEADER_SIZE)
+        return FALSE;
+
+    if (buf[0] == XSETTINGS_MSB_FIRST)
+        swap = G_BYTE_ORDER != G_BIG_ENDIAN;
+    else if (buf[0] == XSETTINGS_LSB_FIRST)
+        swap = G_BYTE_ORDER != G_LITTLE_ENDIAN;
+    else
+        return FALSE;
+
+    if (serial != NULL)
+        *serial = xsettings_wire_get32 (buf + 4, swap);
+
+    n_settings = xsettings_wire_get32 (buf + 8, swap);
+    needle += XSETTINGS_WIRE_HEADER_SIZE;
+
+    for (n = 0; n < n_settings; n++)
+    {
+        if ((gsize) (end - needle) < 4)
+            return FALSE;
+
+        value.type = needle[0];
+        name_len = xsettings_wire_get16 (needle + 2, swap);
+        needle += 4;
+
+        if ((gsize) (end - needle) < XSETTINGS_PAD (name_len, 4) + 4)
+            return FALSE;
+
+        name = (const gchar *) needle;
+        needle += XSETTINGS_PAD (name_len, 4);
+
+        last_change_serial = xsettings_wire_get32 (needle, swap);
+        needle += 4;
+
+        switch (value.type)
+        {
+            case XSETTINGS_WIRE_TYPE_INTEGER:
+                if ((gsize) (end - needle) < 4)
+                    return FALSE;
+
+                value.data.v_int = xsettings_wire_get32 (needle, swap);
+                needle += 4;
+                break;
+
+            case XSETTINGS_WIRE_TYPE_STRING:
+                if ((gsize) (end - needle) < 4)
+                    return FALSE;
+
+                value_len = xsettings_wire_get32 (needle, swap);
+                needle += 4;
+
+                if ((gsize) (end - needle) < XSETTINGS_PAD (value_len, 4))
+                    return FALSE;
+
+                value.data.v_string.str = (const gchar *) needle;
+                value.data.v_string.len = value_len;
+                needle += XSETTINGS_PAD (value_len, 4);
+                break;
+
+            case XSETTINGS_WIRE_TYPE_COLOR:
+                if ((gsize) (end - needle) < 8)
+                    return FALSE;
+
+                value.data.v_color.red = xsettings_wire_get16 (needle, swap);
+                value.data.v_color.blue = xsettings_wire_get16 (needle + 2, swap);
+                value.data.v_color.green = xsettings_wire_get16 (needle + 4, swap);
+                value.data.v_color.alpha = xsettings_wire_get16 (needle + 6, swap);
+                needle += 8;
+                break;
+
+            default:
+                return FALSE;
+        }
+
+        if (func != NULL)
+            (*func) (name, name_len, last_change_serial, &value, user_data);
+    }
+
+    return TRUE;
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2008 Stephan Arts <stephan@xfce.org>
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __XSETTINGS_WIRE_H__
+#define __XSETTINGS_WIRE_H__
+
+#include <glib.h>
+
+/* size of the _XSETTINGS_SETTINGS header */
+#define XSETTINGS_WIRE_HEADER_SIZE 12
+
+typedef struct _XSettingsWireColor XSettingsWireColor;
+typedef struct _XSettingsWireValue XSettingsWireValue;
+
+typedef enum
+{
+    XSETTINGS_WIRE_TYPE_INTEGER = 0,
+    XSETTINGS_WIRE_TYPE_STRING  = 1,
+    XSETTINGS_WIRE_TYPE_COLOR   = 2
+}
+XSettingsWireType;
+
+struct _XSettingsWireColor
+{
+    guint16 red;
+    guint16 green;
+    guint16 blue;
+    guint16 alpha;
+};
+
+struct _XSettingsWireValue
+{
+    XSettingsWireType type;
+
+    union
+    {
+        gint32              v_int;
+        XSettingsWireColor  v_color;
+        struct
+        {
+            /* not nul-terminated when decoded */
+            const gchar    *str;
+            gsize           len;
+        }
+        v_string;
+    }
+    data;
+};
+
+typedef void (*XSettingsWireFunc) (const gchar              *name,
+                                   gsize                     name_len,
+                                   guint32                   last_change_serial,
+                                   const XSettingsWireValue *value,
+                                   gpointer                  user_data);
+
+gsize    xsettings_wire_record_size   (gsize                     name_len,
+                                       const XSettingsWireValue *value);
+
+gsize    xsettings_wire_encode_record (guchar                   *buf,
+                                       const gchar              *name,
+                                       gsize                     name_len,
+                                       guint32                   last_change_serial,
+                                       const XSettingsWireValue *value,
+                                       gsize                    *value_offset);
+
+void     xsettings_wire_encode_header (guchar                   *buf,
+                                       guint32                   serial,
+                                       guint32                   n_settings);
+
+void     xsettings_wire_patch_int     (guchar                   *buf,
+                                       gsize                     offset,
+                                       gint32                    value);
+
+gboolean xsettings_wire_decode        (const guchar             *buf,
+                                       gsize                     len,
+                                       guint32                  *serial,
+                                       XSettingsWireFunc         func,
+                                       gpointer                  user_data);
+
+#endif /* !__XSETTINGS_WIRE_H__ */
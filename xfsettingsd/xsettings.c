@@ -37,7 +37,6 @@
 #endif
 
 #include <X11/Xlib.h>
-#include <X11/Xmd.h>
 #include <X11/Xatom.h>
 
 #include <glib.h>
@@ -50,13 +49,15 @@
 #include <fontconfig/fontconfig.h>
 
 #include "xsettings.h"
+#include "xsettings-wire.h"
+#include "xresources.h"
+#include "fontconfig-monitor.h"
 #include "debug.h"
-
-#define XSettingsTypeInteger 0
-#define XSettingsTypeString  1
-#define XSettingsTypeColor   2
-
-#define XSETTINGS_PAD(n,m) ((n + m - 1) & (~(m-1)))
+#include "atoms.h"
+#include "metrics.h"
+#include "trace.h"
+#include "dispatcher.h"
+#include "memory.h"
 
 #define DPI_FALLBACK        96
 #define DPI_LOW_REASONABLE  50
@@ -65,19 +66,28 @@
 #define FC_TIMEOUT_SEC 2 /* timeout before xsettings notify */
 #define FC_PROPERTY    "/Fontconfig/Timestamp"
 
+#define NOTIFY_DELAY_MSEC     50  /* quiet period before a notify */
+#define NOTIFY_MAX_DELAY_MSEC 250 /* maximum delay after the first change */
 
 
-typedef struct _XfceXSettingsScreen XfceXSettingsScreen;
-typedef struct _XfceXSetting        XfceXSetting;
-typedef struct _XfceXSettingsNotify XfceXSettingsNotify;
+
+typedef struct _XfceXSettingsScreen  XfceXSettingsScreen;
+typedef struct _XfceXSetting         XfceXSetting;
+typedef struct _XfceXSettingsFcState XfceXSettingsFcState;
 
 
 
 static void     xfce_xsettings_helper_finalize     (GObject             *object);
 static void     xfce_xsettings_helper_fc_free      (XfceXSettingsHelper *helper);
-static gboolean xfce_xsettings_helper_fc_init      (gpointer             data);
-static gboolean xfce_xsettings_helper_notify_idle  (gpointer             data);
+static void     xfce_xsettings_helper_fc_start     (XfceXSettingsHelper *helper,
+                                                    gboolean             initial);
+static void     xfce_xsettings_helper_fc_changed   (XfceXSettingsHelper *helper,
+                                                    const gchar         *path);
+static void     xfce_xsettings_helper_schedule     (XfceXSettingsHelper *helper,
+                                                    gboolean             xft);
 static void     xfce_xsettings_helper_setting_free (gpointer             data);
+static void     xfce_xsettings_helper_memory       (XfsdMemoryReport    *report,
+                                                    gpointer             user_data);
 static void     xfce_xsettings_helper_prop_changed (XfconfChannel       *channel,
                                                     const gchar         *prop_name,
                                                     const GValue        *value,
@@ -86,6 +96,9 @@ static void     xfce_xsettings_helper_load         (XfceXSettingsHelper *helper)
 static void     xfce_xsettings_helper_screen_free  (XfceXSettingsScreen *screen);
 static void     xfce_xsettings_helper_notify_xft   (XfceXSettingsHelper *helper);
 static void     xfce_xsettings_helper_notify       (XfceXSettingsHelper *helper);
+static GdkFilterReturn xfce_xsettings_helper_event_filter (GdkXEvent *gdkxevent,
+                                                           GdkEvent  *gdkevent,
+                                                           gpointer   data);
 
 
 
@@ -109,31 +122,52 @@ struct _XfceXSettingsHelper
     /* auto increasing serial for each time we notify */
     gulong         serial;
 
-    /* idle notifications */
-    guint          notify_idle_id;
-    guint          notify_xft_idle_id;
+    /* reusable buffer for the _XSETTINGS_SETTINGS property */
+    guchar        *buf;
+    gsize          buf_size;
+
+    /* coalesced notifications */
+    guint          notify_timeout_id;
+    gint64         notify_pending_since;
+    guint          notify_pending : 1;
+    guint          notify_xft_pending : 1;
 
     /* atom for xsetting property changes */
     Atom           xsettings_atom;
 
+    /* resident copy of the RESOURCE_MANAGER property */
+    XfceXResources *xresources;
+
     /* fontconfig monitoring */
-    GPtrArray     *fc_monitors;
+    XfceFontconfigMonitor *fc_monitor;
     guint          fc_notify_timeout_id;
-    guint          fc_init_id;
+    guint          fc_running : 1;
+    guint          fc_rerun : 1;
 };
 
 struct _XfceXSetting
 {
     GValue *value;
     gulong  last_change_serial;
+
+    /* cached wire record of this setting, only valid if
+     * record_serial matches last_change_serial */
+    guchar *record;
+    gsize   record_len;
+    gulong  record_serial;
+
+    /* offset of the screen dependent dpi in the record, 0 if unused */
+    gsize   dpi_offset;
 };
 
-struct _XfceXSettingsNotify
+struct _XfceXSettingsFcState
 {
-    guchar *buf;
-    gsize   buf_len;
-    gint    n_settings;
-    gsize   dpi_offset;
+    /* paths to monitor, NULL if the configuration did not change */
+    gchar    **config_files;
+    gchar    **font_dirs;
+
+    /* fontconfig was reinitialized */
+    guint      changed : 1;
 };
 
 struct _XfceXSettingsScreen
@@ -173,6 +207,9 @@ xfce_xsettings_helper_init (XfceXSettingsHelper *helper)
 
     g_signal_connect (G_OBJECT (helper->channel), "property-changed",
         G_CALLBACK (xfce_xsettings_helper_prop_changed), helper);
+
+    xfsettings_memory_register (XFSD_HELPER_XSETTINGS,
+        xfce_xsettings_helper_memory, helper);
 }
 
 
@@ -183,206 +220,315 @@ xfce_xsettings_helper_finalize (GObject *object)
     XfceXSettingsHelper *helper = XFCE_XSETTINGS_HELPER (object);
     GSList              *li;
 
+    xfsettings_memory_unregister (xfce_xsettings_helper_memory, helper);
+
     /* stop fontconfig monitoring */
     xfce_xsettings_helper_fc_free (helper);
 
     /* stop pending update */
-    if (helper->notify_idle_id != 0)
-        g_source_remove (helper->notify_idle_id);
-
-    if (helper->notify_xft_idle_id != 0)
-        g_source_remove (helper->notify_xft_idle_id);
+    if (helper->notify_timeout_id != 0)
+        g_source_remove (helper->notify_timeout_id);
 
     g_object_unref (G_OBJECT (helper->channel));
 
     /* remove screens */
+    if (helper->screens != NULL)
+        xfsettings_dispatcher_remove (xfce_xsettings_helper_event_filter, helper);
     for (li = helper->screens; li != NULL; li = li->next)
         xfce_xsettings_helper_screen_free (li->data);
     g_slist_free (helper->screens);
 
     g_hash_table_destroy (helper->settings);
 
+    g_free (helper->buf);
+
+    xfce_xresources_free (helper->xresources);
+
     (*G_OBJECT_CLASS (xfce_xsettings_helper_parent_class)->finalize) (object);
 }
 
 
 
-static gboolean
-xfce_xsettings_helper_fc_notify (gpointer data)
+static void
+xfce_xsettings_helper_fc_timestamp (XfceXSettingsHelper *helper)
 {
-    XfceXSettingsHelper *helper = XFCE_XSETTINGS_HELPER (data);
-    XfceXSetting        *setting;
-
-    helper->fc_notify_timeout_id = 0;
+    XfceXSetting *setting;
 
-    /* check if the font config setup changed */
-    if (!FcConfigUptoDate (NULL) && FcInitReinitialize ())
+    setting = g_hash_table_lookup (helper->settings, FC_PROPERTY);
+    if (setting == NULL)
     {
-        /* stop the monitors */
-        xfce_xsettings_helper_fc_free (helper);
+        /* create new setting */
+        setting = g_slice_new0 (XfceXSetting);
+        setting->value = g_new0 (GValue, 1);
+        g_value_init (setting->value, G_TYPE_INT);
+        g_hash_table_insert (helper->settings, g_strdup (FC_PROPERTY), setting);
+    }
 
-        setting = g_hash_table_lookup (helper->settings, FC_PROPERTY);
-        if (setting == NULL)
-        {
-            /* create new setting */
-            setting = g_slice_new0 (XfceXSetting);
-            setting->value = g_new0 (GValue, 1);
-            g_value_init (setting->value, G_TYPE_INT);
-            g_hash_table_insert (helper->settings, g_strdup (FC_PROPERTY), setting);
-        }
+    /* update setting */
+    setting->last_change_serial = helper->serial;
+    g_value_set_int (setting->value, time (NULL));
 
-        /* update setting */
-        setting->last_change_serial = helper->serial;
-        g_value_set_int (setting->value, time (NULL));
+    xfsettings_dbg (XFSD_DEBUG_FONTCONFIG, "timestamp updated (time=%d)",
+                    g_value_get_int (setting->value));
 
-        xfsettings_dbg (XFSD_DEBUG_FONTCONFIG, "timestamp updated (time=%d)",
-                        g_value_get_int (setting->value));
+    /* schedule xsettings update */
+    xfce_xsettings_helper_schedule (helper, FALSE);
+}
 
-        /* schedule xsettings update */
-        if (helper->notify_idle_id == 0)
-            helper->notify_idle_id = g_idle_add (xfce_xsettings_helper_notify_idle, helper);
 
-        /* restart monitoring */
-        helper->fc_init_id = g_idle_add (xfce_xsettings_helper_fc_init, helper);
-    }
 
-    return FALSE;
+static void
+xfce_xsettings_helper_fc_state_free (gpointer data)
+{
+    XfceXSettingsFcState *state = data;
+
+    g_strfreev (state->config_files);
+    g_strfreev (state->font_dirs);
+    g_slice_free (XfceXSettingsFcState, state);
 }
 
 
 
-static void
-xfce_xsettings_helper_fc_changed (XfceXSettingsHelper *helper)
+static gchar **
+xfce_xsettings_helper_fc_strv (FcStrList *list)
 {
-    /* reschedule monitor */
-    if (helper->fc_notify_timeout_id != 0)
-        g_source_remove (helper->fc_notify_timeout_id);
+    GPtrArray   *array;
+    const gchar *path;
 
-    helper->fc_notify_timeout_id = g_timeout_add_seconds (FC_TIMEOUT_SEC,
-        xfce_xsettings_helper_fc_notify, helper);
+    array = g_ptr_array_new ();
+
+    if (G_LIKELY (list != NULL))
+    {
+        while ((path = (const gchar *) FcStrListNext (list)) != NULL)
+            g_ptr_array_add (array, g_strdup (path));
+        FcStrListDone (list);
+    }
+
+    g_ptr_array_add (array, NULL);
+
+    return (gchar **) g_ptr_array_free (array, FALSE);
 }
 
 
 
 static void
-xfce_xsettings_helper_fc_free (XfceXSettingsHelper *helper)
+xfce_xsettings_helper_fc_thread (GTask        *task,
+                                 gpointer      source_object,
+                                 gpointer      task_data,
+                                 GCancellable *cancellable)
 {
-    if (helper->fc_notify_timeout_id != 0)
-    {
-        /* stop update timeout */
-        g_source_remove (helper->fc_notify_timeout_id);
-        helper->fc_notify_timeout_id = 0;
-    }
+    XfceXSettingsFcState *state;
+    gboolean              initial = GPOINTER_TO_UINT (task_data);
+
+    state = g_slice_new0 (XfceXSettingsFcState);
 
-    if (helper->fc_init_id != 0)
+    if (initial)
     {
-        /* stop startup timeout */
-        g_source_remove (helper->fc_init_id);
-        helper->fc_init_id = 0;
+        /* this scans all font directories without a valid cache,
+         * which can take a long time on a cold cache */
+        if (!FcInit ())
+        {
+            g_slice_free (XfceXSettingsFcState, state);
+            g_task_return_pointer (task, NULL, NULL);
+            return;
+        }
     }
-
-    if (helper->fc_monitors != NULL)
+    else
     {
-        /* remove monitors */
-        g_ptr_array_foreach (helper->fc_monitors, (GFunc) (void (*)(void)) g_object_unref, NULL);
-        g_ptr_array_free (helper->fc_monitors, TRUE);
-        helper->fc_monitors = NULL;
+        /* check if the font config setup changed; reinitializing
+         * rebuilds the invalid caches of the font directories, so
+         * they are valid before the timestamp is advertised and
+         * clients do not all rescan them on reload */
+        state->changed = !FcConfigUptoDate (NULL) && FcInitReinitialize ();
+        if (!state->changed)
+        {
+            g_task_return_pointer (task, state, xfce_xsettings_helper_fc_state_free);
+            return;
+        }
     }
+
+    /* paths to monitor for the new configuration */
+    state->config_files = xfce_xsettings_helper_fc_strv (FcConfigGetConfigFiles (NULL));
+    state->font_dirs = xfce_xsettings_helper_fc_strv (FcConfigGetFontDirs (NULL));
+
+    g_task_return_pointer (task, state, xfce_xsettings_helper_fc_state_free);
 }
 
 
 
 static void
-xfce_xsettings_helper_fc_monitor (XfceXSettingsHelper *helper,
-                                  FcStrList           *files)
+xfce_xsettings_helper_fc_ready (GObject      *source_object,
+                                GAsyncResult *result,
+                                gpointer      data)
 {
-    const gchar  *path;
-    GFile        *file;
-    GFileMonitor *monitor;
+    XfceXSettingsHelper  *helper = XFCE_XSETTINGS_HELPER (source_object);
+    XfceXSettingsFcState *state;
 
-    if (G_UNLIKELY (files == NULL))
-        return;
+    helper->fc_running = FALSE;
 
-    for (;;)
+    state = g_task_propagate_pointer (G_TASK (result), NULL);
+    if (state != NULL)
     {
-        path = (const gchar *) FcStrListNext (files);
-        if (G_UNLIKELY (path == NULL))
-            break;
-
-        file = g_file_new_for_path (path);
-        monitor = g_file_monitor (file, G_FILE_MONITOR_NONE, NULL, NULL);
-        g_object_unref (G_OBJECT (file));
-
-        if (G_LIKELY (monitor != NULL))
+        if (state->font_dirs != NULL)
         {
-            g_ptr_array_add (helper->fc_monitors, monitor);
-            g_signal_connect_swapped (G_OBJECT (monitor), "changed",
-                G_CALLBACK (xfce_xsettings_helper_fc_changed), helper);
+            if (helper->fc_monitor == NULL)
+            {
+                helper->fc_monitor = xfce_fontconfig_monitor_new ();
+                g_signal_connect_swapped (G_OBJECT (helper->fc_monitor), "changed",
+                    G_CALLBACK (xfce_xsettings_helper_fc_changed), helper);
+            }
 
-            xfsettings_dbg_filtered (XFSD_DEBUG_FONTCONFIG, "monitoring \"%s\"",
-                                     path);
+            /* update the monitored paths */
+            xfce_fontconfig_monitor_update (helper->fc_monitor,
+                                            state->config_files,
+                                            state->font_dirs);
         }
+
+        if (state->changed)
+            xfce_xsettings_helper_fc_timestamp (helper);
+
+        xfce_xsettings_helper_fc_state_free (state);
     }
 
-    FcStrListDone (files);
+    /* something changed while the worker was busy */
+    if (helper->fc_rerun)
+    {
+        helper->fc_rerun = FALSE;
+        xfce_xsettings_helper_fc_start (helper, FALSE);
+    }
+}
+
+
+
+static void
+xfce_xsettings_helper_fc_start (XfceXSettingsHelper *helper,
+                                gboolean             initial)
+{
+    GTask *task;
+
+    if (helper->fc_running)
+    {
+        helper->fc_rerun = TRUE;
+        return;
+    }
+
+    helper->fc_running = TRUE;
+
+    /* fontconfig can block for a long time, so run it in a thread to
+     * keep the daemon responsive; the task holds a reference on the helper */
+    task = g_task_new (helper, NULL, xfce_xsettings_helper_fc_ready, NULL);
+    g_task_set_task_data (task, GUINT_TO_POINTER (initial), NULL);
+    g_task_run_in_thread (task, xfce_xsettings_helper_fc_thread);
+    g_object_unref (G_OBJECT (task));
 }
 
 
 
 static gboolean
-xfce_xsettings_helper_fc_init (gpointer data)
+xfce_xsettings_helper_fc_notify (gpointer data)
 {
     XfceXSettingsHelper *helper = XFCE_XSETTINGS_HELPER (data);
 
-    g_return_val_if_fail (helper->fc_monitors == NULL, FALSE);
+    helper->fc_notify_timeout_id = 0;
 
-    helper->fc_init_id = 0;
+    xfce_xsettings_helper_fc_start (helper, FALSE);
+
+    return FALSE;
+}
 
-    if (FcInit ())
-    {
-        helper->fc_monitors = g_ptr_array_new ();
 
-        /* start monitoring config files and font directories */
-        xfce_xsettings_helper_fc_monitor (helper, FcConfigGetConfigFiles (NULL));
-        xfce_xsettings_helper_fc_monitor (helper, FcConfigGetFontDirs (NULL));
 
-        xfsettings_dbg (XFSD_DEBUG_FONTCONFIG, "monitoring %d paths",
-                        helper->fc_monitors->len);
+static void
+xfce_xsettings_helper_fc_changed (XfceXSettingsHelper *helper,
+                                  const gchar         *path)
+{
+    /* reschedule monitor */
+    if (helper->fc_notify_timeout_id != 0)
+        g_source_remove (helper->fc_notify_timeout_id);
+
+    helper->fc_notify_timeout_id = g_timeout_add_seconds (FC_TIMEOUT_SEC,
+        xfce_xsettings_helper_fc_notify, helper);
+}
+
+
+
+static void
+xfce_xsettings_helper_fc_free (XfceXSettingsHelper *helper)
+{
+    if (helper->fc_notify_timeout_id != 0)
+    {
+        /* stop update timeout */
+        g_source_remove (helper->fc_notify_timeout_id);
+        helper->fc_notify_timeout_id = 0;
     }
 
-    return FALSE;
+    if (helper->fc_monitor != NULL)
+    {
+        /* remove monitors */
+        g_object_unref (G_OBJECT (helper->fc_monitor));
+        helper->fc_monitor = NULL;
+    }
 }
 
 
 
 static gboolean
-xfce_xsettings_helper_notify_idle (gpointer data)
+xfce_xsettings_helper_notify_timeout (gpointer data)
 {
     XfceXSettingsHelper *helper = XFCE_XSETTINGS_HELPER (data);
 
+    helper->notify_timeout_id = 0;
+
     /* only update if there are screen registered */
     if (helper->screens != NULL)
-        xfce_xsettings_helper_notify (helper);
+    {
+        if (helper->notify_pending)
+            xfce_xsettings_helper_notify (helper);
+
+        if (helper->notify_xft_pending)
+            xfce_xsettings_helper_notify_xft (helper);
+    }
 
-    helper->notify_idle_id = 0;
+    helper->notify_pending = FALSE;
+    helper->notify_xft_pending = FALSE;
 
     return FALSE;
 }
 
 
 
-static gboolean
-xfce_xsettings_helper_notify_xft_idle (gpointer data)
+static void
+xfce_xsettings_helper_schedule (XfceXSettingsHelper *helper,
+                                gboolean             xft)
 {
-    XfceXSettingsHelper *helper = XFCE_XSETTINGS_HELPER (data);
+    gint64 now;
+    gint64 elapsed;
+    guint  delay;
 
-    /* only update if there are screen registered */
-    if (helper->screens != NULL)
-        xfce_xsettings_helper_notify_xft (helper);
+    now = g_get_monotonic_time ();
 
-    helper->notify_xft_idle_id = 0;
+    /* remember when the first change of this burst happened */
+    if (helper->notify_timeout_id == 0)
+        helper->notify_pending_since = now;
 
-    return FALSE;
+    helper->notify_pending = TRUE;
+    if (xft)
+        helper->notify_xft_pending = TRUE;
+
+    /* wait for a quiet period, but never longer than the
+     * maximum delay after the first change */
+    elapsed = (now - helper->notify_pending_since) / 1000;
+    if (elapsed + NOTIFY_DELAY_MSEC > NOTIFY_MAX_DELAY_MSEC)
+        delay = MAX (NOTIFY_MAX_DELAY_MSEC - elapsed, 0);
+    else
+        delay = NOTIFY_DELAY_MSEC;
+
+    /* reschedule the notification */
+    if (helper->notify_timeout_id != 0)
+        g_source_remove (helper->notify_timeout_id);
+
+    helper->notify_timeout_id = g_timeout_add (delay,
+        xfce_xsettings_helper_notify_timeout, helper);
 }
 
 
@@ -493,18 +639,12 @@ xfce_xsettings_helper_prop_changed (XfconfChannel       *channel,
         g_hash_table_remove (helper->settings, prop_name);
     }
 
-    if (helper->notify_idle_id == 0)
-    {
-        /* schedule an update */
-        helper->notify_idle_id = g_idle_add (xfce_xsettings_helper_notify_idle, helper);
-    }
+    xfsettings_metrics_changed (XFSD_HELPER_XSETTINGS, prop_name);
 
-    if (helper->notify_xft_idle_id == 0
-        && (g_str_has_prefix (prop_name, "/Xft/")
-            || g_str_has_prefix (prop_name, "/Gtk/CursorTheme")))
-    {
-        helper->notify_xft_idle_id = g_idle_add (xfce_xsettings_helper_notify_xft_idle, helper);
-    }
+    /* schedule an update, coalesced with other changes in this burst */
+    xfce_xsettings_helper_schedule (helper,
+        g_str_has_prefix (prop_name, "/Xft/")
+        || g_str_has_prefix (prop_name, "/Gtk/CursorTheme"));
 }
 
 
@@ -535,11 +675,62 @@ xfce_xsettings_helper_setting_free (gpointer data)
 
     g_value_unset (setting->value);
     g_free (setting->value);
+    g_free (setting->record);
     g_slice_free (XfceXSetting, setting);
 }
 
 
 
+static void
+xfce_xsettings_helper_memory (XfsdMemoryReport *report,
+                              gpointer          user_data)
+{
+    XfceXSettingsHelper *helper = XFCE_XSETTINGS_HELPER (user_data);
+    GHashTableIter       iter;
+    gpointer             key, value;
+    XfceXSetting        *setting;
+    gsize                n_bytes, n_records = 0, records_size = 0;
+    guint                n_watches = 0;
+    gsize                index_size = 0;
+    guint                n_lines = 0;
+    gsize                xresources_size = 0;
+
+    n_bytes = xfsettings_memory_hash_table_size (helper->settings);
+    g_hash_table_iter_init (&iter, helper->settings);
+    while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+        setting = value;
+
+        n_bytes += strlen (key) + 1 + sizeof (XfceXSetting) + sizeof (GValue);
+        if (G_VALUE_HOLDS_STRING (setting->value)
+            && g_value_get_string (setting->value) != NULL)
+            n_bytes += strlen (g_value_get_string (setting->value)) + 1;
+
+        if (setting->record != NULL)
+        {
+            n_records++;
+            records_size += setting->record_len;
+        }
+    }
+
+    xfsettings_memory_add (report, "settings",
+                           g_hash_table_size (helper->settings), n_bytes);
+    xfsettings_memory_add (report, "wire-records", n_records, records_size);
+    xfsettings_memory_add (report, "wire-buffer", 1, helper->buf_size);
+
+    if (helper->fc_monitor != NULL)
+        xfce_fontconfig_monitor_get_stats (helper->fc_monitor, &n_watches, &index_size);
+
+    xfsettings_memory_add (report, "fc-monitors", n_watches, index_size);
+
+    if (helper->xresources != NULL)
+        xfce_xresources_get_stats (helper->xresources, &n_lines, &xresources_size);
+
+    xfsettings_memory_add (report, "xresources", n_lines, xresources_size);
+}
+
+
+
 static gint
 xfce_xsettings_helper_screen_dpi (XfceXSettingsScreen *screen)
 {
@@ -579,27 +770,14 @@ xfce_xsettings_helper_screen_dpi (XfceXSettingsScreen *screen)
 
 
 static void
-xfce_xsettings_helper_notify_xft_update (GString      *resource,
-                                         const gchar  *name,
-                                         const GValue *value)
+xfce_xsettings_helper_notify_xft_update (XfceXResources *resources,
+                                         const gchar    *name,
+                                         const GValue   *value)
 {
-    gchar       *found;
-    gchar       *end;
     const gchar *str = NULL;
     gchar        s[64];
     gint         num;
 
-    g_return_if_fail (g_str_has_suffix (name, ":"));
-
-    /* remove the old property */
-    found = strstr (resource->str, name);
-    if (found != NULL)
-    {
-        end = strchr (found, '\n');
-        g_string_erase (resource, found - resource->str,
-                        end != NULL ? end - found + 1 : -1);
-    }
-
     switch (G_VALUE_TYPE (value))
     {
         case G_TYPE_STRING:
@@ -615,10 +793,10 @@ xfce_xsettings_helper_notify_xft_update (GString      *resource,
 
             /* -1 means default in xft, so only remove it */
             if (num == -1)
-                return;
+                break;
 
             /* special case for dpi */
-            if (strcmp (name, "Xft.dpi:") == 0)
+            if (strcmp (name, "Xft.dpi") == 0)
                 num = CLAMP (num, DPI_LOW_REASONABLE, DPI_HIGH_REASONABLE);
 
             g_snprintf  (s, sizeof (s), "%d", num);
@@ -629,14 +807,8 @@ xfce_xsettings_helper_notify_xft_update (GString      *resource,
             g_assert_not_reached ();
     }
 
-    if (str != NULL)
-    {
-        /* append a new line if required */
-        if (!g_str_has_suffix (resource->str, "\n"))
-            g_string_append_c (resource, '\n');
-
-        g_string_append_printf (resource, "%s\t%s\n", name, str);
-    }
+    /* a NULL value removes the resource */
+    xfce_xresources_set (resources, name, str);
 }
 
 
@@ -644,44 +816,35 @@ xfce_xsettings_helper_notify_xft_update (GString      *resource,
 static void
 xfce_xsettings_helper_notify_xft (XfceXSettingsHelper *helper)
 {
-    Display      *xdisplay;
-    gchar        *str;
-    GString      *resource;
     XfceXSetting *setting;
     guint         i;
     GValue        bool_val = { 0, };
     const gchar  *props[][2] =
     {
         /* { xfconf name}, { xft name } */
-        { "/Xft/Antialias", "Xft.antialias:" },
-        { "/Xft/Hinting", "Xft.hinting:" },
-        { "/Xft/HintStyle", "Xft.hintstyle:" },
-        { "/Xft/RGBA", "Xft.rgba:" },
-        { "/Xft/Lcdfilter", "Xft.lcdfilter:" },
-        { "/Xft/DPI", "Xft.dpi:" },
-        { "/Gtk/CursorThemeName", "Xcursor.theme:" },
-        { "/Gtk/CursorThemeSize", "Xcursor.size:" }
+        { "/Xft/Antialias", "Xft.antialias" },
+        { "/Xft/Hinting", "Xft.hinting" },
+        { "/Xft/HintStyle", "Xft.hintstyle" },
+        { "/Xft/RGBA", "Xft.rgba" },
+        { "/Xft/Lcdfilter", "Xft.lcdfilter" },
+        { "/Xft/DPI", "Xft.dpi" },
+        { "/Gtk/CursorThemeName", "Xcursor.theme" },
+        { "/Gtk/CursorThemeSize", "Xcursor.size" }
     };
 
     g_return_if_fail (XFCE_IS_XSETTINGS_HELPER (helper));
 
-    if (G_LIKELY (helper->screens == NULL))
+    if (G_LIKELY (helper->screens == NULL)
+        || helper->xresources == NULL)
         return;
 
-    xdisplay = XOpenDisplay (NULL);
-    g_return_if_fail (xdisplay != NULL);
-
-    /* get the resource string from this display from screen zero */
-    str = XResourceManagerString (xdisplay);
-    resource = g_string_new (str);
-
     /* update/insert the properties */
     for (i = 0; i < G_N_ELEMENTS (props); i++)
     {
         setting = g_hash_table_lookup (helper->settings, props[i][0]);
         if (G_LIKELY (setting != NULL))
         {
-            xfce_xsettings_helper_notify_xft_update (resource, props[i][1],
+            xfce_xsettings_helper_notify_xft_update (helper->xresources, props[i][1],
                                                      setting->value);
         }
     }
@@ -689,76 +852,62 @@ xfce_xsettings_helper_notify_xft (XfceXSettingsHelper *helper)
     /* set for Xcursor.theme */
     g_value_init (&bool_val, G_TYPE_BOOLEAN);
     g_value_set_boolean (&bool_val, TRUE);
-    xfce_xsettings_helper_notify_xft_update (resource, "Xcursor.theme_core:", &bool_val);
+    xfce_xsettings_helper_notify_xft_update (helper->xresources, "Xcursor.theme_core", &bool_val);
     g_value_unset (&bool_val);
 
-    gdk_x11_display_error_trap_push (gdk_display_get_default ());
-
-    /* set the new resource manager string */
-    XChangeProperty (xdisplay,
-                     RootWindow (xdisplay, 0),
-                     XA_RESOURCE_MANAGER, XA_STRING, 8,
-                     PropModeReplace,
-                     (guchar *) resource->str,
-                     resource->len);
-
-    XCloseDisplay (xdisplay);
-
-    if (gdk_x11_display_error_trap_pop (gdk_display_get_default ()) != 0)
-        g_critical ("Failed to update the resource manager string");
-
-    xfsettings_dbg (XFSD_DEBUG_XSETTINGS,
-                    "resource manager (xft) changed (len=%"G_GSIZE_FORMAT")",
-                    resource->len);
-
-    g_string_free (resource, TRUE);
+    /* only write the resource manager string if something changed */
+    if (xfce_xresources_commit (helper->xresources))
+        xfsettings_dbg (XFSD_DEBUG_XSETTINGS, "resource manager (xft) changed");
 }
 
 
 
 static void
-xfce_xsettings_helper_setting_append (const gchar         *name,
-                                      XfceXSetting        *setting,
-                                      XfceXSettingsNotify *notify)
+xfce_xsettings_helper_setting_encode (const gchar  *name,
+                                      XfceXSetting *setting)
 {
-    gsize        buf_len, new_len;
-    gsize        name_len, name_len_pad;
-    gsize        value_len, value_len_pad;
-    const gchar *str = NULL;
-    guchar      *needle;
-    guchar       type = 0;
-    gint         num;
-
-    name_len = strlen (name) - 1 /* -1 for the xfconf slash */;
-    name_len_pad = XSETTINGS_PAD (name_len, 4);
+    XSettingsWireValue  wire;
+    gsize               name_len;
+    gsize               buf_len;
+    gsize               value_offset;
+    gint                num;
 
-    buf_len = 8 + name_len_pad;
-    value_len_pad = value_len = 0;
+    name++; /* skip the xfconf slash */
+    name_len = strlen (name);
 
-    /* get the total size of this setting */
     switch (G_VALUE_TYPE (setting->value))
     {
         case G_TYPE_INT:
+            wire.type = XSETTINGS_WIRE_TYPE_INTEGER;
+            num = g_value_get_int (setting->value);
+
+            /* special case handling for DPI, clamp the value and
+             * set 1/1024ths of an inch for Xft, values < 1 are
+             * replaced by the screen dpi in notify */
+            if (strcmp (name, "Xft/DPI") == 0 && num >= 1)
+                num = CLAMP (num, DPI_LOW_REASONABLE, DPI_HIGH_REASONABLE) * 1024;
+
+            wire.data.v_int = num;
+            break;
+
         case G_TYPE_BOOLEAN:
-            type = XSettingsTypeInteger;
-            buf_len += 4;
+            wire.type = XSETTINGS_WIRE_TYPE_INTEGER;
+            wire.data.v_int = g_value_get_boolean (setting->value);
             break;
 
         case G_TYPE_STRING:
-            type = XSettingsTypeString;
-            buf_len += 4;
-            str = g_value_get_string (setting->value);
-            if (str != NULL)
-            {
-                value_len = strlen (str);
-                value_len_pad = XSETTINGS_PAD (value_len, 4);
-                buf_len += value_len_pad;
-            }
+            wire.type = XSETTINGS_WIRE_TYPE_STRING;
+            wire.data.v_string.str = g_value_get_string (setting->value);
+            wire.data.v_string.len = wire.data.v_string.str != NULL ?
+                strlen (wire.data.v_string.str) : 0;
             break;
 
         case G_TYPE_INT64 /* TODO */:
-            type = XSettingsTypeColor;
-            buf_len += 8;
+            wire.type = XSETTINGS_WIRE_TYPE_COLOR;
+            wire.data.v_color.red = 0;
+            wire.data.v_color.green = 0;
+            wire.data.v_color.blue = 0;
+            wire.data.v_color.alpha = 0;
             break;
 
         default:
@@ -766,132 +915,27 @@ xfce_xsettings_helper_setting_append (const gchar         *name,
             break;
     }
 
-    /* additional length for this setting */
-    new_len = notify->buf_len + buf_len;
-
-    /* resize the buffer to fit this setting */
-    notify->buf = g_renew (guchar, notify->buf, new_len);
-    if (G_UNLIKELY (notify->buf == NULL))
-      return;
-    needle = notify->buf + notify->buf_len;
-    notify->buf_len = new_len;
-
-    /* setting record:
-     *
-     * 1  SETTING_TYPE  type
-     * 1                unused
-     * 2  n             name-len
-     * n  STRING8       name
-     * P                unused, p=pad(n)
-     * 4  CARD32        last-change-serial
-     */
-
-    /* setting type */
-    *needle++ = type;
-
-    /* unused */
-    *needle++ = 0;
-
-    /* name length */
-    *(CARD16 *)needle = name_len;
-    needle += 2;
-
-    /* name */
-    memcpy (needle, name + 1 /* +1 for the xfconf slash */, name_len);
-    needle += name_len;
-
-    /* zero the padding */
-    for (; name_len_pad > name_len; name_len_pad--)
-        *needle++ = 0;
-
-    /* setting's last change serial */
-    *(CARD32 *)needle = setting->last_change_serial;
-    needle += 4;
-
-    /* set setting value */
-    switch (type)
+    /* allocate the record, only reuse the old one if the size matches */
+    buf_len = xsettings_wire_record_size (name_len, &wire);
+    if (setting->record == NULL || setting->record_len != buf_len)
     {
-        case XSettingsTypeString:
-            /* body for XSettingsTypeString:
-             *
-             * 4  n        value-len
-             * n  STRING8  value
-             * P           unused, p=pad(n)
-             */
-            if (G_LIKELY (value_len > 0 && str != NULL))
-            {
-                /* value length */
-                *(CARD32 *)needle = value_len;
-                needle += 4;
-
-                /* value */
-                memcpy (needle, str, value_len);
-                needle += value_len;
-
-                /* zero the padding */
-                for (; value_len_pad > value_len; value_len_pad--)
-                    *needle++ = 0;
-            }
-            else
-            {
-                /* value length */
-                *(CARD32 *)needle = 0;
-                needle += 4;
-            }
-            break;
-
-        case XSettingsTypeInteger:
-            /* Body for XSettingsTypeInteger:
-             *
-             * 4  INT32  value
-             */
-            if (G_VALUE_TYPE (setting->value) == G_TYPE_INT)
-            {
-                num = g_value_get_int (setting->value);
-
-                /* special case handling for DPI */
-                if (strcmp (name, "/Xft/DPI") == 0)
-                {
-                    /* remember the offset for screen dependend dpi
-                     * or clamp the value and set 1/1024ths of an inch
-                     * for Xft */
-                    if (num < 1)
-                        notify->dpi_offset = needle - notify->buf;
-                    else
-                        num = CLAMP (num, DPI_LOW_REASONABLE, DPI_HIGH_REASONABLE) * 1024;
-                }
-            }
-            else
-            {
-                num = g_value_get_boolean (setting->value);
-            }
+        g_free (setting->record);
+        setting->record = g_malloc (buf_len);
+        setting->record_len = buf_len;
+    }
 
-            *(INT32 *)needle = num;
-            needle += 4;
-            break;
+    xsettings_wire_encode_record (setting->record, name, name_len,
+                                  setting->last_change_serial,
+                                  &wire, &value_offset);
 
-        /* TODO */
-        case XSettingsTypeColor:
-            /* body for XSettingsTypeColor:
-            *
-            * 2  CARD16  red
-            * 2  CARD16  blue
-            * 2  CARD16  green
-            * 2  CARD16  alpha
-            */
-            *(CARD16 *)needle = 0;
-            *(CARD16 *)(needle + 2) = 0;
-            *(CARD16 *)(needle + 4) = 0;
-            *(CARD16 *)(needle + 6) = 0;
-            needle += 8;
-            break;
-
-        default:
-            g_assert_not_reached ();
-            break;
-    }
+    /* remember the offset for screen dependend dpi */
+    setting->dpi_offset = 0;
+    if (G_VALUE_HOLDS_INT (setting->value)
+        && wire.data.v_int < 1
+        && strcmp (name, "Xft/DPI") == 0)
+        setting->dpi_offset = value_offset;
 
-    notify->n_settings++;
+    setting->record_serial = setting->last_change_serial;
 }
 
 
@@ -899,47 +943,67 @@ xfce_xsettings_helper_setting_append (const gchar         *name,
 static void
 xfce_xsettings_helper_notify (XfceXSettingsHelper *helper)
 {
-    XfceXSettingsNotify *notify;
-    CARD32               orderint = 0x01020304;
     guchar              *needle;
     XfceXSettingsScreen *screen;
+    XfceXSetting        *setting;
+    GHashTableIter       iter;
+    gpointer             key, value;
     GSList              *li;
     gint                 dpi;
+    gsize                buf_len;
+    gsize                dpi_offset = 0;
+    guint                n_settings;
+    guint                n_encoded = 0;
 
     g_return_if_fail (XFCE_IS_XSETTINGS_HELPER (helper));
 
-    notify = g_slice_new0 (XfceXSettingsNotify);
-    notify->buf = g_new0 (guchar, 12);
-    if (G_UNLIKELY (notify->buf == NULL))
-      goto errnomem;
-    notify->buf_len = 12;
-    needle = notify->buf;
+    xfsettings_trace (XFSD_HELPER_XSETTINGS, XFSD_TRACE_APPLY_START, 0);
 
-    /* general notification form:
-     *
-     * 1  CARD8   byte-order
-     * 3          unused
-     * 4  CARD32  SERIAL
-     * 4  CARD32  N_SETTINGS
-     */
+    buf_len = XSETTINGS_WIRE_HEADER_SIZE;
 
-    /* byte-order */
-    *(CARD8 *)needle = (*(char *)&orderint == 1) ? MSBFirst : LSBFirst;
-    needle += 4;
+    /* only encode the settings that changed since the previous
+     * notification and sum the length of all the records */
+    g_hash_table_iter_init (&iter, helper->settings);
+    while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+        setting = value;
+        if (setting->record == NULL
+            || setting->record_serial != setting->last_change_serial)
+        {
+            xfce_xsettings_helper_setting_encode (key, setting);
+            n_encoded++;
+        }
 
-    /* serial for this notification */
-    *(CARD32 *)needle = helper->serial++;
+        buf_len += setting->record_len;
+    }
 
-    /* add all the settings */
-    g_hash_table_foreach (helper->settings,
-        (GHFunc) xfce_xsettings_helper_setting_append, notify);
+    /* grow the buffer if the records do not fit */
+    if (helper->buf_size < buf_len)
+    {
+        g_free (helper->buf);
+        helper->buf = g_malloc (buf_len);
+        helper->buf_size = buf_len;
+    }
 
-    if (G_UNLIKELY (notify->buf == NULL))
-      goto errnomem;
+    /* header with the serial for this notification */
+    n_settings = g_hash_table_size (helper->settings);
+    xsettings_wire_encode_header (helper->buf, helper->serial++, n_settings);
+    needle = helper->buf + XSETTINGS_WIRE_HEADER_SIZE;
+
+    /* copy the cached records */
+    g_hash_table_iter_init (&iter, helper->settings);
+    while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+        setting = value;
+
+        if (setting->dpi_offset > 0)
+            dpi_offset = (needle - helper->buf) + setting->dpi_offset;
+
+        memcpy (needle, setting->record, setting->record_len);
+        needle += setting->record_len;
+    }
 
-    /* number of settings */
-    needle = notify->buf + 8;
-    *(CARD32 *)needle = notify->n_settings;
+    g_assert ((gsize) (needle - helper->buf) == buf_len);
 
     gdk_x11_display_error_trap_push (gdk_display_get_default ());
 
@@ -949,16 +1013,15 @@ xfce_xsettings_helper_notify (XfceXSettingsHelper *helper)
         screen = li->data;
 
         /* set the accurate dpi for this screen */
-        if (notify->dpi_offset > 0)
+        if (dpi_offset > 0)
         {
             dpi = xfce_xsettings_helper_screen_dpi (screen);
-            needle = notify->buf + notify->dpi_offset;
-            *(INT32 *)needle = dpi * 1024;
+            xsettings_wire_patch_int (helper->buf, dpi_offset, dpi * 1024);
         }
 
         XChangeProperty (screen->xdisplay, screen->window,
                          helper->xsettings_atom, helper->xsettings_atom,
-                         8, PropModeReplace, notify->buf, notify->buf_len);
+                         8, PropModeReplace, helper->buf, buf_len);
     }
 
     if (gdk_x11_display_error_trap_pop (gdk_display_get_default ()) != 0)
@@ -966,13 +1029,15 @@ xfce_xsettings_helper_notify (XfceXSettingsHelper *helper)
         g_critical ("Failed to set properties");
     }
 
-    xfsettings_dbg (XFSD_DEBUG_XSETTINGS,
-                    "%d settings changed (serial=%lu, len=%"G_GSIZE_FORMAT")",
-                    notify->n_settings, helper->serial - 1, notify->buf_len);
+    /* nothing reached the server without screens */
+    if (helper->screens != NULL)
+        xfsettings_metrics_applied (XFSD_HELPER_XSETTINGS);
+    else
+        xfsettings_metrics_discard (XFSD_HELPER_XSETTINGS);
 
-    g_free (notify->buf);
-  errnomem:
-    g_slice_free (XfceXSettingsNotify, notify);
+    xfsettings_dbg (XFSD_DEBUG_XSETTINGS,
+                    "%u settings changed, %u encoded (serial=%lu, len=%"G_GSIZE_FORMAT")",
+                    n_settings, n_encoded, helper->serial - 1, buf_len);
 }
 
 
@@ -1007,6 +1072,8 @@ xfce_xsettings_helper_event_filter (GdkXEvent *gdkxevent,
             if (xevent->xany.window == screen->window
                 && xevent->xselectionclear.selection == screen->selection_atom)
             {
+                xfsettings_trace (XFSD_HELPER_XSETTINGS, XFSD_TRACE_X_EVENT, xevent->type);
+
                 /* remove the screen */
                 helper->screens = g_slist_delete_link (helper->screens, li);
                 xfce_xsettings_helper_screen_free (screen);
@@ -1016,7 +1083,7 @@ xfce_xsettings_helper_event_filter (GdkXEvent *gdkxevent,
 
                 /* remove this filter if there are no screens */
                 if (helper->screens == NULL)
-                    gdk_window_remove_filter (NULL, xfce_xsettings_helper_event_filter, data);
+                    xfsettings_dispatcher_remove (xfce_xsettings_helper_event_filter, data);
 
                 return GDK_FILTER_REMOVE;
             }
@@ -1037,7 +1104,7 @@ xfce_xsettings_helper_timestamp_predicate (Display  *xdisplay,
 
     return (xevent->type == PropertyNotify
             && xevent->xproperty.window == window
-            && xevent->xproperty.atom == XInternAtom (xdisplay, "_TIMESTAMP_PROP", False));
+            && xevent->xproperty.atom == xfsettings_atom (XFSD_ATOM_TIMESTAMP_PROP));
 }
 
 
@@ -1051,7 +1118,7 @@ xfce_xsettings_get_server_time (Display *xdisplay,
     XEvent xevent;
 
     /* get the current xserver timestamp */
-    timestamp_atom = XInternAtom (xdisplay, "_TIMESTAMP_PROP", False);
+    timestamp_atom = xfsettings_atom (XFSD_ATOM_TIMESTAMP_PROP);
     XChangeProperty (xdisplay, window, timestamp_atom, timestamp_atom,
                      8, PropModeReplace, &c, 1);
     XIfEvent (xdisplay, &xevent, xfce_xsettings_helper_timestamp_predicate,
@@ -1084,7 +1151,7 @@ xfce_xsettings_helper_register (XfceXSettingsHelper *helper,
     g_return_val_if_fail (helper->screens == NULL, FALSE);
 
     xdisplay = GDK_DISPLAY_XDISPLAY (gdkdisplay);
-    helper->xsettings_atom = XInternAtom (xdisplay, "_XSETTINGS_SETTINGS", False);
+    helper->xsettings_atom = xfsettings_atom (XFSD_ATOM_XSETTINGS_SETTINGS);
 
     gdk_x11_display_error_trap_push (gdk_display_get_default ());
 
@@ -1093,7 +1160,7 @@ xfce_xsettings_helper_register (XfceXSettingsHelper *helper,
     for (n = 0; n < n_screens; n++)
     {
         g_snprintf (atom_name, sizeof (atom_name), "_XSETTINGS_S%d", n);
-        selection_atom = XInternAtom (xdisplay, atom_name, False);
+        selection_atom = xfsettings_atoms_lookup (atom_name, FALSE);
 
         if (!force_replace
             && XGetSelectionOwner (xdisplay, selection_atom) != None)
@@ -1122,7 +1189,7 @@ xfce_xsettings_helper_register (XfceXSettingsHelper *helper,
             /* register this xsettings window for this screen */
             xev.type = ClientMessage;
             xev.window = root_window;
-            xev.message_type = XInternAtom (xdisplay, "MANAGER", True);
+            xev.message_type = xfsettings_atom (XFSD_ATOM_MANAGER);
             xev.format = 32;
             xev.data.l[0] = timestamp;
             xev.data.l[1] = selection_atom;
@@ -1172,14 +1239,17 @@ xfce_xsettings_helper_register (XfceXSettingsHelper *helper,
     if (helper->screens != NULL)
     {
         /* watch for selection changes */
-        gdk_window_add_filter (NULL, xfce_xsettings_helper_event_filter, helper);
+        xfsettings_dispatcher_add (SelectionClear, xfce_xsettings_helper_event_filter, helper);
+
+        /* keep the resource manager database around for xft updates */
+        helper->xresources = xfce_xresources_new (gdkdisplay);
 
         /* send notifications */
         xfce_xsettings_helper_notify (helper);
         xfce_xsettings_helper_notify_xft (helper);
 
-        /* startup fontconfig monitoring */
-        helper->fc_init_id = g_idle_add (xfce_xsettings_helper_fc_init, helper);
+        /* initialize fontconfig and start monitoring in a worker thread */
+        xfce_xsettings_helper_fc_start (helper, TRUE);
 
         return TRUE;
     }
@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Accounting of the synchronous X requests done by the helpers. A scope
+ * is put around code that waits for the X server, usually an error trap
+ * or a request with a reply; per helper and code path the number of
+ * round trips, the protocol requests issued and the time spent waiting
+ * are recorded, together with the writes that were skipped because the
+ * server already had the value. The numbers are written to stderr on
+ * SIGUSR1 together with the trace and are available with the GetXStats
+ * method of the metrics interface.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <gdk/gdk.h>
+#include <gdk/gdkx.h>
+#include <X11/Xlib.h>
+
+#include "xstats.h"
+#include "xtrap.h"
+#include "metrics.h"
+
+
+
+typedef struct _XfsdXStatsEntry XfsdXStatsEntry;
+
+
+
+struct _XfsdXStatsEntry
+{
+    /* times the scope waited for the server */
+    guint64 n_round_trips;
+
+    /* protocol requests issued in the scope */
+    guint64 n_requests;
+
+    /* time spent in the scope */
+    guint64 blocked_us;
+    guint64 max_us;
+
+    /* writes skipped because they would not change anything */
+    guint64 n_elided;
+};
+
+/* code path -> XfsdXStatsEntry, per helper */
+static GHashTable *xstats[XFSD_N_HELPERS];
+
+
+
+static XfsdXStatsEntry *
+xfsettings_xstats_entry (XfsdHelper   helper,
+                         const gchar *path)
+{
+    XfsdXStatsEntry *entry;
+
+    /* paths are static strings, so they are not copied */
+    if (G_UNLIKELY (xstats[helper] == NULL))
+        xstats[helper] = g_hash_table_new (g_str_hash, g_str_equal);
+
+    entry = g_hash_table_lookup (xstats[helper], path);
+    if (G_UNLIKELY (entry == NULL))
+    {
+        entry = g_slice_new0 (XfsdXStatsEntry);
+        g_hash_table_insert (xstats[helper], (gpointer) path, entry);
+    }
+
+    return entry;
+}
+
+
+
+void
+xfsettings_xstats_begin (XfsdXStatsScope *scope,
+                         XfsdHelper       helper,
+                         const gchar     *path,
+                         Display         *xdisplay)
+{
+    g_return_if_fail (helper < XFSD_N_HELPERS);
+    g_return_if_fail (path != NULL);
+
+    scope->helper = helper;
+    scope->path = path;
+    scope->xdisplay = xdisplay;
+    scope->start_request = XNextRequest (xdisplay);
+    scope->start_time = g_get_monotonic_time ();
+}
+
+
+
+void
+xfsettings_xstats_end (XfsdXStatsScope *scope)
+{
+    XfsdXStatsEntry *entry;
+    guint64          elapsed;
+
+    elapsed = g_get_monotonic_time () - scope->start_time;
+
+    entry = xfsettings_xstats_entry (scope->helper, scope->path);
+    entry->n_round_trips++;
+    entry->n_requests += XNextRequest (scope->xdisplay) - scope->start_request;
+    entry->blocked_us += elapsed;
+    entry->max_us = MAX (entry->max_us, elapsed);
+}
+
+
+
+void
+xfsettings_xstats_trap_push (XfsdXStatsScope *scope,
+                             XfsdHelper       helper,
+                             const gchar     *path)
+{
+    GdkDisplay *display = gdk_display_get_default ();
+
+    xfsettings_xstats_begin (scope, helper, path, GDK_DISPLAY_XDISPLAY (display));
+
+    /* the transaction handles the errors, see xtrap.c */
+    if (xfsettings_xtrap_is_active ())
+        xfsettings_xtrap_push (NULL);
+    else
+        gdk_x11_display_error_trap_push (display);
+}
+
+
+
+gint
+xfsettings_xstats_trap_pop (XfsdXStatsScope *scope)
+{
+    gint error;
+
+    /* this syncs with the server */
+    if (xfsettings_xtrap_is_active ())
+        error = xfsettings_xtrap_pop_sync ();
+    else
+        error = gdk_x11_display_error_trap_pop (gdk_display_get_default ());
+    xfsettings_xstats_end (scope);
+
+    return error;
+}
+
+
+
+void
+xfsettings_xstats_elided (XfsdHelper   helper,
+                          const gchar *path)
+{
+    g_return_if_fail (helper < XFSD_N_HELPERS);
+    g_return_if_fail (path != NULL);
+
+    xfsettings_xstats_entry (helper, path)->n_elided++;
+}
+
+
+
+GVariant *
+xfsettings_xstats_collect (void)
+{
+    GVariantBuilder  builder;
+    GHashTableIter   iter;
+    gpointer         key, value;
+    XfsdXStatsEntry *entry;
+    guint            n;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ssttttt)"));
+
+    for (n = 0; n < XFSD_N_HELPERS; n++)
+    {
+        if (xstats[n] == NULL)
+            continue;
+
+        g_hash_table_iter_init (&iter, xstats[n]);
+        while (g_hash_table_iter_next (&iter, &key, &value))
+        {
+            entry = value;
+            g_variant_builder_add (&builder, "(ssttttt)",
+                                   xfsettings_metrics_helper_name (n), key,
+                                   entry->n_round_trips, entry->n_requests,
+                                   entry->blocked_us, entry->max_us,
+                                   entry->n_elided);
+        }
+    }
+
+    return g_variant_builder_end (&builder);
+}
+
+
+
+void
+xfsettings_xstats_dump (void)
+{
+    GHashTableIter   iter;
+    gpointer         key, value;
+    XfsdXStatsEntry *entry;
+    guint            n;
+    guint64          round_trips, blocked_us, elided;
+
+    g_printerr (PACKAGE_NAME ": X round trips per helper\n");
+
+    for (n = 0; n < XFSD_N_HELPERS; n++)
+    {
+        if (xstats[n] == NULL)
+            continue;
+
+        round_trips = blocked_us = elided = 0;
+
+        g_hash_table_iter_init (&iter, xstats[n]);
+        while (g_hash_table_iter_next (&iter, &key, &value))
+        {
+            entry = value;
+            round_trips += entry->n_round_trips;
+            blocked_us += entry->blocked_us;
+            elided += entry->n_elided;
+        }
+
+        g_printerr ("  %-18s %8"G_GUINT64_FORMAT" round trips %10.3f ms, "
+                    "%"G_GUINT64_FORMAT" writes elided\n",
+                    xfsettings_metrics_helper_name (n), round_trips,
+                    blocked_us / 1000.0, elided);
+
+        g_hash_table_iter_init (&iter, xstats[n]);
+        while (g_hash_table_iter_next (&iter, &key, &value))
+        {
+            entry = value;
+            g_printerr ("    %-24s %8"G_GUINT64_FORMAT" round trips "
+                        "%8"G_GUINT64_FORMAT" requests %10.3f ms (max %.3f ms) "
+                        "%8"G_GUINT64_FORMAT" elided\n",
+                        (const gchar *) key, entry->n_round_trips, entry->n_requests,
+                        entry->blocked_us / 1000.0, entry->max_us / 1000.0,
+                        entry->n_elided);
+        }
+    }
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __XSTATS_H__
+#define __XSTATS_H__
+
+#include <glib.h>
+#include <X11/Xlib.h>
+
+#include "metrics.h"
+
+typedef struct _XfsdXStatsScope XfsdXStatsScope;
+
+struct _XfsdXStatsScope
+{
+    XfsdHelper   helper;
+    const gchar *path;
+    Display     *xdisplay;
+    gint64       start_time;
+    gulong       start_request;
+};
+
+void      xfsettings_xstats_begin     (XfsdXStatsScope *scope,
+                                       XfsdHelper       helper,
+                                       const gchar     *path,
+                                       Display         *xdisplay);
+
+void      xfsettings_xstats_end       (XfsdXStatsScope *scope);
+
+void      xfsettings_xstats_trap_push (XfsdXStatsScope *scope,
+                                       XfsdHelper       helper,
+                                       const gchar     *path);
+
+gint      xfsettings_xstats_trap_pop  (XfsdXStatsScope *scope);
+
+void      xfsettings_xstats_elided    (XfsdHelper       helper,
+                                       const gchar     *path);
+
+GVariant *xfsettings_xstats_collect   (void);
+
+void      xfsettings_xstats_dump      (void);
+
+#endif /* !__XSTATS_H__ */
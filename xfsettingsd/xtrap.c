@@ -0,0 +1,295 @@
+/*
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Error trap transactions. A gdk error trap waits for the server when
+ * it is popped, so a helper applying a dozen settings pays a dozen round
+ * trips. Inside a transaction the X writes are only tagged with the range
+ * of request serials they used; the errors are collected by our own error
+ * handler and the server is synced once when the outermost transaction
+ * is committed. Each error is then reported against the range, and thus
+ * the setting, that caused it.
+ *
+ * Transactions nest: a setter opens its own transaction, so it works on
+ * its own, and when it is called from an apply-all function that opened
+ * one before, its requests are synced together with the others.
+ *
+ * The xstats traps are transaction aware, so a request with a reply in
+ * a transaction does not install a gdk trap (and with it the gdk error
+ * handler) while our handler is active.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <gdk/gdk.h>
+#include <gdk/gdkx.h>
+#include <X11/Xlib.h>
+
+#include "xtrap.h"
+#include "xstats.h"
+#include "metrics.h"
+
+
+
+typedef struct _XfsdXTrapRange XfsdXTrapRange;
+
+
+
+struct _XfsdXTrapRange
+{
+    /* description for the error message, NULL
+     * for ranges popped with xfsettings_xtrap_pop_sync() */
+    gchar        *what;
+
+    /* request serials in the range, end is exclusive */
+    gulong        start;
+    gulong        end;
+    guint         open : 1;
+
+    /* first error in the range */
+    gint          error_code;
+    guchar        request_code;
+    guchar        minor_code;
+};
+
+static struct
+{
+    guint          depth;
+    Display       *xdisplay;
+    XErrorHandler  previous_handler;
+
+    /* for the round trip accounting */
+    XfsdHelper     helper;
+    const gchar   *path;
+    gulong         start_request;
+
+    /* array of XfsdXTrapRange */
+    GArray        *ranges;
+}
+transaction;
+
+
+
+static int
+xfsettings_xtrap_error_handler (Display     *xdisplay,
+                                XErrorEvent *error)
+{
+    XfsdXTrapRange *range;
+    guint           i;
+
+    if (xdisplay == transaction.xdisplay)
+    {
+        /* walk backwards so nested ranges get the error */
+        for (i = transaction.ranges->len; i > 0; i--)
+        {
+            range = &g_array_index (transaction.ranges, XfsdXTrapRange, i - 1);
+            if (error->serial < range->start
+                || (!range->open && error->serial >= range->end))
+                continue;
+
+            if (range->error_code == 0)
+            {
+                range->error_code = error->error_code;
+                range->request_code = error->request_code;
+                range->minor_code = error->minor_code;
+            }
+
+            return 0;
+        }
+    }
+
+    /* not one of our requests, let gdk handle it */
+    if (transaction.previous_handler != NULL)
+        return transaction.previous_handler (xdisplay, error);
+
+    return 0;
+}
+
+
+
+static XfsdXTrapRange *
+xfsettings_xtrap_close_range (void)
+{
+    XfsdXTrapRange *range;
+    guint           i;
+
+    for (i = transaction.ranges->len; i > 0; i--)
+    {
+        range = &g_array_index (transaction.ranges, XfsdXTrapRange, i - 1);
+        if (range->open)
+        {
+            range->end = XNextRequest (transaction.xdisplay);
+            range->open = FALSE;
+
+            return range;
+        }
+    }
+
+    g_critical ("Error trap popped without a push");
+
+    return NULL;
+}
+
+
+
+void
+xfsettings_xtrap_begin (XfsdHelper   helper,
+                        const gchar *path)
+{
+    g_return_if_fail (helper < XFSD_N_HELPERS);
+    g_return_if_fail (path != NULL);
+
+    /* join the running transaction */
+    if (transaction.depth++ > 0)
+        return;
+
+    if (G_UNLIKELY (transaction.ranges == NULL))
+        transaction.ranges = g_array_new (FALSE, TRUE, sizeof (XfsdXTrapRange));
+
+    transaction.xdisplay = GDK_DISPLAY_XDISPLAY (gdk_display_get_default ());
+    transaction.helper = helper;
+    transaction.path = path;
+    transaction.start_request = XNextRequest (transaction.xdisplay);
+
+    transaction.previous_handler = XSetErrorHandler (xfsettings_xtrap_error_handler);
+}
+
+
+
+void
+xfsettings_xtrap_push (const gchar *format,
+                       ...)
+{
+    XfsdXTrapRange range = { NULL, };
+    va_list        args;
+
+    g_return_if_fail (transaction.depth > 0);
+
+    if (format != NULL)
+    {
+        va_start (args, format);
+        range.what = g_strdup_vprintf (format, args);
+        va_end (args);
+    }
+
+    range.start = XNextRequest (transaction.xdisplay);
+    range.open = TRUE;
+
+    g_array_append_val (transaction.ranges, range);
+}
+
+
+
+void
+xfsettings_xtrap_pop (void)
+{
+    g_return_if_fail (transaction.depth > 0);
+
+    /* the errors are checked on commit */
+    xfsettings_xtrap_close_range ();
+}
+
+
+
+gint
+xfsettings_xtrap_pop_sync (void)
+{
+    XfsdXTrapRange *range;
+
+    g_return_val_if_fail (transaction.depth > 0, 0);
+
+    range = xfsettings_xtrap_close_range ();
+    if (G_UNLIKELY (range == NULL))
+        return 0;
+
+    /* a reply in the range already flushed the errors */
+    if (range->end > range->start
+        && XLastKnownRequestProcessed (transaction.xdisplay) < range->end - 1)
+        XSync (transaction.xdisplay, False);
+
+    return range->error_code;
+}
+
+
+
+gint
+xfsettings_xtrap_commit (void)
+{
+    XfsdXStatsScope  xstats;
+    XfsdXTrapRange  *range;
+    gchar            text[256];
+    gint             n_errors = 0;
+    guint            i;
+
+    g_return_val_if_fail (transaction.depth > 0, 0);
+
+    /* the outermost transaction reports the errors */
+    if (--transaction.depth > 0)
+        return 0;
+
+    if (transaction.ranges->len > 0
+        && XLastKnownRequestProcessed (transaction.xdisplay)
+           < XNextRequest (transaction.xdisplay) - 1)
+    {
+        xfsettings_xstats_begin (&xstats, transaction.helper, transaction.path,
+                                 transaction.xdisplay);
+        xstats.start_request = transaction.start_request;
+
+        /* the only round trip of the transaction */
+        XSync (transaction.xdisplay, False);
+
+        xfsettings_xstats_end (&xstats);
+    }
+
+    XSetErrorHandler (transaction.previous_handler);
+    transaction.previous_handler = NULL;
+
+    for (i = 0; i < transaction.ranges->len; i++)
+    {
+        range = &g_array_index (transaction.ranges, XfsdXTrapRange, i);
+
+        if (G_UNLIKELY (range->open))
+            g_critical ("Error trap for \"%s\" was not popped", range->what);
+
+        if (range->what != NULL && range->error_code != 0)
+        {
+            XGetErrorText (transaction.xdisplay, range->error_code, text, sizeof (text));
+            g_critical ("Failed to %s: %s (request %d.%d)", range->what, text,
+                        range->request_code, range->minor_code);
+
+            n_errors++;
+        }
+
+        g_free (range->what);
+    }
+
+    g_array_set_size (transaction.ranges, 0);
+
+    return n_errors;
+}
+
+
+
+gboolean
+xfsettings_xtrap_is_active (void)
+{
+    return transaction.depth > 0;
+}
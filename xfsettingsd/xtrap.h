@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2011 Nick Schermer <nick@xfce.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __XTRAP_H__
+#define __XTRAP_H__
+
+#include <glib.h>
+
+#include "metrics.h"
+
+void     xfsettings_xtrap_begin     (XfsdHelper   helper,
+                                     const gchar *path);
+
+void     xfsettings_xtrap_push      (const gchar *format,
+                                     ...) G_GNUC_PRINTF (1, 2);
+
+void     xfsettings_xtrap_pop       (void);
+
+gint     xfsettings_xtrap_pop_sync  (void);
+
+gint     xfsettings_xtrap_commit    (void);
+
+gboolean xfsettings_xtrap_is_active (void);
+
+#endif /* !__XTRAP_H__ */